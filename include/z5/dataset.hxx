@@ -8,6 +8,9 @@
 #include "z5/util/util.hxx"
 #include "z5/util/blocking.hxx"
 #include "z5/util/format_data.hxx"
+#include "z5/util/mapped_file.hxx"
+#include "z5/util/chunk_cache.hxx"
+#include "z5/util/threadpool.hxx"
 
 // different compression backends
 #include "z5/compression/raw_compressor.hxx"
@@ -34,7 +37,10 @@ namespace z5 {
                                                     chunkShape_(metadata.chunkShape),
                                                     chunkSize_(std::accumulate(chunkShape_.begin(), chunkShape_.end(), std::size_t(1), std::multiplies<std::size_t>())),
                                                     zarrDelimiter_(metadata.zarrDelimiter),
-                                                    chunking_(shape_, chunkShape_)
+                                                    chunking_(shape_, chunkShape_),
+                                                    chunkCache_(util::chunkCacheBytes()),
+                                                    storedChunkCache_(util::storedChunkCacheBytes(),
+                                                                      util::storedChunkCacheAdmission())
         {}
 
         // Destructor
@@ -91,6 +97,12 @@ namespace z5 {
         inline types::Datatype getDtype() const {return dtype_;}
         inline bool isZarr() const {return isZarr_;}
 
+        // decoded chunks consulted by readSubarray (see util::setChunkCacheBytes) and the
+        // stored bytes of chunks consulted by the chunk reads of the implementations (see
+        // util::setStoredChunkCacheBytes); the write paths invalidate the chunks they change
+        inline util::DecodedChunkCache & chunkCache() const {return chunkCache_;}
+        inline util::StoredChunkCache & storedChunkCache() const {return storedChunkCache_;}
+
         // sharding (zarr v3) - default: not sharded; overridden by ShardedDataset
         virtual bool isSharded() const {return false;}
         virtual types::ShapeType shardShape() const {return types::ShapeType();}
@@ -102,20 +114,76 @@ namespace z5 {
         // read all per-slot inner-chunk blobs of a shard (empty vector for empty slots)
         virtual void readShardBlobs(const types::ShapeType &,
                                     std::vector<std::vector<char>> &) const {}
-        // read a shard once into a raw buffer, reporting per-slot byte offset + length
-        // (length 0 for empty slots) so the read path can decode in-place without copying
-        // each blob out. Returns false if the shard file is absent.
-        virtual bool readShardRaw(const types::ShapeType &, std::vector<char> &,
+        // read the slots `slots` of a shard into a raw buffer, reporting per-slot byte offset
+        // + length within it (length 0 for empty slots and slots that were not read) so the
+        // read path can decode in-place without copying each blob out. Depending on how
+        // many slots are needed, the whole shard or only its index and the needed slots are
+        // read. Returns false if the shard file is absent.
+        virtual bool readShardRaw(const types::ShapeType &, const std::vector<std::size_t> &,
+                                  std::vector<char> &,
                                   std::vector<std::size_t> &,
                                   std::vector<std::size_t> &) const {return false;}
         // build and write a shard from its per-slot blobs (removes the file if all empty)
         virtual void writeShardBlobs(const types::ShapeType &,
                                      const std::vector<std::vector<char>> &) const {}
-        // compress one inner chunk to its on-disk blob; returns false if it is all-fill
-        // (-> empty slot), in which case 'blob' is left empty
+        // in-place shard updates (stores that can append to objects, if enabled):
+        // readShardSlots reads the blobs of the given slots only (blobs[k] for slots[k]),
+        // updateShardSlots replaces them and keeps the other slots. Where
+        // appendsShardUpdates() is false, updateShardSlots rewrites the whole shard.
+        virtual bool appendsShardUpdates() const {return false;}
+        // write the chunks a sharded dataset holds back (see util::setShardWriteBackBytes)
+        // and wait for the writes the store completes in the background (S3 write-behind)
+        virtual void flush() const {}
+        virtual void readShardSlots(const types::ShapeType &, const std::vector<std::size_t> &,
+                                    std::vector<std::vector<char>> &) const {}
+        virtual void updateShardSlots(const types::ShapeType &, const std::vector<std::size_t> &,
+                                      const std::vector<std::vector<char>> &) const {}
+
+        // compress one chunk to its stored bytes (for sharded datasets: the inner chunk's
+        // slot blob); returns false if it is all-fill (-> nothing to store). Together with
+        // writeRawChunk this splits writeChunk into its CPU and IO halves for the staged
+        // write paths.
         virtual bool makeChunkBlob(const types::ShapeType &, const void *,
                                    std::vector<char> &) const {return false;}
 
+        // read the stored bytes of several chunks (as readRawChunk; a missing chunk yields
+        // an empty buffer). Stores with batched reads fetch them with a single request;
+        // readBatchSize() is the number of chunks worth passing at once (1: no batching).
+        virtual void readRawChunks(const std::vector<types::ShapeType> & chunkIds,
+                                   const std::vector<std::vector<char> *> & buffers) const {
+            for(std::size_t i = 0; i < chunkIds.size(); ++i) {
+                readRawChunk(chunkIds[i], *buffers[i]);
+            }
+        }
+        virtual std::size_t readBatchSize() const {return 1;}
+
+        // listing-driven removal (stores with ListableChunkStorePolicy): listChunks appends
+        // the ids of the chunks that may exist, found in one listing of the dataset instead
+        // of one existence check per grid position, and must only be called if
+        // listsChunks(). It includes all chunks that exist; sharded datasets list every
+        // inner chunk of the shards that exist, so check chunkExists for those.
+        // removeChunks removes several chunks on `nThreads` threads, with batched
+        // requests where the store has them.
+        virtual bool listsChunks() const {return false;}
+        virtual void listChunks(std::vector<types::ShapeType> &) const {}
+        virtual void removeChunks(const std::vector<types::ShapeType> & chunkIds, const int nThreads) const {
+            util::parallel_foreach(nThreads, chunkIds.size(), [&](const int, const std::size_t i){
+                removeChunk(chunkIds[i]);
+            });
+        }
+
+        // memory mapped reads (stores with MappedChunkStorePolicy): the zero-copy read
+        // paths of uncompressed datasets copy chunk / shard slot bytes straight from the
+        // mapping into the output. mapRawChunk maps a chunk's stored bytes (as
+        // readRawChunk), mapShardRaw a shard (as readShardRaw); both return false if the
+        // object does not exist and must only be called if supportsMappedReads().
+        virtual bool supportsMappedReads() const {return false;}
+        virtual bool mapRawChunk(const types::ShapeType &, util::MappedFile &) const {return false;}
+        virtual bool mapShardRaw(const types::ShapeType &, const std::vector<std::size_t> &,
+                                 util::MappedFile &,
+                                 std::vector<std::size_t> &,
+                                 std::vector<std::size_t> &) const {return false;}
+
         //
         // API - MUST implement
         //
@@ -128,6 +196,9 @@ namespace z5 {
         virtual bool readChunk(const types::ShapeType &, void *) const = 0;
         // read a chunk; return the unformatted data
         virtual void readRawChunk(const types::ShapeType &, std::vector<char> &) const = 0;
+        // write a chunk's stored bytes as produced by makeChunkBlob; an empty buffer
+        // (all-fill chunk) removes the chunk
+        virtual void writeRawChunk(const types::ShapeType &, const std::vector<char> &) const = 0;
 
         // check the request type
         virtual void checkRequestType(const std::type_info &) const = 0;
@@ -157,6 +228,23 @@ namespace z5 {
         virtual void remove() const = 0;
 
     protected:
+        // drop the cached data of the chunks a write changed (see chunkCache)
+        inline void invalidateCachedChunk(const types::ShapeType & chunkId) const {
+            storedChunkCache_.invalidate(chunkId);
+            chunkCache_.invalidate(chunkId);
+        }
+
+        template<class PRED>
+        inline void invalidateCachedChunksIf(PRED && pred) const {
+            storedChunkCache_.invalidateIf(pred);
+            chunkCache_.invalidateIf(pred);
+        }
+
+        inline void clearCachedChunks() const {
+            storedChunkCache_.clear();
+            chunkCache_.clear();
+        }
+
         // private members:
         bool isZarr_;
         types::Datatype dtype_;
@@ -166,6 +254,9 @@ namespace z5 {
         std::string zarrDelimiter_;
 
         util::Blocking chunking_;
+
+        mutable util::DecodedChunkCache chunkCache_;
+        mutable util::StoredChunkCache storedChunkCache_;
     };
 
 
@@ -131,13 +131,14 @@ namespace z5 {
         const std::string & zarrDelimiter=".",
         const int zarrFormat=2,
         const std::string & chunkKeyEncoding="default",
-        const types::ShapeType & shardShape=types::ShapeType()
+        const types::ShapeType & shardShape=types::ShapeType(),
+        const std::string & shardIndexLocation="end"
     ) {
         DatasetMetadata metadata;
         createDatasetMetadata(dtype, shape, chunkShape, root.isZarr(),
                               compressor, compressionOptions, fillValue,
                               zarrDelimiter, metadata,
-                              zarrFormat, chunkKeyEncoding, shardShape);
+                              zarrFormat, chunkKeyEncoding, shardShape, shardIndexLocation);
 
         #ifdef WITH_S3
         if(root.isS3()) {
@@ -174,7 +175,8 @@ namespace z5 {
         const std::string & zarrDelimiter=".",
         const int zarrFormat=2,
         const std::string & chunkKeyEncoding="default",
-        const types::ShapeType & shardShape=types::ShapeType()
+        const types::ShapeType & shardShape=types::ShapeType(),
+        const std::string & shardIndexLocation="end"
     ) {
         types::Compressor internalCompressor;
         try {
@@ -187,7 +189,7 @@ namespace z5 {
         types::jsonToCompressionType(compressionOptions, cOpts);
 
         return createDataset(root, key, dtype, shape, chunkShape, compressor, cOpts, fillValue,
-                             zarrDelimiter, zarrFormat, chunkKeyEncoding, shardShape);
+                             zarrDelimiter, zarrFormat, chunkKeyEncoding, shardShape, shardIndexLocation);
     }
 
 
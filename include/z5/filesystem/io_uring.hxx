@@ -0,0 +1,521 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#ifdef WITH_IO_URING
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "z5/filesystem/handle.hxx"
+
+
+namespace z5 {
+namespace filesystem {
+
+    //
+    // io_uring batched chunk reads
+    //
+    // Reading a chunk file with std::ifstream costs exists + open + seek + tell + read +
+    // close, i.e. 5+ syscalls per chunk, which dominates reads of small chunks from NVMe.
+    // readFilesBatched submits the open / statx / read / close requests of a whole batch
+    // of files to an io_uring and reaps the completions as they arrive, so a batch costs
+    // a handful of io_uring_enter calls and all of its reads are in flight at once.
+    // The ring is set up directly with the kernel interface (no liburing dependency). If
+    // io_uring is not compiled in (WITH_IO_URING) or not available at runtime (old kernel,
+    // seccomp, io_uring_disabled), or disabled with setUseIoUring(false), the callers fall
+    // back to the blocking reads.
+    //
+
+    namespace uring_detail {
+        inline std::atomic<bool> & useIoUring() {
+            static std::atomic<bool> use(true);
+            return use;
+        }
+        // cleared once setting up a ring or one of the required operations failed
+        inline std::atomic<bool> & ioUringWorks() {
+            static std::atomic<bool> works(true);
+            return works;
+        }
+    }
+
+    // Enable / disable the io_uring reads (enabled by default where available).
+    inline void setUseIoUring(const bool use) {
+        uring_detail::useIoUring() = use;
+    }
+
+#ifdef WITH_IO_URING
+
+    namespace uring_detail {
+
+        // A minimal single-threaded io_uring: one ring per thread, created on first use.
+        class Ring {
+        public:
+            static constexpr unsigned depth = 64;
+
+            Ring() {
+                io_uring_params params;
+                std::memset(&params, 0, sizeof(params));
+                fd_ = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+                if(fd_ < 0) {
+                    return;
+                }
+
+                sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+                cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+                if(singleMmap) {
+                    sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+                }
+                sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                               fd_, IORING_OFF_SQ_RING);
+                if(sqRing_ == MAP_FAILED) {
+                    sqRing_ = nullptr;
+                    close();
+                    return;
+                }
+                cqRing_ = singleMmap ? sqRing_ : mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE,
+                                                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+                if(cqRing_ == MAP_FAILED) {
+                    cqRing_ = nullptr;
+                    close();
+                    return;
+                }
+                sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+                sqes_ = static_cast<io_uring_sqe *>(mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                                                         MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+                if(sqes_ == MAP_FAILED) {
+                    sqes_ = nullptr;
+                    close();
+                    return;
+                }
+
+                char * sq = static_cast<char *>(sqRing_);
+                sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+                sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+                sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+                sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+                sqEntries_ = params.sq_entries;
+
+                char * cq = static_cast<char *>(cqRing_);
+                cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+                cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+                cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+                cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+            }
+
+            ~Ring() {
+                close();
+            }
+
+            Ring(const Ring &) = delete;
+            Ring & operator=(const Ring &) = delete;
+
+            inline bool ok() const {
+                return fd_ >= 0;
+            }
+
+            // number of submission queue entries
+            inline unsigned capacity() const {
+                return sqEntries_;
+            }
+
+            // get a zeroed submission entry; the caller must not queue more than capacity()
+            // entries between two calls of submitAndWait
+            inline io_uring_sqe * nextSqe() {
+                const unsigned tail = *sqTail_ + pendingTail_;
+                const unsigned index = tail & sqMask_;
+                io_uring_sqe * sqe = &sqes_[index];
+                std::memset(sqe, 0, sizeof(io_uring_sqe));
+                sqArray_[index] = index;
+                // published by submitAndWait
+                ++pendingTail_;
+                return sqe;
+            }
+
+            // submit the queued entries and wait for at least `minComplete` completions;
+            // returns false if io_uring_enter failed
+            inline bool submitAndWait(const unsigned minComplete) {
+                if(pendingTail_ > 0) {
+                    std::atomic_ref<unsigned>(*sqTail_).store(*sqTail_ + pendingTail_, std::memory_order_release);
+                    pendingTail_ = 0;
+                }
+                while(true) {
+                    const unsigned toSubmit = *sqTail_ - std::atomic_ref<unsigned>(*sqHead_).load(std::memory_order_acquire);
+                    const long ret = syscall(__NR_io_uring_enter, fd_, toSubmit, minComplete,
+                                             IORING_ENTER_GETEVENTS, nullptr, 0);
+                    if(ret >= 0) {
+                        return true;
+                    }
+                    if(errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                        return false;
+                    }
+                }
+            }
+
+            // call `f(userData, result)` for all available completions; each completion
+            // is consumed before `f` sees it, so an exception from `f` loses none of the others
+            template<class F>
+            inline void reap(F && f) {
+                unsigned head = *cqHead_;
+                const unsigned tail = std::atomic_ref<unsigned>(*cqTail_).load(std::memory_order_acquire);
+                while(head != tail) {
+                    const io_uring_cqe & cqe = cqes_[head & cqMask_];
+                    const uint64_t data = cqe.user_data;
+                    const int res = cqe.res;
+                    ++head;
+                    std::atomic_ref<unsigned>(*cqHead_).store(head, std::memory_order_release);
+                    f(data, res);
+                }
+            }
+
+        private:
+            inline void close() {
+                if(sqes_) {
+                    munmap(sqes_, sqesSize_);
+                    sqes_ = nullptr;
+                }
+                if(cqRing_ && cqRing_ != sqRing_) {
+                    munmap(cqRing_, cqRingSize_);
+                }
+                cqRing_ = nullptr;
+                if(sqRing_) {
+                    munmap(sqRing_, sqRingSize_);
+                    sqRing_ = nullptr;
+                }
+                if(fd_ >= 0) {
+                    ::close(fd_);
+                    fd_ = -1;
+                }
+            }
+
+            int fd_ = -1;
+            void * sqRing_ = nullptr;
+            void * cqRing_ = nullptr;
+            io_uring_sqe * sqes_ = nullptr;
+            std::size_t sqRingSize_ = 0, cqRingSize_ = 0, sqesSize_ = 0;
+            unsigned * sqHead_ = nullptr;
+            unsigned * sqTail_ = nullptr;
+            unsigned * sqArray_ = nullptr;
+            unsigned sqMask_ = 0, sqEntries_ = 0, pendingTail_ = 0;
+            unsigned * cqHead_ = nullptr;
+            unsigned * cqTail_ = nullptr;
+            unsigned cqMask_ = 0;
+            io_uring_cqe * cqes_ = nullptr;
+        };
+
+        inline std::unique_ptr<Ring> & threadRingStorage() {
+            thread_local std::unique_ptr<Ring> ring;
+            return ring;
+        }
+
+        // the calling thread's ring, or nullptr if io_uring cannot be used
+        inline Ring * threadRing() {
+            if(!useIoUring() || !ioUringWorks()) {
+                return nullptr;
+            }
+            auto & ring = threadRingStorage();
+            if(!ring) {
+                ring.reset(new Ring());
+                if(!ring->ok()) {
+                    ioUringWorks() = false;
+                }
+            }
+            return ring->ok() ? ring.get() : nullptr;
+        }
+
+        // state of one file of a batch
+        struct FileRead {
+            enum Stage {pending, opening, reading, closing, done};
+            Stage stage = pending;
+            int fd = -1;
+            int openResult = -1;
+            int statxResult = 0;
+            unsigned nOutstanding = 0;
+            struct statx stx;
+            std::size_t nRead = 0;
+            // handled by the blocking fallback after the batch
+            bool fallback = false;
+        };
+
+        // the user data of a request: file index and operation
+        enum Op : uint64_t {opOpen = 0, opStatx = 1, opRead = 2, opClose = 3};
+
+        inline uint64_t userData(const std::size_t file, const Op op) {
+            return (static_cast<uint64_t>(file) << 2) | op;
+        }
+
+    }
+
+
+    // Read the files `paths[i]` into `*buffers[i]` using the calling thread's io_uring.
+    // Missing files yield `found[i] = false` and an empty buffer. Files that could not be
+    // read for any other reason are marked with `retry[i] = true` (and left to the
+    // blocking path, which reports the error). Returns false without reading anything if
+    // io_uring is not available.
+    inline bool readFilesBatched(const std::vector<const fs::path *> & paths,
+                                 const std::vector<std::vector<char> *> & buffers,
+                                 std::vector<char> & found,
+                                 std::vector<char> & retry) {
+        using namespace uring_detail;
+        Ring * ring = threadRing();
+        if(ring == nullptr) {
+            return false;
+        }
+
+        const std::size_t nFiles = paths.size();
+        found.assign(nFiles, 0);
+        retry.assign(nFiles, 0);
+        std::vector<FileRead> files(nFiles);
+
+        // a file needs at most two requests at a time (open + statx)
+        const std::size_t maxInFlight = ring->capacity() / 2;
+        std::size_t nextFile = 0, nActive = 0, nDone = 0;
+        unsigned nQueued = 0;
+        bool unsupported = false;
+
+        auto queueRead = [&](const std::size_t i) {
+            auto & file = files[i];
+            auto & buffer = *buffers[i];
+            io_uring_sqe * sqe = ring->nextSqe();
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = file.fd;
+            sqe->addr = reinterpret_cast<uint64_t>(buffer.data() + file.nRead);
+            sqe->len = static_cast<unsigned>(std::min<std::size_t>(buffer.size() - file.nRead, 1u << 30));
+            sqe->off = file.nRead;
+            sqe->user_data = userData(i, opRead);
+            file.nOutstanding = 1;
+            ++nQueued;
+        };
+
+        auto queueClose = [&](const std::size_t i) {
+            auto & file = files[i];
+            file.stage = FileRead::closing;
+            io_uring_sqe * sqe = ring->nextSqe();
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = file.fd;
+            sqe->user_data = userData(i, opClose);
+            file.nOutstanding = 1;
+            ++nQueued;
+        };
+
+        auto finish = [&](const std::size_t i) {
+            files[i].stage = FileRead::done;
+            --nActive;
+            ++nDone;
+        };
+
+        // both open and statx have completed
+        auto opened = [&](const std::size_t i) {
+            auto & file = files[i];
+            if(file.openResult < 0) {
+                if(file.openResult == -ENOENT || file.openResult == -ENOTDIR) {
+                    buffers[i]->clear();
+                } else {
+                    unsupported |= file.openResult == -EINVAL || file.openResult == -EOPNOTSUPP;
+                    file.fallback = true;
+                }
+                finish(i);
+                return;
+            }
+            file.fd = file.openResult;
+            if(file.statxResult < 0) {
+                // the file was replaced in between; let the blocking path handle it
+                file.fallback = true;
+                queueClose(i);
+                return;
+            }
+            // request one byte more than the size, so a complete read sees the end of the file
+            buffers[i]->resize(file.stx.stx_size + 1);
+            file.stage = FileRead::reading;
+            queueRead(i);
+        };
+
+        auto complete = [&](const uint64_t data, const int res) {
+            const std::size_t i = static_cast<std::size_t>(data >> 2);
+            const Op op = static_cast<Op>(data & 3);
+            auto & file = files[i];
+            --file.nOutstanding;
+            switch(op) {
+                case opOpen:
+                    file.openResult = res;
+                    break;
+                case opStatx:
+                    file.statxResult = res;
+                    break;
+                case opRead:
+                    if(res < 0) {
+                        if(res == -EINTR || res == -EAGAIN) {
+                            queueRead(i);
+                        } else {
+                            file.fallback = true;
+                            queueClose(i);
+                        }
+                        return;
+                    }
+                    file.nRead += res;
+                    if(res == 0 || file.nRead < buffers[i]->size()) {
+                        // end of file (a short read of a regular file)
+                        if(res != 0 && file.nRead != file.stx.stx_size) {
+                            // the size changed while reading: read on until end of file
+                            queueRead(i);
+                            return;
+                        }
+                        buffers[i]->resize(file.nRead);
+                        found[i] = 1;
+                        queueClose(i);
+                    } else {
+                        // the file has grown: read on
+                        buffers[i]->resize(2 * buffers[i]->size());
+                        queueRead(i);
+                    }
+                    return;
+                case opClose:
+                    finish(i);
+                    return;
+            }
+            if(file.stage == FileRead::opening && file.nOutstanding == 0) {
+                opened(i);
+            }
+        };
+
+        // requests submitted to the kernel whose completion was not reaped yet
+        std::size_t nInFlight = 0;
+        auto reaped = [&](const uint64_t data, const int res) {
+            --nInFlight;
+            complete(data, res);
+        };
+
+        // Before an error leaves the function, wait for the requests still in flight: they
+        // point into `files` and the buffers. Close the files they opened. If the ring
+        // cannot be waited on, drop it and leak the memory the requests may still use.
+        auto abandon = [&]() {
+            auto drained = [&](const uint64_t data, const int res) {
+                --nInFlight;
+                auto & file = files[static_cast<std::size_t>(data >> 2)];
+                switch(static_cast<Op>(data & 3)) {
+                    case opOpen:
+                        file.openResult = res;
+                        break;
+                    case opClose:
+                        file.stage = FileRead::done;
+                        break;
+                    default:
+                        break;
+                }
+            };
+            while(nInFlight + nQueued > 0) {
+                if(!ring->submitAndWait(1)) {
+                    ioUringWorks() = false;
+                    threadRingStorage().reset();
+                    // moving a vector keeps its storage
+                    static_cast<void>(new std::vector<FileRead>(std::move(files)));
+                    for(auto buffer : buffers) {
+                        static_cast<void>(new std::vector<char>(std::move(*buffer)));
+                    }
+                    return;
+                }
+                nInFlight += nQueued;
+                nQueued = 0;
+                ring->reap(drained);
+            }
+            for(auto & file : files) {
+                if(file.stage == FileRead::reading || file.stage == FileRead::closing) {
+                    ::close(file.fd);
+                } else if(file.stage == FileRead::opening && file.openResult >= 0) {
+                    ::close(file.openResult);
+                }
+            }
+        };
+
+        try {
+            while(nDone < nFiles) {
+                // start new files while there is room in the ring
+                while(nextFile < nFiles && nActive < maxInFlight && !unsupported) {
+                    const std::size_t i = nextFile++;
+                    auto & file = files[i];
+                    const char * path = paths[i]->c_str();
+                    file.stage = FileRead::opening;
+                    file.nOutstanding = 2;
+
+                    io_uring_sqe * sqe = ring->nextSqe();
+                    sqe->opcode = IORING_OP_OPENAT;
+                    sqe->fd = AT_FDCWD;
+                    sqe->addr = reinterpret_cast<uint64_t>(path);
+                    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+                    sqe->user_data = userData(i, opOpen);
+
+                    sqe = ring->nextSqe();
+                    sqe->opcode = IORING_OP_STATX;
+                    sqe->fd = AT_FDCWD;
+                    sqe->addr = reinterpret_cast<uint64_t>(path);
+                    sqe->len = STATX_SIZE;
+                    sqe->off = reinterpret_cast<uint64_t>(&file.stx);
+                    sqe->user_data = userData(i, opStatx);
+
+                    nQueued += 2;
+                    ++nActive;
+                }
+                // the kernel does not know the operations: hand the remaining files to the
+                // blocking path
+                if(unsupported && nActive == 0 && nQueued == 0) {
+                    for(; nextFile < nFiles; ++nextFile) {
+                        files[nextFile].fallback = true;
+                        ++nDone;
+                    }
+                    break;
+                }
+                if(!ring->submitAndWait(1)) {
+                    // cannot happen with valid arguments; do not use io_uring again
+                    ioUringWorks() = false;
+                    throw std::runtime_error(std::string("z5: io_uring_enter failed: ") + std::strerror(errno));
+                }
+                nInFlight += nQueued;
+                nQueued = 0;
+                ring->reap(reaped);
+            }
+        } catch(...) {
+            abandon();
+            throw;
+        }
+
+        if(unsupported) {
+            ioUringWorks() = false;
+        }
+        for(std::size_t i = 0; i < nFiles; ++i) {
+            retry[i] = files[i].fallback;
+        }
+        return true;
+    }
+
+#else
+
+    // io_uring is not compiled in
+    inline bool readFilesBatched(const std::vector<const fs::path *> &,
+                                 const std::vector<std::vector<char> *> &,
+                                 std::vector<char> &,
+                                 std::vector<char> &) {
+        return false;
+    }
+
+#endif
+
+    // true if batched reads go through io_uring
+    inline bool ioUringEnabled() {
+#ifdef WITH_IO_URING
+        return uring_detail::threadRing() != nullptr;
+#else
+        return false;
+#endif
+    }
+
+}
+}
@@ -1,9 +1,19 @@
 #pragma once
 
+#include <atomic>
+#include <cerrno>
 #include <fstream>
 #include <ios>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define Z5_HAVE_PREAD
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "z5/filesystem/handle.hxx"
+#include "z5/filesystem/io_uring.hxx"
 #include "z5/generic/store.hxx"
 #include "z5/util/util.hxx"
 
@@ -48,9 +58,123 @@ namespace store_detail {
         file.close();
     }
 
+    // Open a file for range reads (closed on destruction); `size()` is the file size.
+    // `ok()` is false if the file does not exist.
+    class RangeReader {
+    public:
+        RangeReader(const fs::path & path, const char * what) : path_(path), what_(what) {
+#ifdef Z5_HAVE_PREAD
+            fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd_ < 0) {
+                if(errno == ENOENT || errno == ENOTDIR) {
+                    return;
+                }
+                throw std::runtime_error(std::string("z5: cannot open ") + what + " file for reading: " + path.string());
+            }
+            struct stat st;
+            if(::fstat(fd_, &st) != 0) {
+                fail();
+            }
+            size_ = static_cast<std::size_t>(st.st_size);
+#else
+            file_.open(path, std::ios::binary);
+            if(!file_.is_open()) {
+                if(!fs::exists(path)) {
+                    return;
+                }
+                throw std::runtime_error(std::string("z5: cannot open ") + what + " file for reading: " + path.string());
+            }
+            file_.seekg(0, std::ios::end);
+            size_ = file_.tellg();
+#endif
+            ok_ = true;
+        }
+
+        ~RangeReader() {
+#ifdef Z5_HAVE_PREAD
+            if(fd_ >= 0) {
+                ::close(fd_);
+            }
+#endif
+        }
+
+        RangeReader(const RangeReader &) = delete;
+        RangeReader & operator=(const RangeReader &) = delete;
+
+        inline bool ok() const {return ok_;}
+        inline std::size_t size() const {return size_;}
+
+        // read exactly `nBytes` from `offset` into `out`
+        inline void read(const std::size_t offset, const std::size_t nBytes, char * out) {
+            if(offset > size_ || nBytes > size_ - offset) {
+                throw std::runtime_error(std::string("z5: range out of bounds of ") + what_ + " file: " + path_.string());
+            }
+#ifdef Z5_HAVE_PREAD
+            std::size_t done = 0;
+            while(done < nBytes) {
+                const ssize_t n = ::pread(fd_, out + done, nBytes - done, static_cast<off_t>(offset + done));
+                if(n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if(n <= 0) {
+                    fail();
+                }
+                done += static_cast<std::size_t>(n);
+            }
+#else
+            file_.seekg(offset);
+            file_.read(out, nBytes);
+            if(file_.gcount() != static_cast<std::streamsize>(nBytes)) {
+                fail();
+            }
+#endif
+        }
+
+    private:
+        [[noreturn]] inline void fail() const {
+            throw std::runtime_error(std::string("z5: failed to read ") + what_ + " file: " + path_.string());
+        }
+
+        const fs::path & path_;
+        const char * what_;
+        bool ok_ = false;
+        std::size_t size_ = 0;
+#ifdef Z5_HAVE_PREAD
+        int fd_ = -1;
+#else
+        std::ifstream file_;
+#endif
+    };
+
+    inline std::atomic<bool> & useShardAppend() {
+        static std::atomic<bool> use(true);
+        return use;
+    }
+
+    inline std::atomic<bool> & useMappedReads() {
+        static std::atomic<bool> use(false);
+        return use;
+    }
+
 }  // namespace store_detail
 
 
+    // Enable / disable memory mapped reads of uncompressed (raw) chunks and shards (POSIX
+    // systems only, disabled by default). Only enable them if no chunk or shard file is
+    // shortened while it is read: rewriting a chunk, an in-place shard update or compaction
+    // in this or another process truncates the file, and touching a mapped page past the
+    // new end kills the process with SIGBUS (a plain read fails or sees stale bytes instead).
+    inline void setUseMappedReads(const bool use) {
+        store_detail::useMappedReads() = use;
+    }
+
+    // Enable / disable in-place updates of shards: writing a few inner chunks appends
+    // them and a new index to the shard instead of rewriting it (enabled by default).
+    inline void setUseShardAppend(const bool use) {
+        store_detail::useShardAppend() = use;
+    }
+
+
     // Thin byte-IO layer over chunk / shard files. Everything format-related
     // (codec, shard index, read-modify-write) lives in the generic dataset
     // implementations in z5/generic/, which are parameterized on this policy.
@@ -72,6 +196,164 @@ namespace store_detail {
             return true;
         }
 
+        // read many chunks at once: a single io_uring batch where available, one blocking
+        // read per chunk otherwise; an absent chunk yields an empty buffer
+        static inline void readBatch(const std::vector<ChunkHandleType> & chunks,
+                                     const std::vector<std::vector<char> *> & buffers,
+                                     const char * what = "chunk") {
+            std::vector<const fs::path *> paths(chunks.size());
+            for(std::size_t i = 0; i < chunks.size(); ++i) {
+                paths[i] = &chunks[i].path();
+            }
+            std::vector<char> found, retry;
+            const bool batched = readFilesBatched(paths, buffers, found, retry);
+            for(std::size_t i = 0; i < chunks.size(); ++i) {
+                // files the batch could not read go through the blocking path,
+                // which also reports the errors
+                if(!batched || retry[i]) {
+                    if(!read(chunks[i], *buffers[i], what)) {
+                        buffers[i]->clear();
+                    }
+                }
+            }
+        }
+
+        static inline std::size_t readBatchSize() {
+            return ioUringEnabled() ? 32 : 1;
+        }
+
+        // map a chunk / shard file; false if it does not exist
+        static inline bool map(const ChunkHandleType & chunk, util::MappedFile & mapped,
+                               const char * what = "chunk", const bool populate = true) {
+            return mapped.map(chunk.path(), what, populate);
+        }
+
+        static inline bool mappedReads() {
+            return util::MappedFile::supported() && store_detail::useMappedReads();
+        }
+
+        // overwrite the file from `offset` on and cut it off behind the new bytes
+        static inline void writeTail(const ChunkHandleType & chunk, const std::size_t offset,
+                                     const char * data, const std::size_t nBytes,
+                                     const char * what = "chunk") {
+            const auto & path = chunk.path();
+#ifdef Z5_HAVE_PREAD
+            const int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+            if(fd < 0) {
+                throw std::runtime_error(std::string("z5: cannot open ") + what + " file for writing: " + path.string());
+            }
+            std::size_t done = 0;
+            while(done < nBytes) {
+                const ssize_t n = ::pwrite(fd, data + done, nBytes - done, static_cast<off_t>(offset + done));
+                if(n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if(n <= 0) {
+                    ::close(fd);
+                    throw std::runtime_error(std::string("z5: failed to write ") + what + " file: " + path.string());
+                }
+                done += static_cast<std::size_t>(n);
+            }
+            const bool truncated = ::ftruncate(fd, static_cast<off_t>(offset + nBytes)) == 0;
+            ::close(fd);
+            if(!truncated) {
+                throw std::runtime_error(std::string("z5: failed to write ") + what + " file: " + path.string());
+            }
+#else
+            {
+                std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+                if(!file.is_open()) {
+                    throw std::runtime_error(std::string("z5: cannot open ") + what + " file for writing: " + path.string());
+                }
+                file.seekp(offset);
+                file.write(data, nBytes);
+                if(!file.good()) {
+                    throw std::runtime_error(std::string("z5: failed to write ") + what + " file: " + path.string());
+                }
+            }
+            fs::resize_file(path, offset + nBytes);
+#endif
+        }
+
+        static inline bool appendUpdates() {
+            return store_detail::useShardAppend();
+        }
+
+        // size, modification time and inode of a chunk / shard file
+        static inline bool stat(const ChunkHandleType & chunk, generic::ObjectVersion & version) {
+#ifdef Z5_HAVE_PREAD
+            struct ::stat st;
+            if(::stat(chunk.path().c_str(), &st) != 0) {
+                if(errno == ENOENT || errno == ENOTDIR) {
+                    return false;
+                }
+                throw std::runtime_error("z5: cannot stat file: " + chunk.path().string());
+            }
+#ifdef __APPLE__
+            const auto & mtime = st.st_mtimespec;
+#else
+            const auto & mtime = st.st_mtim;
+#endif
+            version.size = static_cast<std::size_t>(st.st_size);
+            version.mtime = static_cast<int64_t>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec;
+            version.id = static_cast<uint64_t>(st.st_ino);
+#else
+            std::error_code ec;
+            const auto size = fs::file_size(chunk.path(), ec);
+            if(ec) {
+                return false;
+            }
+            version.size = static_cast<std::size_t>(size);
+            version.mtime = fs::last_write_time(chunk.path(), ec).time_since_epoch().count();
+#endif
+            return true;
+        }
+
+        // range reads use pread; reading a gap of up to 64 KiB is cheaper than another syscall
+        static constexpr std::size_t rangeCoalesceGap = std::size_t(64) << 10;
+
+        static inline bool readHead(const ChunkHandleType & chunk, const std::size_t nBytes,
+                                    std::vector<char> & buffer, std::size_t & size,
+                                    const char * what = "chunk") {
+            store_detail::RangeReader reader(chunk.path(), what);
+            if(!reader.ok()) {
+                return false;
+            }
+            size = reader.size();
+            const std::size_t n = std::min(nBytes, size);
+            buffer.resize(n);
+            reader.read(0, n, buffer.data());
+            return true;
+        }
+
+        static inline bool readTail(const ChunkHandleType & chunk, const std::size_t nBytes,
+                                    std::vector<char> & buffer, std::size_t & size,
+                                    const char * what = "chunk") {
+            store_detail::RangeReader reader(chunk.path(), what);
+            if(!reader.ok()) {
+                return false;
+            }
+            size = reader.size();
+            const std::size_t n = std::min(nBytes, size);
+            buffer.resize(n);
+            reader.read(size - n, n, buffer.data());
+            return true;
+        }
+
+        static inline bool readRanges(const ChunkHandleType & chunk,
+                                      const std::vector<generic::ByteRange> & ranges,
+                                      char * out, const char * what = "chunk") {
+            store_detail::RangeReader reader(chunk.path(), what);
+            if(!reader.ok()) {
+                return false;
+            }
+            for(const auto & range : ranges) {
+                reader.read(range.offset, range.nBytes, out);
+                out += range.nBytes;
+            }
+            return true;
+        }
+
         static inline void write(const ChunkHandleType & chunk, const std::vector<char> & buffer,
                                  const char * what = "chunk") {
             // create nested chunk directories if needed (a no-op for non-nested chunks)
@@ -156,6 +438,10 @@ namespace store_detail {
     };
 
     static_assert(z5::generic::ChunkStorePolicy<ChunkStore>);
+    static_assert(z5::generic::BatchedChunkStorePolicy<ChunkStore>);
+    static_assert(z5::generic::MappedChunkStorePolicy<ChunkStore>);
+    static_assert(z5::generic::VersionedChunkStorePolicy<ChunkStore>);
+    static_assert(z5::generic::AppendableChunkStorePolicy<ChunkStore>);
 
 }
 }
@@ -48,6 +48,11 @@ namespace gcs {
             detail::notImplemented();
         }
 
+        inline void writeRawChunk(const types::ShapeType & chunkIndices,
+                                  const std::vector<char> & buffer) const {
+            detail::notImplemented();
+        }
+
         inline void checkRequestType(const std::type_info & type) const {
             if(type != typeid(T)) {
                 throw std::runtime_error(std::string("Request has wrong type: expected ") +
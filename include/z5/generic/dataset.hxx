@@ -59,11 +59,41 @@ namespace generic {
                                      Mixin::fillValue_, isVarlen, varSize)) {
                 // if we have data on store for the chunk, delete it
                 STORE::erase(chunk);
-                return;
+            } else {
+                // write the chunk to the store
+                STORE::write(chunk, buffer);
             }
+            invalidateCachedChunk(chunkIndices);
+        }
 
-            // write the chunk to the store
-            STORE::write(chunk, buffer);
+
+        // compress a chunk to its stored bytes (including the n5 header);
+        // false => all-fill, nothing to store
+        inline bool makeChunkBlob(const types::ShapeType & chunkIndices, const void * dataIn,
+                                  std::vector<char> & blob) const override {
+            ChunkHandleType chunk(handle_, chunkIndices, defaultChunkShape(), shape());
+            checkChunk(chunk);
+            if(!util::data_to_buffer(chunk, dataIn, blob, Mixin::compressor_, Mixin::fillValue_)) {
+                blob.clear();
+                return false;
+            }
+            return true;
+        }
+
+        inline void writeRawChunk(const types::ShapeType & chunkIndices,
+                                  const std::vector<char> & blob) const override {
+            if(!handle_.mode().canWrite()) {
+                const std::string err = "Cannot write data in file mode " + handle_.mode().printMode();
+                throw std::invalid_argument(err.c_str());
+            }
+            ChunkHandleType chunk(handle_, chunkIndices, defaultChunkShape(), shape());
+            checkChunk(chunk);
+            if(blob.empty()) {
+                STORE::erase(chunk);
+            } else {
+                STORE::write(chunk, blob);
+            }
+            invalidateCachedChunk(chunkIndices);
         }
 
 
@@ -79,7 +109,7 @@ namespace generic {
             // load the data from the store; the read outcome itself tells us
             // whether the chunk exists
             std::vector<char> buffer;
-            if(!STORE::read(chunk, buffer)) {
+            if(!readStoredChunk(chunk, buffer)) {
                 throw std::runtime_error("Trying to read a chunk that does not exist");
             }
 
@@ -93,11 +123,125 @@ namespace generic {
                                  std::vector<char> & buffer) const {
             ChunkHandleType chunk(handle_, chunkIndices, defaultChunkShape(), shape());
             // a missing chunk yields an empty buffer
-            if(!STORE::read(chunk, buffer)) {
+            if(!readStoredChunk(chunk, buffer)) {
                 buffer.clear();
             }
         }
 
+        // chunks in the stored-chunk cache are copied from it, the others are read (in
+        // one batch if the store supports it)
+        inline void readRawChunks(const std::vector<types::ShapeType> & chunkIds,
+                                  const std::vector<std::vector<char> *> & buffers) const override {
+            auto & cache = storedChunkCache_;
+            const bool useCache = cache.enabled();
+            const std::uint64_t generation = cache.generation();
+
+            std::vector<ChunkHandleType> chunks;
+            std::vector<std::vector<char> *> toRead;
+            chunks.reserve(chunkIds.size());
+            toRead.reserve(chunkIds.size());
+            for(std::size_t i = 0; i < chunkIds.size(); ++i) {
+                if(useCache) {
+                    if(const auto cached = cache.get(chunkIds[i])) {
+                        *buffers[i] = *cached;
+                        continue;
+                    }
+                }
+                chunks.emplace_back(handle_, chunkIds[i], defaultChunkShape(), shape());
+                toRead.push_back(buffers[i]);
+            }
+            if(chunks.empty()) {
+                return;
+            }
+
+            if constexpr(BatchedChunkStorePolicy<STORE>) {
+                STORE::readBatch(chunks, toRead, "chunk");
+            } else {
+                for(std::size_t k = 0; k < chunks.size(); ++k) {
+                    if(!STORE::read(chunks[k], *toRead[k])) {
+                        toRead[k]->clear();
+                    }
+                }
+            }
+
+            if(useCache) {
+                for(std::size_t k = 0; k < chunks.size(); ++k) {
+                    if(!toRead[k]->empty()) {
+                        cache.put(chunks[k].chunkIndices(), std::make_shared<const std::vector<char>>(*toRead[k]),
+                                  toRead[k]->size(), generation);
+                    }
+                }
+            }
+        }
+
+        // wait for the store's background writes (S3 write-behind)
+        inline void flush() const override {
+            if constexpr(FlushableChunkStorePolicy<STORE>) {
+                STORE::flush();
+            }
+        }
+
+        inline std::size_t readBatchSize() const override {
+            if constexpr(BatchedChunkStorePolicy<STORE>) {
+                return STORE::readBatchSize();
+            } else {
+                return 1;
+            }
+        }
+
+        inline bool listsChunks() const override {
+            return ListableChunkStorePolicy<STORE>;
+        }
+
+        // the chunks in the listing of the dataset that lie in the chunk grid
+        inline void listChunks(std::vector<types::ShapeType> & chunkIds) const override {
+            if constexpr(ListableChunkStorePolicy<STORE>) {
+                std::vector<types::ShapeType> listed;
+                STORE::listChunks(handle_, shape().size(), listed);
+                const auto & nChunks = chunksPerDimension();
+                for(auto & chunkId : listed) {
+                    if(std::equal(chunkId.begin(), chunkId.end(), nChunks.begin(), std::less<std::size_t>())) {
+                        chunkIds.emplace_back(std::move(chunkId));
+                    }
+                }
+            }
+        }
+
+        // the store's batches run concurrently, independent of nThreads
+        inline void removeChunks(const std::vector<types::ShapeType> & chunkIds, const int nThreads) const override {
+            if constexpr(ListableChunkStorePolicy<STORE>) {
+                std::vector<ChunkHandleType> chunks;
+                chunks.reserve(chunkIds.size());
+                for(const auto & chunkId : chunkIds) {
+                    chunks.emplace_back(handle_, chunkId, defaultChunkShape(), shape());
+                }
+                STORE::eraseBatch(chunks);
+                for(const auto & chunkId : chunkIds) {
+                    invalidateCachedChunk(chunkId);
+                }
+            } else {
+                z5::Dataset::removeChunks(chunkIds, nThreads);
+            }
+        }
+
+        inline bool supportsMappedReads() const override {
+            if constexpr(MappedChunkStorePolicy<STORE>) {
+                return STORE::mappedReads();
+            } else {
+                return false;
+            }
+        }
+
+        inline bool mapRawChunk(const types::ShapeType & chunkIndices,
+                                util::MappedFile & mapped) const override {
+            if constexpr(MappedChunkStorePolicy<STORE>) {
+                ChunkHandleType chunk(handle_, chunkIndices, defaultChunkShape(), shape());
+                return STORE::map(chunk, mapped, "chunk");
+            } else {
+                return false;
+            }
+        }
+
         inline void checkRequestType(const std::type_info & type) const {
             if(type != typeid(T)) {
                 throw std::runtime_error(std::string("Request has wrong type: expected ") +
@@ -207,9 +351,11 @@ namespace generic {
         inline void removeChunk(const types::ShapeType & chunkId) const {
             ChunkHandleType chunk(handle_, chunkId, defaultChunkShape(), shape());
             chunk.remove();
+            invalidateCachedChunk(chunkId);
         }
         inline void remove() const {
             handle_.remove();
+            clearCachedChunks();
         }
 
         // delete copy constructor and assignment operator
@@ -222,6 +368,26 @@ namespace generic {
 
     private:
 
+        // read the stored bytes of a chunk, from the stored-chunk cache if it is there;
+        // returns false if the chunk does not exist
+        inline bool readStoredChunk(const ChunkHandleType & chunk, std::vector<char> & buffer) const {
+            auto & cache = storedChunkCache_;
+            if(!cache.enabled()) {
+                return STORE::read(chunk, buffer);
+            }
+            const auto & chunkId = chunk.chunkIndices();
+            if(const auto cached = cache.get(chunkId)) {
+                buffer = *cached;
+                return true;
+            }
+            const std::uint64_t generation = cache.generation();
+            if(!STORE::read(chunk, buffer)) {
+                return false;
+            }
+            cache.put(chunkId, std::make_shared<const std::vector<char>>(buffer), buffer.size(), generation);
+            return true;
+        }
+
         // check that the chunk handle is valid
         inline void checkChunk(const ChunkHandleType & chunk,
                                const bool isVarlen=false) const {
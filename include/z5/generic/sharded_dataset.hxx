@@ -1,10 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <numeric>
+#include <shared_mutex>
 
 #include "z5/dataset.hxx"
 #include "z5/generic/store.hxx"
 #include "z5/util/format_data.hxx"
+#include "z5/util/lru_cache.hxx"
 #include "z5/util/sharding.hxx"
 
 
@@ -23,6 +31,31 @@ namespace generic {
     //
     // All storage access goes through the STORE policy (one read / write / erase
     // of a whole shard object); the format logic here is backend-independent.
+    //
+    // The index is stored at the end (default) or the start of the shard, with or without
+    // a crc32c checksum (the codec's index_location / index_codecs, see util/sharding.hxx).
+    // The blobs are written in the order set with util::setShardBlobOrder when the dataset
+    // was opened.
+    //
+    // Where the store supports it (AppendableChunkStorePolicy), writes that touch only a
+    // few inner chunks of an existing shard whose index is at the end append the new
+    // blobs and a new index to the shard instead of rewriting it; the shard is compacted (rewritten) once the
+    // replaced blobs make up more than util::shardCompactionRatio() of it.
+    //
+    // Shards are guarded by striped locks (one of nShardLocks per shard coordinate):
+    // reads hold them shared, writes exclusively, so writers of different shards run in
+    // parallel and readers never see a shard that is being rewritten by this dataset.
+    //
+    // With a write-back budget (util::setShardWriteBackBytes), writeChunk / removeChunk
+    // only record the new inner chunk blobs; each shard is then updated once for all of
+    // its pending chunks by flush(), when the budget is exceeded, before the shard is
+    // read, or when the dataset is destroyed.
+    //
+    // Parsed shard indices are kept in an LRU cache (see util::setShardIndexCacheBytes).
+    // For stores that can stat objects (VersionedChunkStorePolicy), a cached index is
+    // used as long as the shard's size and mtime / ETag are unchanged, so chunkExists
+    // and single chunk reads cost a stat instead of an index read after the first
+    // access, and shards rewritten by other processes are still detected.
     template<typename T, class STORE>
     requires ChunkStorePolicy<STORE>
     class ShardedDataset : public z5::Dataset, private z5::MixinTyped<T> {
@@ -41,9 +74,25 @@ namespace generic {
                                                            handle_(handle),
                                                            shardShape_(metadata.shardShape),
                                                            chunksPerShard_(util::chunksPerShard(metadata.shardShape, metadata.chunkShape)),
-                                                           nSlots_(util::numShardSlots(chunksPerShard_)) {
+                                                           nSlots_(util::numShardSlots(chunksPerShard_)),
+                                                           indexLayout_{metadata.shardIndexLocation == "start",
+                                                                        metadata.shardIndexChecksum},
+                                                           indexCache_(util::shardIndexCacheBytes()),
+                                                           writeBackBytes_(util::shardWriteBackBytes()) {
             // sharding implies zarr v3; seed the cache so chunk handles never probe
             handle_.setIsZarr(true);
+            util::shardBlobPlacement(chunksPerShard_, util::shardBlobOrder(), placement_);
+            placementRank_.resize(placement_.size());
+            for(std::size_t k = 0; k < placement_.size(); ++k) {
+                placementRank_[placement_[k]] = k;
+            }
+        }
+
+        // pending writes cannot be reported from here, call flush() to see errors
+        ~ShardedDataset() {
+            try {
+                flushPendingShards();
+            } catch(...) {}
         }
 
         //
@@ -72,20 +121,50 @@ namespace generic {
             return false;  // no varlen in zarr v3
         }
 
+        // reads the shard index and then only this chunk's slot (unless the slot is in
+        // the stored-chunk cache)
         inline void readRawChunk(const types::ShapeType & chunkIndices,
                                  std::vector<char> & buffer) const {
-            std::vector<util::ShardEntry> entries;
-            std::vector<char> shardBuf;
-            if(!readShard(chunkIndices, shardBuf, entries)) {
+            const auto shardCoord = util::shardId(chunkIndices, chunksPerShard_);
+            flushPending(shardCoord);
+            auto & cache = storedChunkCache_;
+            const bool useCache = cache.enabled();
+            if(useCache) {
+                if(const auto cached = cache.get(chunkIndices)) {
+                    buffer = *cached;
+                    return;
+                }
+            }
+            const std::uint64_t generation = cache.generation();
+            std::shared_lock<std::shared_mutex> lock(shardLock(shardCoord));
+            ChunkHandleType shardChunk(handle_, shardCoord, shardShape_, shape());
+            const auto index = shardIndex(shardCoord, shardChunk);
+            if(!index) {
                 buffer.clear();
                 return;
             }
-            const auto & e = entries[util::shardSlot(chunkIndices, chunksPerShard_)];
+            const auto & e = index->entries[util::shardSlot(chunkIndices, chunksPerShard_)];
             if(e.empty()) {
                 buffer.clear();
                 return;
             }
-            buffer.assign(shardBuf.begin() + e.offset, shardBuf.begin() + e.offset + e.nbytes);
+            buffer.resize(e.nbytes);
+            if(!STORE::readRanges(shardChunk, {ByteRange{e.offset, e.nbytes}}, buffer.data(), "shard")) {
+                buffer.clear();
+            } else if(useCache) {
+                cache.put(chunkIndices, std::make_shared<const std::vector<char>>(buffer), buffer.size(), generation);
+            }
+        }
+
+        // replace one inner chunk's slot blob (read-modify-write of its shard)
+        inline void writeRawChunk(const types::ShapeType & chunkIndices,
+                                  const std::vector<char> & blob) const override {
+            if(!handle_.mode().canWrite()) {
+                throw std::invalid_argument("Cannot write data in file mode " + handle_.mode().printMode());
+            }
+            ChunkHandleType innerChunk(handle_, chunkIndices, defaultChunkShape(), shape());
+            checkChunk(innerChunk);
+            writeInnerBlob(chunkIndices, std::vector<char>(blob), !blob.empty());
         }
 
         inline void checkRequestType(const std::type_info & type) const {
@@ -95,12 +174,15 @@ namespace generic {
         }
 
         inline bool chunkExists(const types::ShapeType & chunkId) const {
-            std::vector<util::ShardEntry> entries;
-            std::vector<char> shardBuf;
-            if(!readShard(chunkId, shardBuf, entries)) {
+            const auto shardCoord = util::shardId(chunkId, chunksPerShard_);
+            flushPending(shardCoord);
+            std::shared_lock<std::shared_mutex> lock(shardLock(shardCoord));
+            ChunkHandleType shardChunk(handle_, shardCoord, shardShape_, shape());
+            const auto index = shardIndex(shardCoord, shardChunk);
+            if(!index) {
                 return false;
             }
-            return !entries[util::shardSlot(chunkId, chunksPerShard_)].empty();
+            return !index->entries[util::shardSlot(chunkId, chunksPerShard_)].empty();
         }
 
         inline std::size_t getChunkSize(const types::ShapeType & chunkId) const {
@@ -170,70 +252,244 @@ namespace generic {
         // slots. 'shardCoord' is the shard's coordinate in the (outer) shard grid.
         inline void readShardBlobs(const types::ShapeType & shardCoord,
                                    std::vector<std::vector<char>> & blobs) const override {
-            // clear slot-by-slot (not assign) so a caller-reused `blobs` keeps the slot
-            // vectors' capacity across shards
-            blobs.resize(nSlots_);
-            for(auto & blob : blobs) {
-                blob.clear();
-            }
-            ChunkHandleType shardChunk(handle_, shardCoord, shardShape_, shape());
-            std::vector<char> shardBuf;
-            if(!STORE::read(shardChunk, shardBuf, "shard")) {
-                return;
-            }
-            std::vector<util::ShardEntry> entries;
-            // a present but corrupt shard must fail loudly: this function feeds the
-            // write read-modify-write path, and treating corruption as "empty shard"
-            // would silently discard all other inner chunks on the next write
-            if(!util::parseShardIndex(shardBuf, nSlots_, entries)) {
-                throw std::runtime_error(std::string(STORE::shardedName) + ": corrupt shard index");
-            }
-            util::extractShardBlobs(shardBuf, entries, blobs);
+            flushPending(shardCoord);
+            std::shared_lock<std::shared_mutex> lock(shardLock(shardCoord));
+            loadShardBlobs(shardCoord, blobs);
         }
 
-        // read a shard once, reporting per-slot byte offset + length within shardBuf
-        // (length 0 for empty/never-written slots). Lets the read path decode each touched
-        // inner chunk straight from shardBuf with no per-slot copy. Returns false if absent.
+        // read the needed slots of a shard, reporting per-slot byte offset + length within
+        // shardBuf (length 0 for empty/never-written slots and slots that were not read).
+        // Lets the read path decode each touched inner chunk straight from shardBuf with
+        // no per-slot copy. Returns false if absent.
+        // If only a few slots are needed, the index is read first and then only the byte
+        // ranges of those slots (ranges closer than STORE::rangeCoalesceGap are merged).
+        // Slots in the stored-chunk cache are not read but appended to shardBuf.
         inline bool readShardRaw(const types::ShapeType & shardCoord,
+                                 const std::vector<std::size_t> & slots,
                                  std::vector<char> & shardBuf,
                                  std::vector<std::size_t> & offsets,
                                  std::vector<std::size_t> & nbytes) const override {
-            ChunkHandleType shardChunk(handle_, shardCoord, shardShape_, shape());
-            if(!STORE::read(shardChunk, shardBuf, "shard")) {
-                return false;
+            flushPending(shardCoord);
+            auto & cache = storedChunkCache_;
+            if(!cache.enabled()) {
+                std::shared_lock<std::shared_mutex> lock(shardLock(shardCoord));
+                return readShardRawUncached(shardCoord, slots, shardBuf, offsets, nbytes);
             }
-            std::vector<util::ShardEntry> entries;
-            if(!util::parseShardIndex(shardBuf, nSlots_, entries)) {
-                throw std::runtime_error(std::string(STORE::shardedName) + ": corrupt shard index");
+
+            std::vector<std::size_t> toRead;
+            std::vector<std::pair<std::size_t, util::StoredChunkCache::ValuePtr>> cached;
+            for(const std::size_t slot : slots) {
+                auto blob = cache.get(util::innerChunkId(shardCoord, slot, chunksPerShard_));
+                if(blob) {
+                    cached.emplace_back(slot, std::move(blob));
+                } else {
+                    toRead.push_back(slot);
+                }
             }
-            offsets.resize(nSlots_);
-            nbytes.resize(nSlots_);
-            for(std::size_t s = 0; s < nSlots_; ++s) {
-                offsets[s] = entries[s].empty() ? 0 : entries[s].offset;
-                nbytes[s] = entries[s].empty() ? 0 : entries[s].nbytes;
+
+            const std::uint64_t generation = cache.generation();
+            if(toRead.empty()) {
+                shardBuf.clear();
+                offsets.assign(nSlots_, 0);
+                nbytes.assign(nSlots_, 0);
+            } else {
+                std::shared_lock<std::shared_mutex> lock(shardLock(shardCoord));
+                if(!readShardRawUncached(shardCoord, toRead, shardBuf, offsets, nbytes)) {
+                    return false;
+                }
+                for(const std::size_t slot : toRead) {
+                    if(nbytes[slot] > 0) {
+                        const auto begin = shardBuf.begin() + offsets[slot];
+                        cache.put(util::innerChunkId(shardCoord, slot, chunksPerShard_),
+                                  std::make_shared<const std::vector<char>>(begin, begin + nbytes[slot]),
+                                  nbytes[slot], generation);
+                    }
+                }
+            }
+
+            for(const auto & [slot, blob] : cached) {
+                offsets[slot] = shardBuf.size();
+                nbytes[slot] = blob->size();
+                shardBuf.insert(shardBuf.end(), blob->begin(), blob->end());
             }
             return true;
         }
 
+        // as readShardRaw, but maps the shard instead of reading it
+        inline bool supportsMappedReads() const override {
+            if constexpr(MappedChunkStorePolicy<STORE>) {
+                return STORE::mappedReads();
+            } else {
+                return false;
+            }
+        }
+
+        // (if only a few slots are needed, only they are read ahead)
+        inline bool mapShardRaw(const types::ShapeType & shardCoord,
+                                const std::vector<std::size_t> & slots,
+                                util::MappedFile & mapped,
+                                std::vector<std::size_t> & offsets,
+                                std::vector<std::size_t> & nbytes) const override {
+            if constexpr(MappedChunkStorePolicy<STORE>) {
+                flushPending(shardCoord);
+                std::shared_lock<std::shared_mutex> lock(shardLock(shardCoord));
+                ChunkHandleType shardChunk(handle_, shardCoord, shardShape_, shape());
+                const bool slotsOnly = readSlotsOnly(slots);
+                if(!STORE::map(shardChunk, mapped, "shard", !slotsOnly)) {
+                    return false;
+                }
+                slotsFromIndex(mapped.data(), mapped.size(), offsets, nbytes);
+                if(slotsOnly) {
+                    for(const std::size_t slot : slots) {
+                        mapped.willNeed(offsets[slot], nbytes[slot]);
+                    }
+                }
+                return true;
+            } else {
+                return false;
+            }
+        }
+
         // build & write a shard from its per-slot blobs (remove the object if all empty).
-        // NOTE: takes no lock itself; callers guarantee exclusivity for the shard object --
-        // the shard-aware writeSubarray path uses one task per shard, and writeInnerBlob
-        // (the direct per-chunk path) calls this while holding shardMutex_.
+        // Holds the shard's lock exclusively while writing; a read-modify-write by the
+        // caller is not atomic (the shard-aware writeSubarray path uses one task per shard).
         inline void writeShardBlobs(const types::ShapeType & shardCoord,
                                     const std::vector<std::vector<char>> & blobs) const override {
-            // single choke point for all sharded writes (writeChunk, removeChunk and
-            // the shard-aware writeSubarray path) -> enforce the file mode here
+            flushPending(shardCoord);
+            {
+                std::unique_lock<std::shared_mutex> lock(shardLock(shardCoord));
+                storeShardBlobs(shardCoord, blobs);
+            }
+            invalidateCachedShard(shardCoord);
+        }
+
+        inline bool appendsShardUpdates() const override {
+            if constexpr(AppendableChunkStorePolicy<STORE>) {
+                return !indexLayout_.atStart && STORE::appendUpdates();
+            } else {
+                return false;
+            }
+        }
+
+        inline void readShardSlots(const types::ShapeType & shardCoord,
+                                   const std::vector<std::size_t> & slots,
+                                   std::vector<std::vector<char>> & blobs) const override {
+            blobs.resize(slots.size());
+            std::vector<char> shardBuf;
+            std::vector<std::size_t> offsets, nbytes;
+            if(!readShardRaw(shardCoord, slots, shardBuf, offsets, nbytes)) {
+                for(auto & blob : blobs) {
+                    blob.clear();
+                }
+                return;
+            }
+            for(std::size_t k = 0; k < slots.size(); ++k) {
+                const auto begin = shardBuf.begin() + offsets[slots[k]];
+                blobs[k].assign(begin, begin + nbytes[slots[k]]);
+            }
+        }
+
+        // replace the blobs of some slots (blobs[k] for slots[k], empty: empty slot);
+        // locks like writeShardBlobs
+        inline void updateShardSlots(const types::ShapeType & shardCoord,
+                                     const std::vector<std::size_t> & slots,
+                                     const std::vector<std::vector<char>> & blobs) const override {
+            flushPending(shardCoord);
+            {
+                std::unique_lock<std::shared_mutex> lock(shardLock(shardCoord));
+                applyShardSlots(shardCoord, slots, blobs);
+            }
+            invalidateCachedShard(shardCoord);
+        }
+
+        // write all pending inner chunks (one update per shard), then wait for the
+        // store's background writes
+        inline void flush() const override {
+            flushPendingShards();
+            if constexpr(FlushableChunkStorePolicy<STORE>) {
+                STORE::flush();
+            }
+        }
+
+        inline bool listsChunks() const override {
+            return ListableChunkStorePolicy<STORE>;
+        }
+
+        // all inner chunks in the grid of the listed shards, not only the ones that exist
+        // (see chunkExists); held back chunks are written first, so their shards are listed
+        inline void listChunks(std::vector<types::ShapeType> & chunkIds) const override {
+            if constexpr(ListableChunkStorePolicy<STORE>) {
+                flushPendingShards();
+                std::vector<types::ShapeType> shardCoords;
+                STORE::listChunks(handle_, shape().size(), shardCoords);
+                const auto & nChunks = chunksPerDimension();
+                for(const auto & shardCoord : shardCoords) {
+                    for(std::size_t slot = 0; slot < nSlots_; ++slot) {
+                        auto chunkId = util::innerChunkId(shardCoord, slot, chunksPerShard_);
+                        if(std::equal(chunkId.begin(), chunkId.end(), nChunks.begin(), std::less<std::size_t>())) {
+                            chunkIds.emplace_back(std::move(chunkId));
+                        }
+                    }
+                }
+            }
+        }
+
+        // remove inner chunks with one update per shard, the shards in parallel. Shards
+        // that end up empty are deleted; for stores that list their chunks (S3) together at
+        // the end with batched requests, so a write to such a shard that runs concurrently
+        // with the call may be lost.
+        inline void removeChunks(const std::vector<types::ShapeType> & chunkIds, const int nThreads) const override {
             if(!handle_.mode().canWrite()) {
                 throw std::invalid_argument("Cannot write data in file mode " + handle_.mode().printMode());
             }
-            ChunkHandleType shardChunk(handle_, shardCoord, shardShape_, shape());
-            if(util::allSlotsEmpty(blobs)) {
-                STORE::erase(shardChunk);
-                return;
+            std::map<types::ShapeType, std::vector<std::size_t>> slotsByShard;
+            for(const auto & chunkId : chunkIds) {
+                slotsByShard[util::shardId(chunkId, chunksPerShard_)].push_back(util::shardSlot(chunkId, chunksPerShard_));
             }
-            std::vector<char> out;
-            util::buildShard(blobs, out);
-            STORE::write(shardChunk, out, "shard");
+            std::vector<const std::pair<const types::ShapeType, std::vector<std::size_t>> *> shards;
+            shards.reserve(slotsByShard.size());
+            for(const auto & kv : slotsByShard) {
+                shards.push_back(&kv);
+            }
+
+            std::mutex emptyMutex;
+            std::vector<types::ShapeType> emptyShards;
+            util::parallel_foreach(nThreads, shards.size(), [&](const int, const std::size_t i){
+                const auto & shardCoord = shards[i]->first;
+                const auto & slots = shards[i]->second;
+                flushPending(shardCoord);
+                std::unique_lock<std::shared_mutex> lock(shardLock(shardCoord));
+                if constexpr(ListableChunkStorePolicy<STORE>) {
+                    std::vector<std::vector<char>> shardBlobs;
+                    loadShardBlobs(shardCoord, shardBlobs);
+                    for(const auto slot : slots) {
+                        shardBlobs[slot].clear();
+                    }
+                    if(util::allSlotsEmpty(shardBlobs)) {
+                        std::lock_guard<std::mutex> emptyLock(emptyMutex);
+                        emptyShards.push_back(shardCoord);
+                    } else {
+                        storeShardBlobs(shardCoord, shardBlobs);
+                    }
+                } else {
+                    applyShardSlots(shardCoord, slots, std::vector<std::vector<char>>(slots.size()));
+                }
+            });
+
+            if constexpr(ListableChunkStorePolicy<STORE>) {
+                std::vector<ChunkHandleType> emptyChunks;
+                emptyChunks.reserve(emptyShards.size());
+                for(const auto & shardCoord : emptyShards) {
+                    emptyChunks.emplace_back(handle_, shardCoord, shardShape_, shape());
+                }
+                STORE::eraseBatch(emptyChunks);
+                for(const auto & shardCoord : emptyShards) {
+                    indexCache_.erase(shardCoord);
+                }
+            }
+            invalidateCachedChunksIf([&](const types::ShapeType & chunkId){
+                return slotsByShard.count(util::shardId(chunkId, chunksPerShard_)) > 0;
+            });
         }
 
         // compress one inner chunk to its on-disk blob; false => all-fill (empty slot).
@@ -257,7 +513,16 @@ namespace generic {
         inline void removeChunk(const types::ShapeType & chunkId) const {
             writeInnerBlob(chunkId, std::vector<char>(), false);
         }
-        inline void remove() const {handle_.remove();}
+        inline void remove() const {
+            {
+                std::lock_guard<std::mutex> pendingLock(pendingMutex_);
+                pending_.clear();
+                pendingBytes_ = 0;
+                nPending_ = 0;
+            }
+            handle_.remove();
+            clearCachedChunks();
+        }
 
         // delete copy constructor and assignment operator
         // because the compressor cannot be copied by default
@@ -266,35 +531,440 @@ namespace generic {
 
     private:
 
-        // read a shard object and parse its index; returns false if the shard does not exist
-        inline bool readShard(const types::ShapeType & chunkId,
-                              std::vector<char> & shardBuf,
-                              std::vector<util::ShardEntry> & entries) const {
-            ChunkHandleType shardChunk(handle_, util::shardId(chunkId, chunksPerShard_), shardShape_, shape());
+        // as readShardRaw, bypassing the stored-chunk cache; the shard's lock must be held
+        inline bool readShardRawUncached(const types::ShapeType & shardCoord,
+                                         const std::vector<std::size_t> & slots,
+                                         std::vector<char> & shardBuf,
+                                         std::vector<std::size_t> & offsets,
+                                         std::vector<std::size_t> & nbytes) const {
+            ChunkHandleType shardChunk(handle_, shardCoord, shardShape_, shape());
+            if(!readSlotsOnly(slots)) {
+                if(!STORE::read(shardChunk, shardBuf, "shard")) {
+                    return false;
+                }
+                slotsFromIndex(shardBuf.data(), shardBuf.size(), offsets, nbytes);
+                return true;
+            }
+
+            const auto index = shardIndex(shardCoord, shardChunk);
+            if(!index) {
+                return false;
+            }
+            const auto & entries = index->entries;
+            offsets.assign(nSlots_, 0);
+            nbytes.assign(nSlots_, 0);
+
+            // the needed non-empty slots in storage order
+            std::vector<std::size_t> needed;
+            for(const std::size_t slot : slots) {
+                if(!entries[slot].empty() && entries[slot].nbytes > 0) {
+                    needed.push_back(slot);
+                }
+            }
+            std::sort(needed.begin(), needed.end(), [&](const std::size_t a, const std::size_t b){
+                return entries[a].offset < entries[b].offset;
+            });
+
+            // coalesce them into ranges, which are read back to back into shardBuf
+            std::vector<ByteRange> ranges;
+            std::size_t rangeStart = 0;  // start of the current range in shardBuf
+            for(const std::size_t slot : needed) {
+                const auto & e = entries[slot];
+                if(ranges.empty() || e.offset > ranges.back().offset + ranges.back().nBytes + STORE::rangeCoalesceGap) {
+                    if(!ranges.empty()) {
+                        rangeStart += ranges.back().nBytes;
+                    }
+                    ranges.push_back(ByteRange{e.offset, 0});
+                }
+                auto & range = ranges.back();
+                range.nBytes = std::max<std::size_t>(range.nBytes, e.offset + e.nbytes - range.offset);
+                offsets[slot] = rangeStart + (e.offset - range.offset);
+                nbytes[slot] = e.nbytes;
+            }
+            if(ranges.empty()) {
+                shardBuf.clear();
+                return true;
+            }
+            shardBuf.resize(rangeStart + ranges.back().nBytes);
+            return STORE::readRanges(shardChunk, ranges, shardBuf.data(), "shard");
+        }
+
+        // readShardBlobs / writeShardBlobs / updateShardSlots without applying the
+        // pending writes first (for use while applying them)
+        inline void loadShardBlobs(const types::ShapeType & shardCoord,
+                                   std::vector<std::vector<char>> & blobs) const {
+            // clear slot-by-slot (not assign) so a caller-reused `blobs` keeps the slot
+            // vectors' capacity across shards
+            blobs.resize(nSlots_);
+            for(auto & blob : blobs) {
+                blob.clear();
+            }
+            ChunkHandleType shardChunk(handle_, shardCoord, shardShape_, shape());
+            std::vector<char> shardBuf;
             if(!STORE::read(shardChunk, shardBuf, "shard")) {
+                return;
+            }
+            std::vector<util::ShardEntry> entries;
+            // a present but corrupt shard must fail loudly: this function feeds the
+            // write read-modify-write path, and treating corruption as "empty shard"
+            // would silently discard all other inner chunks on the next write
+            if(!util::parseShardIndex(shardBuf, nSlots_, entries, indexLayout_)) {
+                throw std::runtime_error(std::string(STORE::shardedName) + ": corrupt shard index");
+            }
+            util::extractShardBlobs(shardBuf, entries, blobs);
+        }
+
+        inline void storeShardBlobs(const types::ShapeType & shardCoord,
+                                    const std::vector<std::vector<char>> & blobs) const {
+            // single choke point for all sharded writes (writeChunk, removeChunk and
+            // the shard-aware writeSubarray path) -> enforce the file mode here
+            if(!handle_.mode().canWrite()) {
+                throw std::invalid_argument("Cannot write data in file mode " + handle_.mode().printMode());
+            }
+            ChunkHandleType shardChunk(handle_, shardCoord, shardShape_, shape());
+            if(util::allSlotsEmpty(blobs)) {
+                indexCache_.erase(shardCoord);
+                STORE::erase(shardChunk);
+                return;
+            }
+            std::vector<char> out;
+            auto index = std::make_shared<ShardIndex>();
+            util::buildShard(blobs, out, index->entries, indexLayout_, placement_);
+            index->size = out.size();
+            // drop the cached index first, so it is never newer than the shard
+            indexCache_.erase(shardCoord);
+            STORE::write(shardChunk, out, "shard");
+            cacheIndex(shardCoord, shardChunk, std::move(index));
+        }
+
+        inline void applyShardSlots(const types::ShapeType & shardCoord,
+                                    const std::vector<std::size_t> & slots,
+                                    const std::vector<std::vector<char>> & blobs) const {
+            if(!handle_.mode().canWrite()) {
+                throw std::invalid_argument("Cannot write data in file mode " + handle_.mode().printMode());
+            }
+            if constexpr(AppendableChunkStorePolicy<STORE>) {
+                if(appendsShardUpdates() && slots.size() < nSlots_ &&
+                   appendShardSlots(shardCoord, slots, blobs)) {
+                    return;
+                }
+            }
+            // rewrite the shard
+            std::vector<std::vector<char>> shardBlobs;
+            if(slots.size() < nSlots_) {
+                loadShardBlobs(shardCoord, shardBlobs);
+            } else {
+                shardBlobs.resize(nSlots_);
+            }
+            for(std::size_t k = 0; k < slots.size(); ++k) {
+                shardBlobs[slots[k]] = blobs[k];
+            }
+            storeShardBlobs(shardCoord, shardBlobs);
+        }
+
+        inline std::shared_mutex & shardLock(const types::ShapeType & shardCoord) const {
+            // neighbouring shards map to different stripes
+            std::size_t h = 0;
+            for(const auto c : shardCoord) {
+                h = h * 1000003 + c;
+            }
+            return shardLocks_[h % nShardLocks];
+        }
+
+        // the inner chunk blobs of a shard that were written but not stored yet (an empty
+        // blob removes the chunk)
+        struct PendingShard {
+            std::map<std::size_t, std::vector<char>> blobs;
+        };
+
+        // a shard's parsed index and the version of the shard it was read from
+        struct ShardIndex {
+            ObjectVersion version;
+            std::size_t size = 0;  // size of the shard the index belongs to
+            std::vector<util::ShardEntry> entries;
+        };
+        typedef std::shared_ptr<const ShardIndex> ShardIndexPtr;
+
+        // the index of a shard, from the cache if the shard did not change since it was
+        // cached; a null pointer if the shard does not exist
+        inline ShardIndexPtr shardIndex(const types::ShapeType & shardCoord,
+                                        const ChunkHandleType & shardChunk) const {
+            if constexpr(VersionedChunkStorePolicy<STORE>) {
+                if(indexCache_.maxBytes() > 0) {
+                    // stat before reading: if the shard changes in between, the cached
+                    // version is outdated and the index is read again next time
+                    ObjectVersion version;
+                    if(!STORE::stat(shardChunk, version)) {
+                        indexCache_.erase(shardCoord);
+                        return ShardIndexPtr();
+                    }
+                    auto cached = indexCache_.get(shardCoord);
+                    if(cached && cached->version == version) {
+                        return cached;
+                    }
+                    auto index = std::make_shared<ShardIndex>();
+                    index->version = version;
+                    if(!readShardIndex(shardChunk, index->entries, index->size)) {
+                        indexCache_.erase(shardCoord);
+                        return ShardIndexPtr();
+                    }
+                    indexCache_.put(shardCoord, index, indexBytes());
+                    return index;
+                }
+            }
+            auto index = std::make_shared<ShardIndex>();
+            if(!readShardIndex(shardChunk, index->entries, index->size)) {
+                return ShardIndexPtr();
+            }
+            return index;
+        }
+
+        // cache the index of a shard that was just written
+        inline void cacheIndex(const types::ShapeType & shardCoord,
+                               const ChunkHandleType & shardChunk,
+                               std::shared_ptr<ShardIndex> index) const {
+            if constexpr(VersionedChunkStorePolicy<STORE>) {
+                if(indexCache_.maxBytes() > 0 && STORE::stat(shardChunk, index->version)) {
+                    indexCache_.put(shardCoord, std::move(index), indexBytes());
+                }
+            }
+        }
+
+        inline std::size_t indexBytes() const {
+            return sizeof(ShardIndex) + nSlots_ * sizeof(util::ShardEntry);
+        }
+
+        // read only the index of a shard object (its head or tail) and parse it; returns
+        // false if the shard does not exist
+        inline bool readShardIndex(const ChunkHandleType & shardChunk,
+                                   std::vector<util::ShardEntry> & entries,
+                                   std::size_t & shardSize) const {
+            const std::size_t indexSize = util::shardIndexSize(nSlots_, indexLayout_);
+            std::vector<char> indexBytes;
+            const bool exists = indexLayout_.atStart ?
+                STORE::readHead(shardChunk, indexSize, indexBytes, shardSize, "shard") :
+                STORE::readTail(shardChunk, indexSize, indexBytes, shardSize, "shard");
+            if(!exists) {
                 return false;
             }
-            if(!util::parseShardIndex(shardBuf, nSlots_, entries)) {
+            if(indexBytes.size() != indexSize ||
+               !util::parseShardIndexBytes(indexBytes.data(), shardSize, nSlots_, entries, indexLayout_)) {
                 throw std::runtime_error(std::string(STORE::shardedName) + ": corrupt shard index");
             }
             return true;
         }
 
-        // replace one inner chunk's blob in its shard (read-modify-write). Serialized by
-        // shardMutex_ so concurrent direct writeChunk calls to the same shard are safe;
-        // the read + rebuild themselves are shared with the batched shard-aware path.
+        // Append the new blobs of `slots` behind the shard's data and write a new footer;
+        // returns false if the shard has to be rewritten instead (it does not exist, would
+        // become empty, or too much of it would be dead bytes).
+        inline bool appendShardSlots(const types::ShapeType & shardCoord,
+                                     const std::vector<std::size_t> & slots,
+                                     const std::vector<std::vector<char>> & blobs) const {
+            if constexpr(AppendableChunkStorePolicy<STORE>) {
+                ChunkHandleType shardChunk(handle_, shardCoord, shardShape_, shape());
+                const auto current = shardIndex(shardCoord, shardChunk);
+                if(!current) {
+                    return false;
+                }
+                const std::size_t footerSize = util::shardIndexSize(nSlots_, indexLayout_);
+                const std::size_t dataEnd = current->size - footerSize;
+
+                auto index = std::make_shared<ShardIndex>();
+                index->entries = current->entries;
+                auto & entries = index->entries;
+                // the appended blobs follow the dataset's blob order as well
+                std::vector<std::size_t> appendOrder(slots.size());
+                std::iota(appendOrder.begin(), appendOrder.end(), std::size_t(0));
+                if(!placementRank_.empty()) {
+                    std::sort(appendOrder.begin(), appendOrder.end(), [&](const std::size_t a, const std::size_t b){
+                        return placementRank_[slots[a]] < placementRank_[slots[b]];
+                    });
+                }
+                std::vector<char> tail;
+                for(const std::size_t k : appendOrder) {
+                    const auto & blob = blobs[k];
+                    if(blob.empty()) {
+                        entries[slots[k]] = util::ShardEntry();
+                        continue;
+                    }
+                    entries[slots[k]].offset = dataEnd + tail.size();
+                    entries[slots[k]].nbytes = blob.size();
+                    tail.insert(tail.end(), blob.begin(), blob.end());
+                }
+
+                std::size_t liveBytes = 0;
+                bool anyLive = false;
+                for(const auto & entry : entries) {
+                    if(!entry.empty()) {
+                        liveBytes += entry.nbytes;
+                        anyLive = true;
+                    }
+                }
+                const std::size_t dataBytes = dataEnd + tail.size();
+                if(!anyLive ||
+                   static_cast<double>(dataBytes - liveBytes) > util::shardCompactionRatio() * (dataBytes + footerSize)) {
+                    return false;
+                }
+
+                util::appendShardIndex(entries, tail, indexLayout_);
+                index->size = dataEnd + tail.size();
+                indexCache_.erase(shardCoord);
+                STORE::writeTail(shardChunk, dataEnd, tail.data(), tail.size(), "shard");
+                cacheIndex(shardCoord, shardChunk, std::move(index));
+                return true;
+            } else {
+                return false;
+            }
+        }
+
+        // reading the index separately pays off if less than half of the slots are needed
+        inline bool readSlotsOnly(const std::vector<std::size_t> & slots) const {
+            return 2 * slots.size() < nSlots_;
+        }
+
+        // parse the index of a shard's bytes into per-slot byte offsets + lengths
+        // (length 0 for empty slots)
+        inline void slotsFromIndex(const char * shard, const std::size_t shardSize,
+                                   std::vector<std::size_t> & offsets,
+                                   std::vector<std::size_t> & nbytes) const {
+            std::vector<util::ShardEntry> entries;
+            if(!util::parseShardIndex(shard, shardSize, nSlots_, entries, indexLayout_)) {
+                throw std::runtime_error(std::string(STORE::shardedName) + ": corrupt shard index");
+            }
+            offsets.resize(nSlots_);
+            nbytes.resize(nSlots_);
+            for(std::size_t s = 0; s < nSlots_; ++s) {
+                offsets[s] = entries[s].empty() ? 0 : entries[s].offset;
+                nbytes[s] = entries[s].empty() ? 0 : entries[s].nbytes;
+            }
+        }
+
+        // replace one inner chunk's blob in its shard (appended in place or by rewriting
+        // the shard, see updateShardSlots). Serialized by the shard's lock so concurrent
+        // direct writeChunk calls to the same shard are safe, while writes to other shards
+        // proceed in parallel; the update itself is shared with the batched shard-aware path.
         inline void writeInnerBlob(const types::ShapeType & chunkId,
                                    std::vector<char> && blob,
                                    const bool nonEmpty) const {
-            std::lock_guard<std::mutex> lock(shardMutex_);
-
             const auto shardCoord = util::shardId(chunkId, chunksPerShard_);
             const std::size_t slot = util::shardSlot(chunkId, chunksPerShard_);
+            if(!nonEmpty) {
+                blob.clear();
+            }
+
+            if(writeBackBytes_ > 0) {
+                bool overBudget;
+                {
+                    std::lock_guard<std::mutex> pendingLock(pendingMutex_);
+                    auto & shard = pending_[shardCoord];
+                    if(shard.blobs.empty()) {
+                        ++nPending_;
+                    }
+                    auto & pendingBlob = shard.blobs[slot];
+                    pendingBytes_ -= pendingBlob.size();
+                    pendingBytes_ += blob.size();
+                    pendingBlob = std::move(blob);
+                    overBudget = pendingBytes_ > writeBackBytes_;
+                }
+                // reads apply the pending chunks of a shard first, so they see the
+                // new chunk from here on
+                invalidateCachedChunk(chunkId);
+                if(overBudget) {
+                    flushPendingShards();
+                }
+                return;
+            }
+
+            {
+                std::unique_lock<std::shared_mutex> lock(shardLock(shardCoord));
+                std::vector<std::vector<char>> blobs(1);
+                blobs[0] = std::move(blob);
+                applyShardSlots(shardCoord, {slot}, blobs);
+            }
+            invalidateCachedChunk(chunkId);
+        }
+
+        // drop the decoded inner chunks of a shard that was rewritten or updated
+        inline void invalidateCachedShard(const types::ShapeType & shardCoord) const {
+            invalidateCachedChunksIf([&](const types::ShapeType & chunkId){
+                return util::shardId(chunkId, chunksPerShard_) == shardCoord;
+            });
+        }
+
+        // write all pending inner chunks (one update per shard)
+        inline void flushPendingShards() const {
+            if(nPending_ == 0) {
+                return;
+            }
+            std::vector<types::ShapeType> shardCoords;
+            {
+                std::lock_guard<std::mutex> pendingLock(pendingMutex_);
+                shardCoords.reserve(pending_.size());
+                for(const auto & kv : pending_) {
+                    shardCoords.push_back(kv.first);
+                }
+            }
+            for(const auto & shardCoord : shardCoords) {
+                flushPending(shardCoord);
+            }
+        }
 
+        // write the pending chunks of one shard, if there are any. Extracting and applying
+        // them under the shard's lock keeps concurrent flushes of a shard in order. If the
+        // write fails, the chunks are pending again (behind the ones written since), so that
+        // the next flush retries them.
+        inline void flushPending(const types::ShapeType & shardCoord) const {
+            if(nPending_ == 0) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> pendingLock(pendingMutex_);
+                if(pending_.find(shardCoord) == pending_.end()) {
+                    return;
+                }
+            }
+            std::unique_lock<std::shared_mutex> lock(shardLock(shardCoord));
+            std::vector<std::size_t> slots;
             std::vector<std::vector<char>> blobs;
-            readShardBlobs(shardCoord, blobs);
-            blobs[slot] = nonEmpty ? std::move(blob) : std::vector<char>();
-            writeShardBlobs(shardCoord, blobs);
+            {
+                std::lock_guard<std::mutex> pendingLock(pendingMutex_);
+                auto it = pending_.find(shardCoord);
+                if(it == pending_.end()) {
+                    return;
+                }
+                slots.reserve(it->second.blobs.size());
+                blobs.reserve(it->second.blobs.size());
+                for(auto & kv : it->second.blobs) {
+                    pendingBytes_ -= kv.second.size();
+                    slots.push_back(kv.first);
+                    blobs.push_back(std::move(kv.second));
+                }
+                pending_.erase(it);
+                --nPending_;
+            }
+            try {
+                applyShardSlots(shardCoord, slots, blobs);
+            } catch(...) {
+                restorePending(shardCoord, slots, blobs);
+                throw;
+            }
+        }
+
+        // put the chunks of a failed shard write back, unless they were written again
+        inline void restorePending(const types::ShapeType & shardCoord,
+                                   const std::vector<std::size_t> & slots,
+                                   std::vector<std::vector<char>> & blobs) const {
+            std::lock_guard<std::mutex> pendingLock(pendingMutex_);
+            auto & shard = pending_[shardCoord];
+            if(shard.blobs.empty()) {
+                ++nPending_;
+            }
+            for(std::size_t k = 0; k < slots.size(); ++k) {
+                const std::size_t size = blobs[k].size();
+                if(shard.blobs.try_emplace(slots[k], std::move(blobs[k])).second) {
+                    pendingBytes_ += size;
+                }
+            }
         }
 
         inline void checkChunk(const ChunkHandleType & chunk, const bool isVarlen=false) const {
@@ -311,7 +981,21 @@ namespace generic {
         types::ShapeType shardShape_;
         types::ShapeType chunksPerShard_;
         std::size_t nSlots_;
-        mutable std::mutex shardMutex_;
+        util::ShardIndexLayout indexLayout_;
+        // storage order of the blobs (see util::setShardBlobOrder; empty: C order) and
+        // the position of each slot in it
+        std::vector<std::size_t> placement_;
+        std::vector<std::size_t> placementRank_;
+        // striped per-shard locks: shared for reads, exclusive for writes
+        static constexpr std::size_t nShardLocks = 128;
+        mutable std::array<std::shared_mutex, nShardLocks> shardLocks_;
+        mutable util::LruCache<types::ShapeType, ShardIndex> indexCache_;
+        // write-back of writeChunk / removeChunk
+        std::size_t writeBackBytes_;
+        mutable std::mutex pendingMutex_;
+        mutable std::map<types::ShapeType, PendingShard> pending_;
+        mutable std::size_t pendingBytes_ = 0;
+        mutable std::atomic<std::size_t> nPending_{0};
     };
 
 
@@ -1,12 +1,32 @@
 #pragma once
 
 #include <concepts>
+#include <cstdint>
 #include <filesystem>
+#include <string>
 #include <vector>
 
+#include "z5/util/mapped_file.hxx"
+
 namespace z5 {
 namespace generic {
 
+    // a byte range [offset, offset + nBytes) of a stored object
+    struct ByteRange {
+        std::size_t offset;
+        std::size_t nBytes;
+    };
+
+    // what identifies a version of a stored object: its size and, depending on the
+    // store, modification time + file id (filesystem) or ETag (S3)
+    struct ObjectVersion {
+        std::size_t size = 0;
+        int64_t mtime = 0;
+        uint64_t id = 0;
+        std::string etag;
+        bool operator==(const ObjectVersion &) const = default;
+    };
+
     // Compile-time interface of a backend's chunk store: the thin byte-IO layer
     // (read / write / erase one chunk or shard object) that the generic dataset
     // implementations in z5/generic/ are parameterized on. Each backend's store
@@ -16,16 +36,33 @@ namespace generic {
     //
     // The 'what' parameter of read/write names the object kind ("chunk"/"shard")
     // for error messages; object-store backends may ignore it.
+    //
+    // The range reads let the sharded datasets fetch a shard's index and only the
+    // inner chunks a request touches instead of the whole shard object: readHead /
+    // readTail read the first / last min(n, size) bytes and report the object size
+    // (shard indices are stored at the start or the end of the shard), readRanges reads the
+    // given ranges back to back into `out` (which must hold their total size). Both
+    // return false if the object is absent and throw if a range is out of bounds.
+    // rangeCoalesceGap is the largest gap between two ranges that is cheaper to read
+    // along than to request separately.
     template<class STORE>
     concept ChunkStorePolicy = requires(const typename STORE::ChunkHandleType & chunk,
                                         const typename STORE::DatasetHandleType & ds,
                                         std::vector<char> & buffer,
                                         std::filesystem::path & path,
-                                        const char * what) {
+                                        const char * what,
+                                        std::size_t & size,
+                                        const std::vector<ByteRange> & ranges,
+                                        char * out) {
         // byte IO; read returns false if the object is absent, erase is idempotent
         { STORE::read(chunk, buffer, what) } -> std::convertible_to<bool>;
         STORE::write(chunk, buffer, what);
         STORE::erase(chunk);
+        // range IO
+        { STORE::readHead(chunk, std::size_t(), buffer, size, what) } -> std::convertible_to<bool>;
+        { STORE::readTail(chunk, std::size_t(), buffer, size, what) } -> std::convertible_to<bool>;
+        { STORE::readRanges(chunk, ranges, out, what) } -> std::convertible_to<bool>;
+        { STORE::rangeCoalesceGap } -> std::convertible_to<std::size_t>;
         // path API (object-store backends return an empty path / no-op)
         { STORE::path(ds) } -> std::same_as<const std::filesystem::path &>;
         STORE::chunkPath(chunk, path);
@@ -34,5 +71,80 @@ namespace generic {
         { STORE::shardedName } -> std::convertible_to<const char *>;
     };
 
+    // Optional extension: stores that can read many chunk objects at once (the
+    // filesystem store with one io_uring batch, S3 with concurrent requests).
+    // readBatch reads chunks[i] into *buffers[i] (an absent chunk yields an empty
+    // buffer); readBatchSize is the number of chunks worth batching (1: batching
+    // brings no benefit, e.g. io_uring is not available).
+    // The generic dataset falls back to one read per chunk for other stores.
+    template<class STORE>
+    concept BatchedChunkStorePolicy = ChunkStorePolicy<STORE> &&
+        requires(const std::vector<typename STORE::ChunkHandleType> & chunks,
+                 const std::vector<std::vector<char> *> & buffers,
+                 const char * what) {
+        STORE::readBatch(chunks, buffers, what);
+        { STORE::readBatchSize() } -> std::convertible_to<std::size_t>;
+    };
+
+    // Optional extension: stores that can list the chunk (or shard) objects of a dataset
+    // and erase many of them at once (S3, where an existence check per grid position is a
+    // request of its own). listChunks appends the chunk indices of the objects of an
+    // `ndim`-dimensional dataset, eraseBatch erases the given chunks (idempotent as erase).
+    // Used to remove datasets and chunks without walking the chunk grid.
+    template<class STORE>
+    concept ListableChunkStorePolicy = ChunkStorePolicy<STORE> &&
+        requires(const typename STORE::DatasetHandleType & ds,
+                 std::vector<std::vector<std::size_t>> & chunkIds,
+                 const std::vector<typename STORE::ChunkHandleType> & chunks) {
+        STORE::listChunks(ds, std::size_t(), chunkIds);
+        STORE::eraseBatch(chunks);
+    };
+
+    // Optional extension: stores whose objects can be memory mapped (the filesystem).
+    // map returns false if the object is absent; with populate == false the pages are not
+    // read ahead (for callers that only touch parts of the object, see
+    // MappedFile::willNeed). mappedReads tells whether mapping is currently enabled. Used
+    // by the zero-copy read paths of uncompressed datasets.
+    template<class STORE>
+    concept MappedChunkStorePolicy = ChunkStorePolicy<STORE> &&
+        requires(const typename STORE::ChunkHandleType & chunk,
+                 util::MappedFile & mapped,
+                 const char * what) {
+        { STORE::map(chunk, mapped, what, bool()) } -> std::convertible_to<bool>;
+        { STORE::mappedReads() } -> std::convertible_to<bool>;
+    };
+
+    // Optional extension: stores that can overwrite the end of an object in place (the
+    // filesystem). writeTail replaces the bytes from `offset` on with `nBytes` bytes of
+    // `data` (the object must exist and be at least `offset` bytes long); appendUpdates
+    // tells whether sharded datasets should use it to update shards in place.
+    template<class STORE>
+    concept AppendableChunkStorePolicy = ChunkStorePolicy<STORE> &&
+        requires(const typename STORE::ChunkHandleType & chunk,
+                 const char * data,
+                 const char * what) {
+        STORE::writeTail(chunk, std::size_t(), data, std::size_t(), what);
+        { STORE::appendUpdates() } -> std::convertible_to<bool>;
+    };
+
+    // Optional extension: stores that can tell the current version of an object more
+    // cheaply than reading it. stat returns false if the object is absent. Used to
+    // validate cached shard indices, so writes by other processes are detected.
+    template<class STORE>
+    concept VersionedChunkStorePolicy = ChunkStorePolicy<STORE> &&
+        requires(const typename STORE::ChunkHandleType & chunk,
+                 ObjectVersion & version) {
+        { STORE::stat(chunk, version) } -> std::convertible_to<bool>;
+    };
+
+    // Optional extension: stores that complete writes in the background (S3 with
+    // write-behind). flush waits until all writes are stored and rethrows write errors;
+    // Dataset::flush calls it.
+    template<class STORE>
+    concept FlushableChunkStorePolicy = ChunkStorePolicy<STORE> &&
+        requires() {
+        STORE::flush();
+    };
+
 }
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <set>
 #include "z5/types/types.hxx"
 #include "z5/util/file_mode.hxx"
@@ -127,6 +128,41 @@ namespace handle {
         int zarrFormat() const {return zarrFormat_;}
         const std::string & chunkKeyEncoding() const {return chunkKeyEncoding_;}
 
+        // the inverse of Chunk::getChunkKey: the indices of the chunk with the key `key`
+        // (relative to the dataset) in an `ndim`-dimensional dataset; false if `key` is not
+        // a chunk key, e.g. of a metadata file
+        inline bool parseChunkKey(const std::string & key, const bool isZarr, const std::size_t ndim,
+                                  types::ShapeType & chunkIndices) const {
+            std::string name = key;
+            const std::string delimiter = isZarr ? zarrDelimiter_ : "/";
+            if(isZarr && zarrFormat_ == 3 && chunkKeyEncoding_ == "default") {
+                const std::string head = "c" + zarrDelimiter_;
+                if(name.compare(0, head.size(), head) != 0) {
+                    return false;
+                }
+                name = name.substr(head.size());
+            }
+            std::vector<std::string> parts;
+            util::split(name, parts, delimiter);
+            if(parts.size() != ndim) {
+                return false;
+            }
+            chunkIndices.resize(ndim);
+            for(std::size_t d = 0; d < ndim; ++d) {
+                const auto & part = parts[d];
+                if(part.empty() || part.size() > 19 ||
+                   part.find_first_not_of("0123456789") != std::string::npos) {
+                    return false;
+                }
+                chunkIndices[d] = std::stoull(part);
+            }
+            // N5-Axis order: the chunk indices are stored in reverse order
+            if(!isZarr) {
+                std::reverse(chunkIndices.begin(), chunkIndices.end());
+            }
+            return true;
+        }
+
     private:
         std::string zarrDelimiter_;
         int zarrFormat_;
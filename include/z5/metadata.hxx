@@ -45,7 +45,8 @@ namespace z5 {
             const std::string & zarrDelimiter=".",
             const int zarrFormat=2,
             const std::string & chunkKeyEncoding="default",
-            const types::ShapeType & shardShape=types::ShapeType()
+            const types::ShapeType & shardShape=types::ShapeType(),
+            const std::string & shardIndexLocation="end"
             ) : Metadata(isZarr, zarrFormat),
                 dtype(dtype),
                 shape(shape),
@@ -55,7 +56,8 @@ namespace z5 {
                 fillValue(fillValue),
                 zarrDelimiter(zarrDelimiter),
                 chunkKeyEncoding(chunkKeyEncoding),
-                shardShape(shardShape)
+                shardShape(shardShape),
+                shardIndexLocation(shardIndexLocation)
         {
             checkShapes();
         }
@@ -295,11 +297,13 @@ namespace z5 {
                 bytesCodec["name"] = "bytes";
                 bytesCodec["configuration"]["endian"] = "little";
                 indexCodecs.push_back(bytesCodec);
-                nlohmann::json crcCodec;
-                crcCodec["name"] = "crc32c";
-                indexCodecs.push_back(crcCodec);
+                if(shardIndexChecksum) {
+                    nlohmann::json crcCodec;
+                    crcCodec["name"] = "crc32c";
+                    indexCodecs.push_back(crcCodec);
+                }
                 sharding["configuration"]["index_codecs"] = indexCodecs;
-                sharding["configuration"]["index_location"] = "end";
+                sharding["configuration"]["index_location"] = shardIndexLocation;
                 j["codecs"] = nlohmann::json::array({sharding});
             } else {
                 j["codecs"] = innerCodecs;
@@ -367,6 +371,7 @@ namespace z5 {
                     chunkShape = types::ShapeType(innerShapeJson.begin(), innerShapeJson.end());
                     shardShape = outerShape;
                     innerCodecs = &scfg.at("codecs");
+                    readShardIndexLayout(scfg);
                     break;
                 }
             }
@@ -377,6 +382,39 @@ namespace z5 {
             types::readV3CodecsFromJson(*innerCodecs, compressor, compressionOptions);
         }
 
+        // index_location and index_codecs of the sharding codec; the index must be
+        // little endian `bytes`, optionally followed by `crc32c` (readers locate the index
+        // by its size, so variable-size codecs such as compressors cannot be used)
+        void readShardIndexLayout(const nlohmann::json & scfg) {
+            shardIndexLocation = scfg.contains("index_location") ?
+                scfg.at("index_location").get<std::string>() : std::string("end");
+            if(shardIndexLocation != "start" && shardIndexLocation != "end") {
+                throw std::runtime_error("z5.DatasetMetadata.fromJsonV3: invalid shard index_location " + shardIndexLocation);
+            }
+            shardIndexChecksum = true;
+            if(!scfg.contains("index_codecs")) {
+                return;
+            }
+            const auto & indexCodecs = scfg.at("index_codecs");
+            std::size_t k = 0;
+            for(const auto & c : indexCodecs) {
+                const auto name = c.at("name").get<std::string>();
+                if(!((k == 0 && name == "bytes") || (k == 1 && name == "crc32c"))) {
+                    throw std::runtime_error("z5.DatasetMetadata.fromJsonV3: unsupported shard index codec " + name +
+                                             " (the index must be 'bytes', optionally followed by 'crc32c')");
+                }
+                if(c.contains("configuration") && c.at("configuration").contains("endian") &&
+                   c.at("configuration").at("endian") != "little") {
+                    throw std::runtime_error("z5.DatasetMetadata.fromJsonV3: only little endian shard indices are supported");
+                }
+                ++k;
+            }
+            if(k == 0) {
+                throw std::runtime_error("z5.DatasetMetadata.fromJsonV3: the shard index needs a 'bytes' codec");
+            }
+            shardIndexChecksum = k == 2;
+        }
+
     public:
         // metadata values that can be set
         types::Datatype dtype;
@@ -394,6 +432,9 @@ namespace z5 {
         // shape (empty unless the sharding_indexed codec is used)
         std::string chunkKeyEncoding = "default";
         types::ShapeType shardShape;
+        // where the shard index is stored ("end" / "start") and whether it has a crc32c
+        std::string shardIndexLocation = "end";
+        bool shardIndexChecksum = true;
 
         // metadata values that are fixed for now
         // zarr format is fixed to 2
@@ -456,7 +497,8 @@ namespace z5 {
         DatasetMetadata & metadata,
         const int zarrFormat=2,
         const std::string & chunkKeyEncoding="default",
-        const types::ShapeType & shardShape=types::ShapeType())
+        const types::ShapeType & shardShape=types::ShapeType(),
+        const std::string & shardIndexLocation="end")
     {
         // get the internal data type
         types::Datatype internalDtype;
@@ -493,13 +535,16 @@ namespace z5 {
                     throw std::runtime_error("z5::createDatasetMetadata: shard shape must be a multiple of the chunk shape");
                 }
             }
+            if(shardIndexLocation != "start" && shardIndexLocation != "end") {
+                throw std::runtime_error("z5::createDatasetMetadata: shard index location must be 'start' or 'end'");
+            }
         }
 
         metadata = DatasetMetadata(internalDtype, shape,
                                    chunkShape, createAsZarr,
                                    internalCompressor, internalCompressionOptions,
                                    fillValue, zarrDelimiter,
-                                   zarrFormat, chunkKeyEncoding, shardShape);
+                                   zarrFormat, chunkKeyEncoding, shardShape, shardIndexLocation);
     }
 
 
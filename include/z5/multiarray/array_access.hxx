@@ -2,7 +2,9 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <map>
+#include <mutex>
 #include <numeric>
 
 #include "z5/dataset.hxx"
@@ -10,6 +12,8 @@
 #include "z5/multiarray/array_view.hxx"
 #include "z5/multiarray/array_util.hxx"
 #include "z5/util/threadpool.hxx"
+#include "z5/util/pipeline.hxx"
+#include "z5/util/async.hxx"
 #include "z5/util/sharding.hxx"
 
 
@@ -17,62 +21,100 @@ namespace z5 {
 namespace multiarray {
 
 
-    // Run `body(buffer, unitIndex)` for each unit in [0, nUnits), single- or multi-threaded.
-    // Each thread gets its own reusable buffer of `bufSize` elements (initialised to `init`),
-    // so per-unit buffer reuse and the single-threaded (no-threadpool) fast path are kept.
-    // `body` is a template parameter -> no std::function indirection / zero abstraction cost.
-    template<typename T, typename BODY>
-    inline void forEachBuffered(const int numberOfThreads, const std::size_t nUnits,
-                                const std::size_t bufSize, const T init, BODY && body) {
-        if(numberOfThreads == 1) {
-            std::vector<T> buffer(bufSize, init);
-            for(std::size_t i = 0; i < nUnits; ++i) {
-                body(buffer, i);
-            }
-        } else {
-            util::ThreadPool tp(numberOfThreads);
-            // a pool created with n_threads <= 0 may have 0 workers; parallel_foreach then
-            // runs synchronously and still calls the task with thread id 0, so we need at
-            // least one per-thread buffer.
-            const int nThreads = std::max(1, static_cast<int>(tp.nThreads()));
-            std::vector<std::vector<T>> buffers(nThreads, std::vector<T>(bufSize, init));
-            util::parallel_foreach(tp, nUnits, [&](const int tId, const std::size_t i){
-                body(buffers[tId], i);
-            });
+    // Per-thread scratch of the staged read / write paths, reused across chunks, shards and
+    // calls (util::ThreadLocalScratch): repeatedly allocating and freeing buffers of
+    // hundreds of KB to MBs makes throughput dependent on the allocator's mmap/trim
+    // heuristics (page faults on every cycle in the unlucky mode), which reuse avoids
+    // deterministically. util::releaseThreadScratch() drops the retained buffers.
+    template<typename T>
+    inline std::vector<T> & chunkScratchBuffer(util::ThreadLocalScratch<std::vector<T>> & scratch,
+                                               const std::size_t size) {
+        auto & buffer = scratch.get();
+        if(buffer.size() != size) {
+            buffer.resize(size);
         }
+        return buffer;
     }
 
 
-    // Like forEachBuffered, but with an arbitrary per-thread state object constructed by
-    // `makeState()`. The shard paths use this to reuse ALL their large scratch buffers
-    // across shards: repeatedly allocating and freeing buffers of hundreds of KB to MBs
-    // makes throughput dependent on the allocator's mmap/trim heuristics (page faults on
-    // every cycle in the unlucky mode), which reuse avoids deterministically.
-    template<typename MAKE_STATE, typename BODY>
-    inline void forEachWithState(const int numberOfThreads, const std::size_t nUnits,
-                                 MAKE_STATE && makeState, BODY && body) {
-        if(numberOfThreads == 1) {
-            auto state = makeState();
-            for(std::size_t i = 0; i < nUnits; ++i) {
-                body(state, i);
-            }
-        } else {
-            util::ThreadPool tp(numberOfThreads);
-            // see forEachBuffered for the max(1, ...): a pool with 0 workers still runs
-            // tasks (synchronously) with thread id 0
-            const int nThreads = std::max(1, static_cast<int>(tp.nThreads()));
-            std::vector<decltype(makeState())> states;
-            states.reserve(nThreads);
-            for(int t = 0; t < nThreads; ++t) {
-                states.emplace_back(makeState());
+    // true if the stored bytes of uncompressed chunks can be copied into the output as
+    // they are: raw codec and no byte swapping (zarr is little endian, n5 big endian)
+    template<typename T>
+    inline bool rawPayloadIsData(const Dataset & ds) {
+        return ds.getCompressor() == types::raw && (ds.isZarr() || sizeof(T) == 1);
+    }
+
+    // `nBytes` at `bytes` can be viewed as `nElements` values of type T
+    template<typename T>
+    inline bool isRawPayload(const char * bytes, const std::size_t nBytes, const std::size_t nElements) {
+        return nBytes == nElements * sizeof(T) &&
+               reinterpret_cast<std::uintptr_t>(bytes) % alignof(T) == 0;
+    }
+
+    // put a decoded chunk (`chunkSize` values laid out in `chunkShape`) into the
+    // decoded-chunk cache of the dataset, for a read that started at `generation`
+    template<typename T>
+    inline void cacheDecodedChunk(const Dataset & ds,
+                                  const types::ShapeType & chunkId,
+                                  const T * data,
+                                  const types::ShapeType & chunkShape,
+                                  const std::size_t chunkSize,
+                                  const std::uint64_t generation) {
+        auto chunk = std::make_shared<util::DecodedChunk>();
+        chunk->shape = chunkShape;
+        chunk->data.assign(reinterpret_cast<const char *>(data),
+                           reinterpret_cast<const char *>(data + chunkSize));
+        const std::size_t nBytes = chunk->data.size();
+        ds.chunkCache().put(chunkId, std::move(chunk), nBytes, generation);
+    }
+
+    // Copy the requested chunks that are in the decoded-chunk cache into the output and
+    // return the others, which still have to be read.
+    template<typename T>
+    inline std::vector<types::ShapeType> readCachedChunks(const Dataset & ds,
+                                                          const ArrayView<T> & out,
+                                                          const types::ShapeType & offset,
+                                                          const types::ShapeType & shape,
+                                                          const std::vector<types::ShapeType> & chunkRequests,
+                                                          const int numberOfThreads) {
+        auto & cache = ds.chunkCache();
+        std::vector<types::ShapeType> misses;
+        std::vector<std::pair<std::size_t, util::DecodedChunkCache::ValuePtr>> hits;
+        for(std::size_t i = 0; i < chunkRequests.size(); ++i) {
+            auto chunk = cache.get(chunkRequests[i]);
+            if(chunk) {
+                hits.emplace_back(i, std::move(chunk));
+            } else {
+                misses.push_back(chunkRequests[i]);
             }
-            util::parallel_foreach(tp, nUnits, [&](const int tId, const std::size_t i){
-                body(states[tId], i);
-            });
         }
+
+        const auto & chunking = ds.chunking();
+        util::parallel_foreach_shared(numberOfThreads, hits.size(), [&](const int, const std::size_t h){
+            types::ShapeType offsetInRequest, requestShape, offsetInChunk;
+            chunking.getCoordinatesInRoi(chunkRequests[hits[h].first], offset, shape,
+                                         offsetInRequest, requestShape, offsetInChunk);
+            const auto & chunk = *hits[h].second;
+            const ConstArrayView<T> chunkView(reinterpret_cast<const T *>(chunk.data.data()),
+                                              chunk.shape, cOrderStrides(chunk.shape));
+            copyView(subview(chunkView, offsetInChunk, requestShape),
+                     subview(out, offsetInRequest, requestShape));
+        });
+        return misses;
     }
 
+    // chunks of uncompressed datasets are memory mapped from this size on; for smaller
+    // chunks, setting up and tearing down the mapping costs more than the copy it saves
+    inline constexpr std::size_t mappedReadMinChunkBytes = std::size_t(64) << 10;
 
+
+    // Read path for non-sharded datasets, staged (util::runBatchedReadPipeline): the I/O
+    // stage fetches the raw bytes of a batch of chunks (a missing chunk yields an empty
+    // buffer; stores with batched reads, e.g. the filesystem with io_uring, fetch the
+    // whole batch with one request), the decode stage decompresses and copies each chunk
+    // into the output view. Uncompressed chunks are copied into the output straight from
+    // the stored bytes; on stores that support it, large uncompressed chunks are memory
+    // mapped instead of read, so their data is copied only once.
     template<typename T>
     inline void readSubarrayPlain(const Dataset & ds,
                                   const ArrayView<T> & out,
@@ -85,14 +127,17 @@ namespace multiarray {
         const auto & maxChunkShape = ds.defaultChunkShape();
         const auto & chunking = ds.chunking();
         const bool isZarr = ds.isZarr();
+        const bool rawPayload = rawPayloadIsData<T>(ds);
+        // the generation is taken before any chunk is read (see util::DecodedChunkCache)
+        const bool cacheChunks = ds.chunkCache().enabled();
+        const std::uint64_t cacheGeneration = ds.chunkCache().generation();
 
         T fillValue;
         ds.getFillValue(&fillValue);
 
-        // read buffer is always overwritten by decompress (or unused on the fill path), so
-        // value-initialising to T() matches the previous default-constructed buffer.
-        forEachBuffered<T>(numberOfThreads, chunkRequests.size(), maxChunkSize, T(),
-                           [&](std::vector<T> & buffer, const std::size_t chunkIndex){
+        // decode the stored bytes of a chunk (none: the chunk does not exist) and copy
+        // them into the output
+        auto decodeChunkBytes = [&](const std::size_t chunkIndex, const char * bytes, const std::size_t nBytes){
             const auto & chunkId = chunkRequests[chunkIndex];
             types::ShapeType offsetInRequest, requestShape, chunkShape, offsetInChunk;
 
@@ -102,8 +147,8 @@ namespace multiarray {
             // get the view into our array
             const auto outView = subview(out, offsetInRequest, requestShape);
 
-            // check if this chunk exists, if not fill output with fill value
-            if(!ds.chunkExists(chunkId)) {
+            // the chunk does not exist -> fill output with fill value
+            if(nBytes == 0) {
                 fillView(outView, fillValue);
                 return;
             }
@@ -113,15 +158,11 @@ namespace multiarray {
             std::size_t chunkSize = std::accumulate(chunkShape.begin(), chunkShape.end(),
                                                     std::size_t(1), std::multiplies<std::size_t>());
 
-            // read the data from storage
-            std::vector<char> dataBuffer;
-            ds.readRawChunk(chunkId, dataBuffer);
-
             // get the shape of the chunk (as it is stored)
             std::size_t chunkStoreSize = maxChunkSize;
             std::size_t headerLength = 0;
             if(!isZarr) {
-                if(util::read_n5_header(dataBuffer, chunkStoreSize, headerLength)) {
+                if(util::read_n5_header(bytes, nBytes, chunkStoreSize, headerLength)) {
                     throw std::runtime_error("Can't read from varlen chunks to multiarray");
                 }
             }
@@ -133,14 +174,26 @@ namespace multiarray {
                 chunkShape = maxChunkShape;
             }
 
-            // resize the buffer if necessary
-            if(chunkSize != buffer.size()) {
-                buffer.resize(chunkSize);
+            const char * payload = bytes + headerLength;
+            const std::size_t payloadBytes = nBytes - headerLength;
+
+            // uncompressed: copy the requested sub-block straight from the stored bytes
+            if(rawPayload && isRawPayload<T>(payload, payloadBytes, chunkSize)) {
+                const ConstArrayView<T> chunkView(reinterpret_cast<const T *>(payload), chunkShape,
+                                                  cOrderStrides(chunkShape));
+                copyView(subview(chunkView, offsetInChunk, requestShape), outView);
+                if(cacheChunks) {
+                    cacheDecodedChunk(ds, chunkId, chunkView.data, chunkShape, chunkSize, cacheGeneration);
+                }
+                return;
             }
 
+            // per-thread decode buffer; it is always overwritten by decompress
+            util::ThreadLocalScratch<std::vector<T>> scratch([]{ return std::vector<T>(); });
+            auto & buffer = chunkScratchBuffer(scratch, chunkSize);
+
             // decompress the data, decoding straight past the n5 header (no memmove)
-            ds.decompress(dataBuffer.data() + headerLength, dataBuffer.size() - headerLength,
-                          &buffer[0], chunkSize);
+            ds.decompress(payload, payloadBytes, &buffer[0], chunkSize);
 
             // reverse the endianness for N5 data (unless datatype is byte)
             if(!isZarr && sizeof(T) > 1) {
@@ -150,7 +203,51 @@ namespace multiarray {
             // copy the requested sub-block of the chunk buffer into the output view
             const ConstArrayView<T> chunkView(buffer.data(), chunkShape, cOrderStrides(chunkShape));
             copyView(subview(chunkView, offsetInChunk, requestShape), outView);
-        });
+            if(cacheChunks) {
+                cacheDecodedChunk(ds, chunkId, buffer.data(), chunkShape, chunkSize, cacheGeneration);
+            }
+        };
+
+        // large uncompressed chunks: map them in the I/O stage (prefaulting the pages)
+        if(rawPayload && maxChunkSize * sizeof(T) >= mappedReadMinChunkBytes && ds.supportsMappedReads()) {
+            util::runReadPipeline<util::MappedFile>(chunkRequests.size(), numberOfThreads,
+                [&](const std::size_t chunkIndex, util::MappedFile & mapped){
+                    // a missing chunk leaves the mapping empty
+                    if(!ds.mapRawChunk(chunkRequests[chunkIndex], mapped)) {
+                        mapped.unmap();
+                    }
+                },
+                [&](util::MappedFile & mapped, const std::size_t chunkIndex){
+                    decodeChunkBytes(chunkIndex, mapped.data(), mapped.size());
+                    mapped.unmap();
+                });
+            return;
+        }
+
+        // I/O stage: read the data of a batch of chunks from storage
+        auto readChunkData = [&](const std::size_t first, const std::size_t n,
+                                 std::vector<char> * const * dataBuffers){
+            if(n == 1) {
+                ds.readRawChunk(chunkRequests[first], *dataBuffers[0]);
+                return;
+            }
+            const std::vector<types::ShapeType> chunkIds(chunkRequests.begin() + first,
+                                                         chunkRequests.begin() + first + n);
+            ds.readRawChunks(chunkIds, std::vector<std::vector<char> *>(dataBuffers, dataBuffers + n));
+        };
+
+        // decode stage: decompress and copy into the output
+        auto decodeChunk = [&](std::vector<char> & dataBuffer, const std::size_t chunkIndex){
+            decodeChunkBytes(chunkIndex, dataBuffer.data(), dataBuffer.size());
+        };
+
+        // batch as many chunks as the store benefits from, but keep the raw bytes of a
+        // batch (bounded by the uncompressed chunk size) within 16 MiB
+        const std::size_t maxBatchBytes = std::size_t(16) << 20;
+        const std::size_t batchSize = std::clamp(maxBatchBytes / (maxChunkSize * sizeof(T)),
+                                                 std::size_t(1), ds.readBatchSize());
+        util::runBatchedReadPipeline<std::vector<char>>(chunkRequests.size(), numberOfThreads, batchSize,
+                                                        readChunkData, decodeChunk);
     }
 
 
@@ -172,6 +269,14 @@ namespace multiarray {
         const auto & chunking = ds.chunking();
         chunking.getBlocksOverlappingRoi(offset, shape, chunkRequests);
 
+        // chunks in the decoded-chunk cache are copied without reading or decoding them
+        if(ds.chunkCache().enabled()) {
+            chunkRequests = readCachedChunks<T>(ds, out, offset, shape, chunkRequests, numberOfThreads);
+            if(chunkRequests.empty()) {
+                return;
+            }
+        }
+
         // sharded datasets use a shard-aware path (one read per shard, parallel across shards)
         if(ds.isSharded()) {
             readSubarraySharded<T>(ds, out, offset, shape, chunkRequests, numberOfThreads);
@@ -250,6 +355,8 @@ namespace multiarray {
     // chunk-by-chunk write driver for non-sharded datasets; the request data is
     // written into each chunk buffer by `fillRequest` (see prepareChunkWriteBuffer).
     // Shared by writeSubarray (copy from input view) and writeScalar (fill value).
+    // Staged (util::runWritePipeline): the encode stage fills and compresses a chunk,
+    // the store stage writes the compressed blob (or removes an all-fill chunk).
     template<typename T, typename FILL_REQUEST>
     inline void writePlainGeneric(const Dataset & ds,
                                   const types::ShapeType & offset,
@@ -265,9 +372,10 @@ namespace multiarray {
         T fillValue;
         ds.getFillValue(&fillValue);
 
-        forEachBuffered<T>(numberOfThreads, chunkRequests.size(), maxChunkSize, fillValue,
-                           [&](std::vector<T> & buffer, const std::size_t chunkIndex){
+        auto encodeChunk = [&](const std::size_t chunkIndex, std::vector<char> & blob){
             const auto & chunkId = chunkRequests[chunkIndex];
+            util::ThreadLocalScratch<std::vector<T>> scratch([]{ return std::vector<T>(); });
+            auto & buffer = chunkScratchBuffer(scratch, maxChunkSize);
             types::ShapeType chunkShape;
             // partial-overlap reads come from the chunk file (preserving the varlen guard)
             prepareChunkWriteBuffer<T>(ds, chunking, offset, shape, chunkId, isZarr,
@@ -283,8 +391,18 @@ namespace multiarray {
                                            }
                                            return true;
                                        });
-            ds.writeChunk(chunkId, &buffer[0]);
-        });
+            // an all-fill chunk leaves the blob empty -> removed by the store stage
+            if(!ds.makeChunkBlob(chunkId, &buffer[0], blob)) {
+                blob.clear();
+            }
+        };
+
+        util::runWritePipeline<std::vector<char>>(chunkRequests.size(), numberOfThreads,
+            encodeChunk,
+            [&](const std::vector<char> & blob, const std::size_t chunkIndex){
+                ds.writeRawChunk(chunkRequests[chunkIndex], blob);
+            },
+            [](const std::vector<char> & blob){ return blob.size(); });
     }
 
 
@@ -321,6 +439,28 @@ namespace multiarray {
         }
     }
 
+    // Number of threads that encode / decode the inner chunks of one shard. With at least
+    // as many shards as codec threads each shard is handled by one thread; with fewer (in
+    // the extreme a single shard of thousands of inner chunks) the codec threads are split
+    // across the shards and each shard's chunks are processed in parallel, while the shard
+    // itself is still read and written once.
+    inline std::size_t innerChunkThreads(const std::size_t nShards, const int numberOfThreads) {
+        const std::size_t nCodec = util::codecConcurrency(numberOfThreads);
+        if(nShards == 0 || nShards >= nCodec) {
+            return 1;
+        }
+        return (nCodec + nShards - 1) / nShards;
+    }
+
+    // compressed bytes held by a shard's slot blobs (what the write queue is bounded by)
+    inline std::size_t shardBlobBytes(const std::vector<std::vector<char>> & blobs) {
+        std::size_t nBytes = 0;
+        for(const auto & blob : blobs) {
+            nBytes += blob.size();
+        }
+        return nBytes;
+    }
+
     // shard-grouped write driver: one read-modify-write per shard, parallel across
     // shards; the request data is written into each inner-chunk buffer by `fillRequest`.
     // Shared by writeSubarray (copy from input view) and writeScalar (fill value).
@@ -355,52 +495,91 @@ namespace multiarray {
             groups.push_back(&kv);
         }
 
-        // per-thread scratch, reused across the thread's shards (see forEachWithState)
+        // per-thread scratch of the encode stage (see chunkScratchBuffer)
         struct Scratch {
             std::vector<T> buffer;                 // chunk write buffer
-            std::vector<std::vector<char>> blobs;  // per-slot compressed blobs
             std::vector<char> blob;                // compressed blob of the current chunk
         };
 
-        // process a single shard: read it once, update the touched slots, write it once
-        auto processShard = [&](Scratch & scratch,
-                                const types::ShapeType & shardCoord,
-                                const std::vector<types::ShapeType> & innerChunks) {
-            auto & blobs = scratch.blobs;
-            ds.readShardBlobs(shardCoord, blobs);  // preserves untouched slots; cheap if absent
+        // shards that support in-place updates only read and write the touched slots;
+        // their blobs are then indexed like the shard's chunk list instead of by slot
+        const bool inPlace = ds.appendsShardUpdates();
+        auto touchedSlots = [&](const std::size_t i) {
+            std::vector<std::size_t> slots;
+            slots.reserve(groups[i]->second.size());
+            for(const auto & chunkId : groups[i]->second) {
+                slots.push_back(util::shardSlot(chunkId, cps));
+            }
+            return slots;
+        };
 
-            types::ShapeType chunkShape;
-            for(const auto & chunkId : innerChunks) {
-                const std::size_t slot = util::shardSlot(chunkId, cps);
+        // inner chunks of a shard are compressed in parallel if there are fewer shards
+        // than codec threads; each chunk writes its own blob, so they need no lock
+        const std::size_t nInner = innerChunkThreads(groups.size(), numberOfThreads);
+
+        // encode stage: read the shard once and update the touched slots of its blobs
+        auto encodeShard = [&](const std::size_t i, std::vector<std::vector<char>> & blobs) {
+            const auto & shardCoord = groups[i]->first;
+            const auto & chunkIds = groups[i]->second;
+            // in place: the stored blobs of the touched slots, read (once) when a chunk
+            // is only partially overwritten
+            std::vector<std::vector<char>> storedBlobs;
+            std::once_flag readStored;
+            if(inPlace) {
+                blobs.resize(chunkIds.size());
+            } else {
+                ds.readShardBlobs(shardCoord, blobs);  // preserves untouched slots; cheap if absent
+            }
+
+            util::parallel_foreach_shared(nInner, chunkIds.size(), [&](const int, const std::size_t k){
+                util::ThreadLocalScratch<Scratch> threadScratch([]{ return Scratch(); });
+                auto & scratch = threadScratch.get();
+                if(scratch.buffer.size() != maxChunkSize) {
+                    scratch.buffer.resize(maxChunkSize);
+                }
+                types::ShapeType chunkShape;
+                const auto & chunkId = chunkIds[k];
+                const std::size_t blobIndex = inPlace ? k : util::shardSlot(chunkId, cps);
                 prepareChunkWriteBuffer<T>(
                     ds, chunking, offset, shape, chunkId, isZarr, maxChunkSize,
                     fillValue, scratch.buffer, chunkShape, fillRequest,
                     [&](std::vector<T> & buf) -> bool {
                         // partial overlap: serve the existing chunk from the in-memory shard
-                        if(blobs[slot].empty()) {
+                        if(inPlace) {
+                            std::call_once(readStored, [&]{
+                                ds.readShardSlots(shardCoord, touchedSlots(i), storedBlobs);
+                            });
+                        }
+                        const auto & stored = inPlace ? storedBlobs[k] : blobs[blobIndex];
+                        if(stored.empty()) {
                             return false;
                         }
-                        ds.decompress(blobs[slot], &buf[0], buf.size());
+                        ds.decompress(stored, &buf[0], buf.size());
                         return true;
                     });
                 const bool nonEmpty = ds.makeChunkBlob(chunkId, &scratch.buffer[0], scratch.blob);
                 // swap instead of copy; every compressor overwrites its output, so
                 // reusing `blob` (now holding the slot's old bytes) is safe
                 if(nonEmpty) {
-                    blobs[slot].swap(scratch.blob);
+                    blobs[blobIndex].swap(scratch.blob);
                 } else {
-                    blobs[slot].clear();
+                    blobs[blobIndex].clear();
                 }
-            }
-            ds.writeShardBlobs(shardCoord, blobs);
+            });
         };
 
-        // one task per shard (so each shard file has a single writer -> no lock needed)
-        forEachWithState(numberOfThreads, groups.size(),
-                         [&]{ return Scratch{std::vector<T>(maxChunkSize, fillValue), {}, {}}; },
-                         [&](Scratch & scratch, const std::size_t i){
-            processShard(scratch, groups[i]->first, groups[i]->second);
-        });
+        // store stage: write each shard once (one task per shard, so each shard file
+        // has a single writer -> no lock needed)
+        util::runWritePipeline<std::vector<std::vector<char>>>(groups.size(), numberOfThreads,
+            encodeShard,
+            [&](const std::vector<std::vector<char>> & blobs, const std::size_t i){
+                if(inPlace) {
+                    ds.updateShardSlots(groups[i]->first, touchedSlots(i), blobs);
+                } else {
+                    ds.writeShardBlobs(groups[i]->first, blobs);
+                }
+            },
+            shardBlobBytes);
     }
 
 
@@ -445,51 +624,96 @@ namespace multiarray {
         // constant across chunks, so compute them once.
         const auto chunkStrides = cOrderStrides(maxChunkShape);
 
-        // per-thread scratch, reused across the thread's shards (see forEachWithState)
-        struct Scratch {
-            std::vector<T> buffer;               // chunk decode buffer
+        // uncompressed shards are memory mapped where the store supports it, and their
+        // slots are copied into the output straight from the shard bytes
+        const bool rawPayload = rawPayloadIsData<T>(ds);
+        const bool mapShards = rawPayload && ds.supportsMappedReads();
+
+        // the generation is taken before any shard is read (see util::DecodedChunkCache)
+        const bool cacheChunks = ds.chunkCache().enabled();
+        const std::uint64_t cacheGeneration = ds.chunkCache().generation();
+
+        // a shard as read by the I/O stage (recycled across shards and calls)
+        struct RawShard {
+            bool exists = false;
             std::vector<char> shardBuf;          // raw shard bytes
-            std::vector<std::size_t> offsets;    // per-slot offsets within shardBuf
+            util::MappedFile mapped;             // ... or the mapped shard
+            std::vector<std::size_t> offsets;    // per-slot offsets within the shard
             std::vector<std::size_t> nbytes;     // per-slot byte counts
+            inline const char * bytes() const {
+                return mapped.data() ? mapped.data() : shardBuf.data();
+            }
+            // memory kept by a recycled item (see util::pipeline_detail::retainedBytes)
+            inline std::size_t retainedBytes() const {
+                return shardBuf.capacity() + util::pipeline_detail::retainedBytes(mapped) +
+                    (offsets.capacity() + nbytes.capacity()) * sizeof(std::size_t);
+            }
         };
 
-        // process a single shard: read it once, decode the requested inner chunks in place
-        auto processShard = [&](Scratch & scratch,
-                                const types::ShapeType & shardCoord,
-                                const std::vector<types::ShapeType> & innerChunks) {
-            auto & buffer = scratch.buffer;
-            const bool exists = ds.readShardRaw(shardCoord, scratch.shardBuf,
-                                                scratch.offsets, scratch.nbytes);
+        // I/O stage: read (or map) each shard once; only the touched slots are fetched
+        auto readShard = [&](const std::size_t i, RawShard & raw) {
+            std::vector<std::size_t> slots;
+            slots.reserve(groups[i]->second.size());
+            for(const auto & chunkId : groups[i]->second) {
+                slots.push_back(util::shardSlot(chunkId, cps));
+            }
+            if(mapShards) {
+                raw.exists = ds.mapShardRaw(groups[i]->first, slots, raw.mapped, raw.offsets, raw.nbytes);
+            } else {
+                raw.exists = ds.readShardRaw(groups[i]->first, slots, raw.shardBuf, raw.offsets, raw.nbytes);
+            }
+        };
 
-            types::ShapeType offsetInRequest, requestShape, offsetInChunk;
-            for(const auto & chunkId : innerChunks) {
+        // the inner chunks of a shard are decoded in parallel if there are fewer shards
+        // than codec threads (they write disjoint parts of the output)
+        const std::size_t nInner = innerChunkThreads(groups.size(), numberOfThreads);
+
+        // decode stage: decode the requested inner chunks in place
+        auto decodeShard = [&](RawShard & raw, const std::size_t i) {
+            const auto & chunkIds = groups[i]->second;
+            util::parallel_foreach_shared(nInner, chunkIds.size(), [&](const int, const std::size_t k){
+                // per-thread decode buffer; it is always overwritten by decompress
+                util::ThreadLocalScratch<std::vector<T>> scratch([]{ return std::vector<T>(); });
+                auto & buffer = chunkScratchBuffer(scratch, maxChunkSize);
+
+                types::ShapeType offsetInRequest, requestShape, offsetInChunk;
+                const auto & chunkId = chunkIds[k];
                 const std::size_t slot = util::shardSlot(chunkId, cps);
                 chunking.getCoordinatesInRoi(chunkId, offset, shape,
                                              offsetInRequest, requestShape, offsetInChunk);
                 const auto outView = subview(out, offsetInRequest, requestShape);
 
                 // empty / never-written slot -> fill value
-                if(!exists || scratch.nbytes[slot] == 0) {
+                if(!raw.exists || raw.nbytes[slot] == 0) {
                     fillView(outView, fillValue);
-                    continue;
+                    return;
                 }
 
-                // decode the inner chunk straight from the shard buffer (no per-slot copy)
-                if(buffer.size() != maxChunkSize) {
-                    buffer.resize(maxChunkSize);
+                const char * slotBytes = raw.bytes() + raw.offsets[slot];
+                // uncompressed: copy straight from the shard bytes
+                if(rawPayload && isRawPayload<T>(slotBytes, raw.nbytes[slot], maxChunkSize)) {
+                    const ConstArrayView<T> chunkView(reinterpret_cast<const T *>(slotBytes),
+                                                      maxChunkShape, chunkStrides);
+                    copyView(subview(chunkView, offsetInChunk, requestShape), outView);
+                    if(cacheChunks) {
+                        cacheDecodedChunk(ds, chunkId, chunkView.data, maxChunkShape, maxChunkSize, cacheGeneration);
+                    }
+                    return;
                 }
-                ds.decompress(scratch.shardBuf.data() + scratch.offsets[slot],
-                              scratch.nbytes[slot], &buffer[0], maxChunkSize);
+
+                // decode the inner chunk straight from the shard buffer (no per-slot copy)
+                ds.decompress(slotBytes, raw.nbytes[slot], &buffer[0], maxChunkSize);
                 const ConstArrayView<T> chunkView(buffer.data(), maxChunkShape, chunkStrides);
                 copyView(subview(chunkView, offsetInChunk, requestShape), outView);
-            }
+                if(cacheChunks) {
+                    cacheDecodedChunk(ds, chunkId, buffer.data(), maxChunkShape, maxChunkSize, cacheGeneration);
+                }
+            });
+            raw.mapped.unmap();
         };
 
-        forEachWithState(numberOfThreads, groups.size(),
-                         [&]{ return Scratch{std::vector<T>(maxChunkSize, T()), {}, {}, {}}; },
-                         [&](Scratch & scratch, const std::size_t i){
-            processShard(scratch, groups[i]->first, groups[i]->second);
-        });
+        // staged: shard reads overlap with decoding (see util::runReadPipeline)
+        util::runReadPipeline<RawShard>(groups.size(), numberOfThreads, readShard, decodeShard);
     }
 
 
@@ -521,6 +745,111 @@ namespace multiarray {
     }
 
 
+    // Asynchronous readSubarray: validates the request, then runs it on the shared thread
+    // pool (see util::submitAsync) and returns a handle to wait for, cancel or get the
+    // error of the request. `ds` and the memory viewed by `out` must stay valid until the
+    // request has finished.
+    template<typename T, typename ITER>
+    inline util::AsyncRequest readSubarrayAsync(const Dataset & ds,
+                                                const ArrayView<T> & out,
+                                                ITER roiBeginIter,
+                                                const int numberOfThreads=1) {
+        const types::ShapeType offset(roiBeginIter, roiBeginIter + out.ndim());
+        const types::ShapeType shape(out.shape.begin(), out.shape.end());
+        ds.checkRequestShape(offset, shape);
+        ds.checkRequestType(typeid(T));
+        return util::submitAsync([&ds, out, offset, numberOfThreads]{
+            readSubarray<T>(ds, out, offset.begin(), numberOfThreads);
+        });
+    }
+
+
+    // Asynchronous writeSubarray; `ds` and the memory viewed by `in` must stay valid until
+    // the request has finished. A cancelled write may have written some of its chunks.
+    template<typename T, typename ITER>
+    inline util::AsyncRequest writeSubarrayAsync(const Dataset & ds,
+                                                 const ConstArrayView<T> & in,
+                                                 ITER roiBeginIter,
+                                                 const int numberOfThreads=1) {
+        const types::ShapeType offset(roiBeginIter, roiBeginIter + in.ndim());
+        const types::ShapeType shape(in.shape.begin(), in.shape.end());
+        ds.checkRequestShape(offset, shape);
+        ds.checkRequestType(typeid(T));
+        return util::submitAsync([&ds, in, offset, numberOfThreads]{
+            writeSubarray<T>(ds, in, offset.begin(), numberOfThreads);
+        });
+    }
+
+
+    // Write a batch of full chunks, `data[i]` holding the chunk `chunkIds[i]` (as passed to
+    // Dataset::writeChunk; the ids must be unique). Staged like writeSubarray: the chunks
+    // are compressed in parallel while the writers store the finished blobs. For sharded
+    // datasets the chunks are grouped by shard, so each shard is read and written once.
+    template<typename T>
+    inline void writeChunks(const Dataset & ds,
+                            const std::vector<types::ShapeType> & chunkIds,
+                            const std::vector<const T *> & data,
+                            const int numberOfThreads=1) {
+        if(chunkIds.size() != data.size()) {
+            throw std::runtime_error("Number of chunk ids and data pointers do not match");
+        }
+        ds.checkRequestType(typeid(T));
+        if(!ds.mode().canWrite()) {
+            throw std::invalid_argument("Cannot write data in file mode " + ds.mode().printMode());
+        }
+        const auto & chunking = ds.chunking();
+        for(const auto & chunkId : chunkIds) {
+            if(!chunking.checkBlockCoordinate(chunkId)) {
+                throw std::runtime_error("Invalid chunk");
+            }
+        }
+
+        if(!ds.isSharded()) {
+            util::runWritePipeline<std::vector<char>>(chunkIds.size(), numberOfThreads,
+                [&](const std::size_t i, std::vector<char> & blob){
+                    if(!ds.makeChunkBlob(chunkIds[i], data[i], blob)) {
+                        blob.clear();
+                    }
+                },
+                [&](const std::vector<char> & blob, const std::size_t i){
+                    ds.writeRawChunk(chunkIds[i], blob);
+                },
+                [](const std::vector<char> & blob){ return blob.size(); });
+            return;
+        }
+
+        // group the chunks (by their index in the batch) by shard
+        const auto cps = util::chunksPerShard(ds.shardShape(), ds.defaultChunkShape());
+        std::map<types::ShapeType, std::vector<std::size_t>> shardGroups;
+        for(std::size_t i = 0; i < chunkIds.size(); ++i) {
+            shardGroups[util::shardId(chunkIds[i], cps)].push_back(i);
+        }
+        std::vector<const std::pair<const types::ShapeType, std::vector<std::size_t>> *> groups;
+        groups.reserve(shardGroups.size());
+        for(const auto & kv : shardGroups) {
+            groups.push_back(&kv);
+        }
+
+        const std::size_t nInner = innerChunkThreads(groups.size(), numberOfThreads);
+        util::runWritePipeline<std::vector<std::vector<char>>>(groups.size(), numberOfThreads,
+            [&](const std::size_t g, std::vector<std::vector<char>> & blobs){
+                ds.readShardBlobs(groups[g]->first, blobs);  // preserves untouched slots
+                const auto & group = groups[g]->second;
+                util::parallel_foreach_shared(nInner, group.size(), [&](const int, const std::size_t k){
+                    const std::size_t i = group[k];
+                    auto & blob = blobs[util::shardSlot(chunkIds[i], cps)];
+                    if(!ds.makeChunkBlob(chunkIds[i], data[i], blob)) {
+                        blob.clear();
+                    }
+                });
+            },
+            [&](const std::vector<std::vector<char>> & blobs, const std::size_t g){
+                ds.writeShardBlobs(groups[g]->first, blobs);
+            },
+            shardBlobBytes);
+    }
+
+
     // unique ptr API
     template<typename T, typename ITER>
     inline void readSubarray(std::unique_ptr<Dataset> & ds,
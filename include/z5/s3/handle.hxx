@@ -1,9 +1,14 @@
 #pragma once
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <exception>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <random>
 #include <tuple>
 // aws includes
 #include <aws/core/Aws.h>
@@ -13,7 +18,11 @@
 #include <aws/core/auth/AWSCredentialsProviderChain.h>
 #include <aws/core/utils/memory/AWSMemory.h>
 #include <aws/core/utils/memory/stl/AWSStringStream.h>
+#include <aws/core/utils/stream/PreallocatedStreamBuf.h>
 #include <aws/core/client/AWSError.h>
+#include <aws/core/client/CoreErrors.h>
+#include <aws/core/client/RetryStrategy.h>
+#include <aws/core/http/HttpRequest.h>
 #include <aws/core/http/HttpResponse.h>
 #include <aws/s3/S3Client.h>
 #include <aws/s3/S3ClientConfiguration.h>
@@ -28,8 +37,17 @@
 #include <aws/s3/model/HeadObjectRequest.h>
 #include <aws/s3/model/DeleteObjectRequest.h>
 #include <aws/s3/model/DeleteObjectsRequest.h>
+#include <aws/s3/model/CreateMultipartUploadRequest.h>
+#include <aws/s3/model/UploadPartRequest.h>
+#include <aws/s3/model/CompletedPart.h>
+#include <aws/s3/model/CompletedMultipartUpload.h>
+#include <aws/s3/model/CompleteMultipartUploadRequest.h>
+#include <aws/s3/model/AbortMultipartUploadRequest.h>
 
 #include "z5/handle.hxx"
+#include "z5/util/disk_cache.hxx"
+#include "z5/util/threadpool.hxx"
+#include "z5/util/write_behind.hxx"
 
 
 namespace z5 {
@@ -69,6 +87,76 @@ namespace detail {
         return base.empty() ? name : base + "/" + name;
     }
 
+    // counters of s3::requestMetrics
+    struct RequestCounters {
+        std::atomic<std::size_t> retries{0};
+        std::atomic<std::size_t> throttleRetries{0};
+        std::atomic<std::size_t> hedges{0};
+        std::atomic<std::size_t> hedgeWins{0};
+    };
+
+    inline RequestCounters & requestCounters() {
+        static RequestCounters counters;
+        return counters;
+    }
+
+    // see s3::setRetries
+    struct RetryConfig {
+        std::atomic<long> maxRetries{10};
+        std::atomic<long> baseDelayMs{50};
+        std::atomic<long> maxDelayMs{20000};
+    };
+
+    inline RetryConfig & retryConfig() {
+        static RetryConfig config;
+        return config;
+    }
+
+    // while a hedged GET attempt runs on this thread: the flag that is set once another
+    // attempt of the GET has won (see sendGet); an abandoned attempt is not retried
+    inline const std::atomic<bool> *& abandonedFlag() {
+        thread_local const std::atomic<bool> * flag = nullptr;
+        return flag;
+    }
+
+    // 503 SlowDown and the other ways S3 (or a compatible store) asks to slow down
+    inline bool isThrottling(const Aws::Client::AWSError<Aws::Client::CoreErrors> & error) {
+        return error.GetErrorType() == Aws::Client::CoreErrors::SLOW_DOWN ||
+               error.GetErrorType() == Aws::Client::CoreErrors::THROTTLING ||
+               error.GetResponseCode() == Aws::Http::HttpResponseCode::SERVICE_UNAVAILABLE ||
+               error.GetResponseCode() == Aws::Http::HttpResponseCode::TOO_MANY_REQUESTS;
+    }
+
+    // Retries the errors the SDK classifies as transient (throttling, 5xx, dropped
+    // connections) with exponential backoff and full jitter: the n-th retry waits a
+    // uniformly random time up to min(maxDelay, baseDelay * 2^n), which spreads the
+    // retries of many concurrent requests instead of hitting a throttled prefix in waves.
+    class BackoffRetryStrategy : public Aws::Client::RetryStrategy {
+    public:
+        bool ShouldRetry(const Aws::Client::AWSError<Aws::Client::CoreErrors> & error,
+                         const long attemptedRetries) const override {
+            const auto abandoned = abandonedFlag();
+            if((abandoned && *abandoned) || !error.ShouldRetry() ||
+               attemptedRetries >= retryConfig().maxRetries) {
+                return false;
+            }
+            ++requestCounters().retries;
+            if(isThrottling(error)) {
+                ++requestCounters().throttleRetries;
+            }
+            return true;
+        }
+
+        long CalculateDelayBeforeNextRetry(const Aws::Client::AWSError<Aws::Client::CoreErrors> &,
+                                           const long attemptedRetries) const override {
+            const auto & config = retryConfig();
+            const long maxDelay = config.maxDelayMs;
+            const long delay = std::min(maxDelay, config.baseDelayMs.load() << std::min(attemptedRetries, 20L));
+            thread_local std::minstd_rand generator(std::random_device{}());
+            return std::uniform_int_distribution<long>(0, std::max(delay, 0L))(generator);
+        }
+    };
+
     // build an S3 client configured for the given endpoint / region / credentials.
     // A custom endpoint (MinIO / moto / ...) forces path-style addressing, since
     // virtual-host addressing ("bucket.host") does not resolve against such servers.
@@ -88,6 +176,7 @@ namespace detail {
         // finite timeouts so a misconfigured endpoint fails fast instead of hanging
         config.connectTimeoutMs = 5000;
         config.requestTimeoutMs = 60000;
+        config.retryStrategy = Aws::MakeShared<BackoffRetryStrategy>(ALLOC_TAG);
         if(!region.empty()) {
             config.region = Aws::String(region.c_str(), region.size());
         }
@@ -155,6 +244,49 @@ namespace detail {
                                handle.accessKey(), handle.secretKey());
     }
 
+    //
+    // concurrent requests (see s3::setRequestConcurrency)
+    //
+
+    struct RequestConfig {
+        std::mutex mutex;
+        std::atomic<std::size_t> concurrency{64};
+    };
+
+    inline RequestConfig & requestConfig() {
+        static RequestConfig config;
+        return config;
+    }
+
+    // the threads that issue the requests of batched reads; separate from the shared
+    // pool, so threads waiting for S3 do not take the place of the ones that decode
+    inline util::ThreadPool & requestPool() {
+        // joined at exit before the API is shut down (see writeBehindConfig)
+        ensureApiInitialized();
+        static util::ThreadPool pool(util::ParallelOptions::NoThreads);
+        return pool;
+    }
+
+    // call `request(i)` for all i in [0, n) with up to requestConcurrency requests in
+    // flight per call; the calling thread issues requests too. Rethrows the first error
+    // once the running requests have finished.
+    template<class F>
+    inline void runRequests(const std::size_t n, F && request) {
+        auto & config = requestConfig();
+        const std::size_t nRunners = std::min(n, config.concurrency.load());
+        auto & pool = requestPool();
+        if(nRunners > pool.nThreads() + 1) {
+            std::lock_guard<std::mutex> lock(config.mutex);
+            if(nRunners > pool.nThreads() + 1) {
+                pool.resize(nRunners - 1);
+            }
+        }
+        util::parallel_foreach_stealing(pool, nRunners, n, [&request](const int, const std::size_t i){
+            request(i);
+        }, 1);
+    }
+
+
     //
     // low-level object IO helpers (used by handle / dataset / metadata / attributes)
     //
@@ -173,40 +305,442 @@ namespace detail {
                                   std::string(error.GetMessage().c_str()) + ")");
     }
 
-    // read an object's bytes; returns false if the object does not exist,
-    // throws on any other error
-    inline bool getObject(Aws::S3::S3Client & client,
-                          const std::string & bucket, const std::string & key,
-                          std::vector<char> & out) {
+    // Destinations of the body of a GET response: the SDK writes the bytes it receives
+    // straight into them (see sendGet) instead of into a string stream that is copied
+    // afterwards. reset() discards what was written, as the SDK creates a new response
+    // stream for every attempt of a request.
+
+    // appends to a vector (its capacity is kept, so recycled buffers do not reallocate)
+    class VectorStreamBuf : public std::streambuf {
+    public:
+        explicit VectorStreamBuf(std::vector<char> & out) : out_(out) {}
+        inline void reset() {out_.clear();}
+        inline std::size_t size() const {return out_.size();}
+
+    protected:
+        std::streamsize xsputn(const char * data, const std::streamsize n) override {
+            out_.insert(out_.end(), data, data + n);
+            return n;
+        }
+
+        int_type overflow(const int_type c) override {
+            if(!traits_type::eq_int_type(c, traits_type::eof())) {
+                out_.push_back(traits_type::to_char_type(c));
+            }
+            return traits_type::not_eof(c);
+        }
+
+    private:
+        std::vector<char> & out_;
+    };
+
+    // fills a fixed span of memory, e.g. the slots of a shard buffer; writes beyond it fail
+    class SpanStreamBuf : public std::streambuf {
+    public:
+        SpanStreamBuf(char * data, const std::size_t size) : data_(data), size_(size) {
+            reset();
+        }
+        inline void reset() {setp(data_, data_ + size_);}
+        inline std::size_t size() const {return static_cast<std::size_t>(pptr() - pbase());}
+
+    private:
+        char * data_;
+        std::size_t size_;
+    };
+
+    // the local disk cache of GET responses (see s3::setDiskCache); null if disabled
+    struct DiskCacheConfig {
+        std::mutex mutex;
+        std::shared_ptr<util::DiskCache> cache;
+        std::atomic<int64_t> maxAge{0};
+    };
+
+    inline DiskCacheConfig & diskCacheConfig() {
+        static DiskCacheConfig config;
+        return config;
+    }
+
+    inline std::shared_ptr<util::DiskCache> diskCache() {
+        auto & config = diskCacheConfig();
+        std::lock_guard<std::mutex> lock(config.mutex);
+        return config.cache;
+    }
+
+    // the name of an object in the disk cache and the write-behind staging
+    inline std::string objectName(const std::string & bucket, const std::string & key) {
+        return bucket + "/" + key;
+    }
+
+    // outcome of a GET request
+    enum class GetStatus {ok, notFound, notModified, unsatisfiable};
+
+    // One GET of an object, or of the bytes selected by the HTTP `range` if it is not
+    // empty, unless its ETag is `ifNoneMatch` (if not empty), writing the body straight
+    // into `body` (a VectorStreamBuf or SpanStreamBuf; its contents are undefined unless
+    // the status is ok). On success, `objectSize` is the object's total size (from
+    // Content-Range for ranged GETs) and `etag` its ETag. The transfer is aborted once
+    // `abandoned` (if given) is set.
+    template<class BODY>
+    inline GetStatus sendGetOnce(Aws::S3::S3Client & client,
+                                 const std::string & bucket, const std::string & key,
+                                 const std::string & range, const std::string & ifNoneMatch,
+                                 BODY & body, std::size_t & objectSize, std::string & etag,
+                                 const std::atomic<bool> * abandoned=nullptr) {
         Aws::S3::Model::GetObjectRequest request;
         request.SetBucket(Aws::String(bucket.c_str(), bucket.size()));
         request.SetKey(Aws::String(key.c_str(), key.size()));
+        if(!range.empty()) {
+            request.SetRange(Aws::String(range.c_str(), range.size()));
+        }
+        if(!ifNoneMatch.empty()) {
+            request.SetIfNoneMatch(Aws::String(ifNoneMatch.c_str(), ifNoneMatch.size()));
+        }
+        // the SDK owns (and deletes) the stream, `body` outlives the request
+        request.SetResponseStreamFactory([&body]{
+            body.reset();
+            return Aws::New<Aws::IOStream>(ALLOC_TAG, &body);
+        });
+        if(abandoned) {
+            request.SetContinueRequestHandler([abandoned](const Aws::Http::HttpRequest *){
+                return !*abandoned;
+            });
+        }
         auto outcome = client.GetObject(request);
         if(!outcome.IsSuccess()) {
-            if(isNotFound(outcome.GetError())) {
-                return false;
+            const auto & error = outcome.GetError();
+            if(isNotFound(error)) {
+                return GetStatus::notFound;
+            }
+            if(!ifNoneMatch.empty() && error.GetResponseCode() == Aws::Http::HttpResponseCode::NOT_MODIFIED) {
+                return GetStatus::notModified;
+            }
+            if(!range.empty() && error.GetResponseCode() == Aws::Http::HttpResponseCode::REQUESTED_RANGE_NOT_SATISFIABLE) {
+                return GetStatus::unsatisfiable;
             }
-            throw makeS3Error("could not read object from S3", key, outcome.GetError());
+            throw makeS3Error(range.empty() ? "could not read object from S3"
+                                            : "could not read object range from S3", key, error);
         }
-        auto result = outcome.GetResultWithOwnership();
+        const auto & result = outcome.GetResult();
         const long long length = result.GetContentLength();
-        auto & body = result.GetBody();
-        if(length >= 0) {
-            out.resize(static_cast<std::size_t>(length));
-            if(length > 0) {
-                body.read(out.data(), length);
-                if(body.gcount() != static_cast<std::streamsize>(length)) {
-                    throw std::runtime_error("z5: truncated response body from S3: " + key);
-                }
+        if(length >= 0 && body.size() != static_cast<std::size_t>(length)) {
+            throw std::runtime_error("z5: truncated response body from S3: " + key);
+        }
+        etag = std::string(result.GetETag().c_str());
+        objectSize = body.size();
+        if(!range.empty()) {
+            // "bytes <first>-<last>/<size>"; a server that ignores the range sends the whole object
+            const std::string contentRange(result.GetContentRange().c_str());
+            const auto slash = contentRange.rfind('/');
+            if(slash != std::string::npos && slash + 1 < contentRange.size() && contentRange[slash + 1] != '*') {
+                objectSize = std::stoull(contentRange.substr(slash + 1));
             }
+        }
+        return GetStatus::ok;
+    }
+
+    //
+    // hedged GETs (see s3::setHedging)
+    //
+
+    // the latencies of recent GETs, from which the hedging delay is derived
+    struct HedgeConfig {
+        static constexpr std::size_t nSamples = 1024;
+        // hedging needs this many samples
+        static constexpr std::size_t minSamples = 64;
+        std::atomic<double> percentile{0.};
+        std::mutex mutex;
+        std::vector<int64_t> latencies;   // microseconds, ring buffer
+        std::size_t next = 0;
+        std::size_t nRecorded = 0;
+        // the current hedging delay in microseconds; -1: not enough samples yet
+        std::atomic<int64_t> delay{-1};
+        // the threads that run hedged attempts; grown to the attempts in flight
+        std::atomic<std::size_t> nAttempts{0};
+    };
+
+    inline HedgeConfig & hedgeConfig() {
+        static HedgeConfig config;
+        return config;
+    }
+
+    inline util::ThreadPool & hedgePool() {
+        // abandoned attempts may still be running at exit (see writeBehindConfig)
+        ensureApiInitialized();
+        static util::ThreadPool pool(util::ParallelOptions::NoThreads);
+        return pool;
+    }
+
+    // Record the latency of a GET as the caller saw it: from the start of the first attempt
+    // until an attempt succeeded. Sampling the attempts instead would drop the slow first
+    // attempts that lose to their hedge, so the delay would drift below the percentile and
+    // hedge ever more GETs. The delay is recomputed every 32 samples.
+    inline void recordLatency(const int64_t micros) {
+        auto & config = hedgeConfig();
+        std::lock_guard<std::mutex> lock(config.mutex);
+        if(config.latencies.size() < HedgeConfig::nSamples) {
+            config.latencies.push_back(micros);
         } else {
-            // unknown content length: read the stream to EOF (binary-safe)
+            config.latencies[config.next] = micros;
+        }
+        config.next = (config.next + 1) % HedgeConfig::nSamples;
+        if(++config.nRecorded % 32 != 0 || config.latencies.size() < HedgeConfig::minSamples) {
+            return;
+        }
+        std::vector<int64_t> sorted(config.latencies);
+        const auto nth = sorted.begin() + static_cast<std::ptrdiff_t>(
+            std::min(config.percentile.load(), 1.) * (sorted.size() - 1));
+        std::nth_element(sorted.begin(), nth, sorted.end());
+        config.delay = *nth;
+    }
+
+    inline void resetLatencies() {
+        auto & config = hedgeConfig();
+        std::lock_guard<std::mutex> lock(config.mutex);
+        config.latencies.clear();
+        config.next = 0;
+        config.nRecorded = 0;
+        config.delay = -1;
+    }
+
+    // the outcome of one attempt of a hedged GET
+    struct HedgedAttempt {
+        std::vector<char> data;
+        GetStatus status = GetStatus::ok;
+        std::size_t objectSize = 0;
+        std::string etag;
+        std::exception_ptr error;
+    };
+
+    // the attempts of a hedged GET; shared with the attempts, which may outlive the GET
+    struct HedgedGet {
+        std::mutex mutex;
+        std::condition_variable finished;
+        HedgedAttempt attempts[2];
+        int nLaunched = 0;
+        int nFinished = 0;
+        int winner = -1;
+        // set once there is a winner: the other attempt is aborted
+        std::atomic<bool> decided{false};
+    };
+
+    // GET as sendGetOnce; with hedging enabled a second attempt is issued if the first
+    // one has not finished within the hedging delay, and whichever finishes first is
+    // used. The attempts of a hedged GET run on the hedge pool and receive the body into
+    // their own buffers, which is copied into `body` (an abandoned attempt must not
+    // write to the caller's memory).
+    template<class BODY>
+    inline GetStatus sendGet(Aws::S3::S3Client & client,
+                             const std::string & bucket, const std::string & key,
+                             const std::string & range, const std::string & ifNoneMatch,
+                             BODY & body, std::size_t & objectSize, std::string & etag) {
+        auto & config = hedgeConfig();
+        if(config.percentile <= 0.) {
+            return sendGetOnce(client, bucket, key, range, ifNoneMatch, body, objectSize, etag);
+        }
+
+        auto state = std::make_shared<HedgedGet>();
+        // `client` is one of the process-wide shared clients, which outlive the attempts
+        auto launch = [state, &client, bucket, key, range, ifNoneMatch](const int k){
+            auto & config = hedgeConfig();
+            auto & pool = hedgePool();
+            const std::size_t nAttempts = ++config.nAttempts;
+            if(nAttempts > pool.nThreads()) {
+                std::lock_guard<std::mutex> lock(config.mutex);
+                if(nAttempts > pool.nThreads()) {
+                    pool.resize(nAttempts);
+                }
+            }
+            pool.enqueue([state, &client, bucket, key, range, ifNoneMatch, k](int){
+                auto & attempt = state->attempts[k];
+                abandonedFlag() = &state->decided;
+                try {
+                    VectorStreamBuf attemptBody(attempt.data);
+                    attempt.status = sendGetOnce(client, bucket, key, range, ifNoneMatch, attemptBody,
+                                                 attempt.objectSize, attempt.etag, &state->decided);
+                } catch(...) {
+                    attempt.error = std::current_exception();
+                }
+                abandonedFlag() = nullptr;
+                --hedgeConfig().nAttempts;
+                std::lock_guard<std::mutex> lock(state->mutex);
+                ++state->nFinished;
+                if(state->winner < 0 && !attempt.error) {
+                    state->winner = k;
+                    state->decided = true;
+                }
+                state->finished.notify_all();
+            });
+        };
+
+        const int64_t delay = config.delay;
+        const auto start = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->nLaunched = 1;
+        launch(0);
+        auto done = [&state]{return state->winner >= 0 || state->nFinished == state->nLaunched;};
+        // no hedge before there are enough samples for the delay
+        if(delay >= 0 && !state->finished.wait_for(lock, std::chrono::microseconds(delay), done)) {
+            state->nLaunched = 2;
+            ++requestCounters().hedges;
+            launch(1);
+        }
+        state->finished.wait(lock, done);
+        // both failed (or the only one did): report the first error
+        if(state->winner < 0) {
+            state->decided = true;
+            std::rethrow_exception(state->attempts[0].error);
+        }
+        if(state->winner == 1) {
+            ++requestCounters().hedgeWins;
+        }
+        auto & attempt = state->attempts[state->winner];
+        lock.unlock();
+        recordLatency(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+
+        body.reset();
+        if(attempt.status == GetStatus::ok) {
+            const auto nBytes = static_cast<std::streamsize>(attempt.data.size());
+            if(body.sputn(attempt.data.data(), nBytes) != nBytes) {
+                throw std::runtime_error("z5: response body from S3 exceeds the requested range: " + key);
+            }
+        }
+        objectSize = attempt.objectSize;
+        etag = attempt.etag;
+        return attempt.status;
+    }
+
+    inline GetStatus sendGet(Aws::S3::S3Client & client,
+                             const std::string & bucket, const std::string & key,
+                             const std::string & range, const std::string & ifNoneMatch,
+                             std::vector<char> & out, std::size_t & objectSize, std::string & etag) {
+        VectorStreamBuf body(out);
+        const auto status = sendGet(client, bucket, key, range, ifNoneMatch, body, objectSize, etag);
+        if(status != GetStatus::ok) {
             out.clear();
-            char chunk[65536];
-            do {
-                body.read(chunk, sizeof(chunk));
-                out.insert(out.end(), chunk, chunk + body.gcount());
-            } while(body.gcount() > 0);
+        }
+        return status;
+    }
+
+    // GET through the disk cache, if there is one: an entry younger than the maximal age
+    // is used as it is, an older one is revalidated with a conditional GET (If-None-Match
+    // its ETag), which transfers no data if the object did not change.
+    inline GetStatus cachedGet(Aws::S3::S3Client & client,
+                               const std::string & bucket, const std::string & key,
+                               const std::string & range,
+                               std::vector<char> & out, std::size_t & objectSize) {
+        std::string etag;
+        const auto cache = diskCache();
+        if(!cache) {
+            return sendGet(client, bucket, key, range, "", out, objectSize, etag);
+        }
+
+        const std::string object = objectName(bucket, key);
+        util::DiskCache::Entry entry;
+        const bool cached = cache->get(object, range, entry);
+        const int64_t now = util::DiskCache::now();
+        if(cached && now - entry.validated < diskCacheConfig().maxAge) {
+            out = std::move(entry.data);
+            objectSize = entry.objectSize;
+            return GetStatus::ok;
+        }
+
+        const auto status = sendGet(client, bucket, key, range, cached ? entry.etag : "",
+                                    out, objectSize, etag);
+        switch(status) {
+            case GetStatus::notModified:
+                cache->setValidated(object, range, now);
+                out = std::move(entry.data);
+                objectSize = entry.objectSize;
+                return GetStatus::ok;
+            case GetStatus::ok:
+                // objects without ETag cannot be revalidated
+                if(!etag.empty()) {
+                    entry.etag = etag;
+                    entry.objectSize = objectSize;
+                    entry.validated = now;
+                    entry.data = out;
+                    cache->put(object, range, entry);
+                }
+                return status;
+            case GetStatus::notFound:
+                if(cached) {
+                    cache->erase(object);
+                }
+                return status;
+            default:
+                return status;
+        }
+    }
+
+    // drop an object that was written or deleted from the disk cache
+    inline void invalidateDiskCache(const std::string & bucket, const std::string & key) {
+        if(const auto cache = diskCache()) {
+            cache->erase(objectName(bucket, key));
+        }
+    }
+
+    // read an object's bytes; returns false if the object does not exist,
+    // throws on any other error
+    inline bool getObject(Aws::S3::S3Client & client,
+                          const std::string & bucket, const std::string & key,
+                          std::vector<char> & out) {
+        std::size_t objectSize;
+        return cachedGet(client, bucket, key, "", out, objectSize) != GetStatus::notFound;
+    }
+
+    // Ranged GET: read the bytes selected by the HTTP `range` ("bytes=a-b" or the suffix
+    // "bytes=-n") and report the object's total size (from Content-Range). Returns false
+    // if the object does not exist; a range that is not satisfiable (e.g. a suffix of an
+    // empty object) yields no bytes.
+    inline bool getObjectRange(Aws::S3::S3Client & client,
+                               const std::string & bucket, const std::string & key,
+                               const std::string & range,
+                               std::vector<char> & out,
+                               std::size_t & objectSize) {
+        switch(cachedGet(client, bucket, key, range, out, objectSize)) {
+            case GetStatus::notFound:
+                return false;
+            case GetStatus::unsatisfiable:
+                out.clear();
+                objectSize = 0;
+                return true;
+            default:
+                return true;
+        }
+    }
+
+    // Read the `nBytes` (> 0) bytes at `offset` of an object straight into `out`, e.g. a
+    // slot of a shard buffer. Returns false if the object does not exist, throws if it
+    // ends before the range does.
+    inline bool getObjectRange(Aws::S3::S3Client & client,
+                               const std::string & bucket, const std::string & key,
+                               const std::size_t offset, const std::size_t nBytes, char * out) {
+        const std::string range = "bytes=" + std::to_string(offset) + "-" +
+                                  std::to_string(offset + nBytes - 1);
+        std::size_t objectSize;
+        bool complete;
+        // the disk cache keeps its own copy of the range
+        if(diskCache()) {
+            std::vector<char> part;
+            if(!getObjectRange(client, bucket, key, range, part, objectSize)) {
+                return false;
+            }
+            complete = part.size() == nBytes;
+            if(complete) {
+                std::copy(part.begin(), part.end(), out);
+            }
+        } else {
+            SpanStreamBuf body(out, nBytes);
+            std::string etag;
+            const auto status = sendGet(client, bucket, key, range, "", body, objectSize, etag);
+            if(status == GetStatus::notFound) {
+                return false;
+            }
+            complete = status == GetStatus::ok && body.size() == nBytes;
+        }
+        if(!complete) {
+            throw std::runtime_error("z5: range out of bounds of S3 object: " + key);
         }
         return true;
     }
@@ -223,17 +757,101 @@ namespace detail {
         return true;
     }
 
-    // write an object from raw bytes (binary-safe)
+    // objects of at least `threshold` bytes are uploaded in parts (see s3::setMultipartUpload)
+    struct MultipartConfig {
+        std::atomic<std::size_t> threshold{std::size_t(64) << 20};
+        std::atomic<std::size_t> partSize{std::size_t(16) << 20};
+    };
+
+    inline MultipartConfig & multipartConfig() {
+        static MultipartConfig config;
+        return config;
+    }
+
+    // upload an object in parts that are sent concurrently (see runRequests); if a part
+    // or the completion fails, the upload is aborted, so S3 drops the parts it holds
+    inline void putObjectMultipart(Aws::S3::S3Client & client,
+                                   const std::string & bucket, const std::string & key,
+                                   const char * data, const std::size_t size) {
+        const Aws::String awsBucket(bucket.c_str(), bucket.size());
+        const Aws::String awsKey(key.c_str(), key.size());
+        Aws::S3::Model::CreateMultipartUploadRequest create;
+        create.SetBucket(awsBucket);
+        create.SetKey(awsKey);
+        auto created = client.CreateMultipartUpload(create);
+        if(!created.IsSuccess()) {
+            throw makeS3Error("could not start multipart upload to S3", key, created.GetError());
+        }
+        const Aws::String uploadId = created.GetResult().GetUploadId();
+
+        // S3 allows at most 10000 parts per object
+        const std::size_t partSize = std::max(multipartConfig().partSize.load(), (size + 9999) / 10000);
+        const std::size_t nParts = (size + partSize - 1) / partSize;
+        try {
+            Aws::Vector<Aws::S3::Model::CompletedPart> parts(nParts);
+            runRequests(nParts, [&](const std::size_t i){
+                const std::size_t offset = i * partSize;
+                const std::size_t nBytes = std::min(partSize, size - offset);
+                Aws::S3::Model::UploadPartRequest request;
+                request.SetBucket(awsBucket);
+                request.SetKey(awsKey);
+                request.SetUploadId(uploadId);
+                request.SetPartNumber(static_cast<int>(i + 1));
+                Aws::Utils::Stream::PreallocatedStreamBuf buffer(
+                    reinterpret_cast<unsigned char *>(const_cast<char *>(data + offset)), nBytes);
+                request.SetBody(Aws::MakeShared<Aws::IOStream>(ALLOC_TAG, &buffer));
+                request.SetContentLength(static_cast<long long>(nBytes));
+                auto outcome = client.UploadPart(request);
+                if(!outcome.IsSuccess()) {
+                    throw makeS3Error("could not upload part of object to S3", key, outcome.GetError());
+                }
+                parts[i].SetPartNumber(static_cast<int>(i + 1));
+                parts[i].SetETag(outcome.GetResult().GetETag());
+            });
+
+            Aws::S3::Model::CompletedMultipartUpload completed;
+            completed.SetParts(std::move(parts));
+            Aws::S3::Model::CompleteMultipartUploadRequest request;
+            request.SetBucket(awsBucket);
+            request.SetKey(awsKey);
+            request.SetUploadId(uploadId);
+            request.SetMultipartUpload(completed);
+            auto outcome = client.CompleteMultipartUpload(request);
+            if(!outcome.IsSuccess()) {
+                throw makeS3Error("could not complete multipart upload to S3", key, outcome.GetError());
+            }
+        } catch(...) {
+            // best effort: a failed abort leaves the parts to the bucket's lifecycle rules
+            Aws::S3::Model::AbortMultipartUploadRequest abort;
+            abort.SetBucket(awsBucket);
+            abort.SetKey(awsKey);
+            abort.SetUploadId(uploadId);
+            client.AbortMultipartUpload(abort);
+            throw;
+        }
+    }
+
+    // write an object from raw bytes (binary-safe); large objects are uploaded in parts
     inline void putObject(Aws::S3::S3Client & client,
                          const std::string & bucket, const std::string & key,
                          const char * data, const std::size_t size) {
+        const std::size_t threshold = multipartConfig().threshold;
+        if(threshold > 0 && size >= threshold) {
+            // the object only changes if the upload completes
+            putObjectMultipart(client, bucket, key, data, size);
+            invalidateDiskCache(bucket, key);
+            return;
+        }
         Aws::S3::Model::PutObjectRequest request;
         request.SetBucket(Aws::String(bucket.c_str(), bucket.size()));
         request.SetKey(Aws::String(key.c_str(), key.size()));
-        auto body = Aws::MakeShared<Aws::StringStream>(ALLOC_TAG);
-        body->write(data, size);
-        request.SetBody(body);
+        // the body is read straight from the caller's buffer (the SDK only reads it)
+        Aws::Utils::Stream::PreallocatedStreamBuf buffer(
+            reinterpret_cast<unsigned char *>(const_cast<char *>(data)), size);
+        request.SetBody(Aws::MakeShared<Aws::IOStream>(ALLOC_TAG, &buffer));
+        request.SetContentLength(static_cast<long long>(size));
         auto outcome = client.PutObject(request);
+        invalidateDiskCache(bucket, key);
         if(!outcome.IsSuccess()) {
             throw std::runtime_error("z5: could not write object to S3: " + key +
                                      " (" + std::string(outcome.GetError().GetMessage().c_str()) + ")");
@@ -254,25 +872,51 @@ namespace detail {
         return client.HeadObject(request).IsSuccess();
     }
 
+    // size and ETag of an object; returns false if it does not exist
+    inline bool headObject(Aws::S3::S3Client & client,
+                           const std::string & bucket, const std::string & key,
+                           std::size_t & size, std::string & etag) {
+        Aws::S3::Model::HeadObjectRequest request;
+        request.SetBucket(Aws::String(bucket.c_str(), bucket.size()));
+        request.SetKey(Aws::String(key.c_str(), key.size()));
+        auto outcome = client.HeadObject(request);
+        if(!outcome.IsSuccess()) {
+            if(isNotFound(outcome.GetError())) {
+                return false;
+            }
+            throw makeS3Error("could not stat object on S3", key, outcome.GetError());
+        }
+        const auto & result = outcome.GetResult();
+        size = static_cast<std::size_t>(result.GetContentLength());
+        etag = std::string(result.GetETag().c_str());
+        return true;
+    }
+
     inline void deleteObject(Aws::S3::S3Client & client,
                            const std::string & bucket, const std::string & key) {
         Aws::S3::Model::DeleteObjectRequest request;
         request.SetBucket(Aws::String(bucket.c_str(), bucket.size()));
         request.SetKey(Aws::String(key.c_str(), key.size()));
         auto outcome = client.DeleteObject(request);
+        invalidateDiskCache(bucket, key);
         // deleting a non-existing object is fine (DeleteObject is idempotent)
         if(!outcome.IsSuccess() && !isNotFound(outcome.GetError())) {
             throw makeS3Error("could not delete object from S3", key, outcome.GetError());
         }
     }
 
-    // collect all object keys under a prefix (paginated)
-    inline void listAllKeys(Aws::S3::S3Client & client,
+    // list the objects directly under `prefix` and the common prefixes ("directories")
+    // below it, if `delimiter` is not empty (paginated)
+    inline void listLevel(Aws::S3::S3Client & client,
                           const std::string & bucket, const std::string & prefix,
-                          std::vector<std::string> & out) {
+                          const std::string & delimiter,
+                          std::vector<std::string> & keys, std::vector<std::string> & prefixes) {
         Aws::S3::Model::ListObjectsV2Request request;
         request.WithBucket(Aws::String(bucket.c_str(), bucket.size()));
         request.WithPrefix(Aws::String(prefix.c_str(), prefix.size()));
+        if(!delimiter.empty()) {
+            request.WithDelimiter(Aws::String(delimiter.c_str(), delimiter.size()));
+        }
         Aws::S3::Model::ListObjectsV2Result result;
         do {
             auto outcome = client.ListObjectsV2(request);
@@ -282,39 +926,389 @@ namespace detail {
             result = outcome.GetResult();
             for(const auto & object : result.GetContents()) {
                 const auto & k = object.GetKey();
-                out.emplace_back(k.c_str(), k.size());
+                keys.emplace_back(k.c_str(), k.size());
+            }
+            for(const auto & commonPrefix : result.GetCommonPrefixes()) {
+                const auto & p = commonPrefix.GetPrefix();
+                prefixes.emplace_back(p.c_str(), p.size());
             }
             request.SetContinuationToken(result.GetNextContinuationToken());
         } while(result.GetIsTruncated());
     }
 
-    // delete every object under a prefix (batched, up to 1000 keys per request)
-    inline void deletePrefix(Aws::S3::S3Client & client,
-                           const std::string & bucket, const std::string & prefix) {
-        std::vector<std::string> keys;
-        listAllKeys(client, bucket, prefix, keys);
+    // whether `key` is an object or a "directory" (objects under key + "/"), with one
+    // delimited listing from `key` on: keys are listed in byte order, so the object comes
+    // first and the directory (as the common prefix key + "/") after only the siblings
+    // that extend `key` by a character sorting before "/" (e.g. "key.0", "key-1")
+    inline bool objectOrPrefixExists(Aws::S3::S3Client & client,
+                                     const std::string & bucket, const std::string & key) {
+        const std::string directory = key + "/";
+        Aws::S3::Model::ListObjectsV2Request request;
+        request.WithBucket(Aws::String(bucket.c_str(), bucket.size()));
+        request.WithPrefix(Aws::String(key.c_str(), key.size()));
+        request.WithDelimiter("/");
+        Aws::S3::Model::ListObjectsV2Result result;
+        do {
+            auto outcome = client.ListObjectsV2(request);
+            if(!outcome.IsSuccess()) {
+                throw makeS3Error("could not list objects in S3", key, outcome.GetError());
+            }
+            result = outcome.GetResult();
+            bool passed = false;
+            for(const auto & object : result.GetContents()) {
+                const std::string k(object.GetKey().c_str(), object.GetKey().size());
+                if(k == key) {
+                    return true;
+                }
+                passed = passed || k > directory;
+            }
+            for(const auto & commonPrefix : result.GetCommonPrefixes()) {
+                const std::string p(commonPrefix.GetPrefix().c_str(), commonPrefix.GetPrefix().size());
+                if(p == directory) {
+                    return true;
+                }
+                passed = passed || p > directory;
+            }
+            if(passed) {
+                return false;
+            }
+            request.SetContinuationToken(result.GetNextContinuationToken());
+        } while(result.GetIsTruncated());
+        return false;
+    }
+
+    // Collect all object keys under a prefix. A single listing is paginated and hence
+    // sequential, so the key space is split along "/": levels with fewer "directories"
+    // than requests may be in flight are descended into, the directories of the first
+    // level that has enough of them are listed flat and concurrently. For chunked
+    // datasets this lists e.g. one row of chunks per request stream.
+    inline void listAllKeys(Aws::S3::S3Client & client,
+                            const std::string & bucket, const std::string & prefix,
+                            std::vector<std::string> & out) {
+        std::vector<std::string> prefixes;
+        listLevel(client, bucket, prefix, "/", out, prefixes);
+        if(prefixes.empty()) {
+            return;
+        }
+        const bool descend = prefixes.size() < requestConfig().concurrency.load();
+        std::vector<std::vector<std::string>> keys(prefixes.size());
+        runRequests(prefixes.size(), [&](const std::size_t i){
+            if(descend) {
+                listAllKeys(client, bucket, prefixes[i], keys[i]);
+            } else {
+                std::vector<std::string> none;
+                listLevel(client, bucket, prefixes[i], "", keys[i], none);
+            }
+        });
+        for(auto & k : keys) {
+            out.insert(out.end(), std::make_move_iterator(k.begin()), std::make_move_iterator(k.end()));
+        }
+    }
+
+    // delete objects with batched requests of up to 1000 keys (the maximum of
+    // DeleteObjects), with up to requestConcurrency batches in flight. Keys that do not
+    // exist are fine; throws if any other key could not be deleted.
+    inline void deleteObjects(Aws::S3::S3Client & client, const std::string & bucket,
+                              const std::vector<std::string> & keys) {
         const std::size_t batchSize = 1000;
-        for(std::size_t start = 0; start < keys.size(); start += batchSize) {
-            Aws::S3::Model::Delete del;
+        const std::size_t nBatches = (keys.size() + batchSize - 1) / batchSize;
+        runRequests(nBatches, [&](const std::size_t batch){
+            const std::size_t start = batch * batchSize;
             const std::size_t end = std::min(start + batchSize, keys.size());
+            Aws::S3::Model::Delete del;
             for(std::size_t i = start; i < end; ++i) {
                 Aws::S3::Model::ObjectIdentifier oid;
                 oid.SetKey(Aws::String(keys[i].c_str(), keys[i].size()));
                 del.AddObjects(oid);
             }
+            // only report the keys that failed
+            del.SetQuiet(true);
             Aws::S3::Model::DeleteObjectsRequest request;
             request.SetBucket(Aws::String(bucket.c_str(), bucket.size()));
             request.SetDelete(del);
             auto outcome = client.DeleteObjects(request);
+            for(std::size_t i = start; i < end; ++i) {
+                invalidateDiskCache(bucket, keys[i]);
+            }
             if(!outcome.IsSuccess()) {
-                throw makeS3Error("could not delete objects from S3", prefix, outcome.GetError());
+                throw makeS3Error("could not delete objects from S3", keys[start], outcome.GetError());
+            }
+            const auto & errors = outcome.GetResult().GetErrors();
+            if(!errors.empty()) {
+                const auto & error = errors.front();
+                throw std::runtime_error("z5: could not delete object from S3: " +
+                                         std::string(error.GetKey().c_str()) + " (" +
+                                         std::string(error.GetCode().c_str()) + ": " +
+                                         std::string(error.GetMessage().c_str()) + ")");
+            }
+        });
+    }
+
+    // delete every object under a prefix
+    inline void deletePrefix(Aws::S3::S3Client & client,
+                           const std::string & bucket, const std::string & prefix) {
+        std::vector<std::string> keys;
+        listAllKeys(client, bucket, prefix, keys);
+        deleteObjects(client, bucket, keys);
+    }
+
+
+    //
+    // write-behind staging of object writes (see s3::setWriteBehind)
+    //
+
+    struct WriteBehindConfig {
+        std::mutex mutex;
+        std::shared_ptr<util::WriteBehind> writeBehind;
+        // the clients of the configurations that staged writes, by context; objects
+        // resumed from an earlier process use a client without the secret key
+        std::map<std::string, std::shared_ptr<Aws::S3::S3Client>> clients;
+    };
+
+    inline WriteBehindConfig & writeBehindConfig() {
+        // construct the API guard first, so the config (its clients and uploader threads)
+        // is destroyed before the API is shut down at exit
+        ensureApiInitialized();
+        static WriteBehindConfig config;
+        return config;
+    }
+
+    inline std::shared_ptr<util::WriteBehind> writeBehind() {
+        auto & config = writeBehindConfig();
+        std::lock_guard<std::mutex> lock(config.mutex);
+        return config.writeBehind;
+    }
+
+    // the client configuration stored with a staged object (never the secret key)
+    inline std::string clientContext(const z5::handle::Handle & handle) {
+        return handle.endpoint() + "\n" + handle.region() + "\n" + (handle.anon() ? "1" : "0") +
+               "\n" + handle.accessKey();
+    }
+
+    // upload a staged object (called by the uploader threads)
+    inline void uploadStaged(const std::string & object, const std::string & context,
+                             const std::vector<char> & data) {
+        std::shared_ptr<Aws::S3::S3Client> client;
+        {
+            auto & config = writeBehindConfig();
+            std::lock_guard<std::mutex> lock(config.mutex);
+            auto it = config.clients.find(context);
+            if(it != config.clients.end()) {
+                client = it->second;
+            }
+        }
+        if(!client) {
+            std::vector<std::string> fields;
+            util::split(context, fields, "\n");
+            fields.resize(4);
+            client = getSharedClient(fields[0], fields[1], fields[2] == "1", "", "");
+        }
+        const auto slash = object.find('/');
+        putObject(*client, object.substr(0, slash), object.substr(slash + 1), data.data(), data.size());
+    }
+
+    // stage the write of an object if write-behind is enabled; false if it is not
+    inline bool stageObject(const z5::handle::Handle & handle, const std::vector<char> & data) {
+        const auto staging = writeBehind();
+        if(!staging) {
+            return false;
+        }
+        const std::string context = clientContext(handle);
+        {
+            auto & config = writeBehindConfig();
+            std::lock_guard<std::mutex> lock(config.mutex);
+            if(config.clients.find(context) == config.clients.end()) {
+                config.clients.emplace(context, makeClient(handle));
             }
         }
+        staging->stage(objectName(handle.bucketName(), handle.nameInBucket()), context,
+                       data.data(), data.size());
+        return true;
+    }
+
+    // the pending upload of an object, or a null pointer
+    inline util::WriteBehind::StagedPtr stagedObject(const std::string & bucket, const std::string & key) {
+        const auto staging = writeBehind();
+        return staging ? staging->find(objectName(bucket, key)) : util::WriteBehind::StagedPtr();
+    }
+
+    // drop the pending uploads of an object / the objects under a prefix before deleting
+    inline void eraseStaged(const std::string & bucket, const std::string & key) {
+        if(const auto staging = writeBehind()) {
+            staging->erase(objectName(bucket, key));
+        }
+    }
+
+    inline void eraseStagedPrefix(const std::string & bucket, const std::string & prefix) {
+        if(const auto staging = writeBehind()) {
+            staging->erasePrefix(objectName(bucket, prefix));
+        }
     }
 
 }  // namespace detail
 
 
+    // Cache the objects read from S3 (chunks, shards, byte ranges of shards and metadata)
+    // in `directory` on a local disk, using at most `maxBytes` (least recently used
+    // entries are evicted). Entries are keyed by bucket and key (and range) and carry the
+    // object's ETag; they persist across processes and can be shared by the processes
+    // of a node. By default every cached read is revalidated with a conditional GET,
+    // which transfers no data if the object did not change; see setDiskCacheMaxAge. An
+    // empty directory or a budget of 0 disables the cache (the default).
+    inline void setDiskCache(const fs::path & directory, const std::size_t maxBytes) {
+        auto & config = detail::diskCacheConfig();
+        std::lock_guard<std::mutex> lock(config.mutex);
+        if(directory.empty() || maxBytes == 0) {
+            config.cache.reset();
+        } else {
+            config.cache = std::make_shared<util::DiskCache>(directory, maxBytes);
+        }
+    }
+
+    // Use cached objects validated less than `seconds` ago without asking S3 (default 0:
+    // always revalidate). Objects changed by others within that time are read stale.
+    inline void setDiskCacheMaxAge(const int64_t seconds) {
+        detail::diskCacheConfig().maxAge = seconds;
+    }
+
+    inline int64_t diskCacheMaxAge() {
+        return detail::diskCacheConfig().maxAge;
+    }
+
+
+    // Issue up to `n` requests at once for the batched reads of a call (default 64):
+    // sub-array reads of chunked datasets GET a batch of chunks concurrently and decode
+    // it as soon as it arrives, the shard path reads the byte ranges of a shard
+    // concurrently. The requests run on dedicated I/O threads, so the number of requests
+    // in flight does not depend on the number of threads that decode.
+    inline void setRequestConcurrency(const std::size_t n) {
+        auto & config = detail::requestConfig();
+        std::lock_guard<std::mutex> lock(config.mutex);
+        config.concurrency = std::max(n, std::size_t(1));
+        // surplus I/O threads are parked
+        if(detail::requestPool().nThreads() + 1 > config.concurrency) {
+            detail::requestPool().resize(config.concurrency - 1);
+        }
+    }
+
+    inline std::size_t requestConcurrency() {
+        return detail::requestConfig().concurrency;
+    }
+
+
+    // Upload objects of at least `threshold` bytes (default 64 MiB) in parts of
+    // `partSize` bytes (default 16 MiB, at least 5 MiB as S3 requires) that are sent
+    // concurrently (up to requestConcurrency at once), so large shards are not limited
+    // by the throughput of one connection or by the 5 GiB limit of a single PUT. The
+    // part size grows if an object would need more than 10000 parts. A failed upload is
+    // aborted. A threshold of 0 disables multipart uploads.
+    inline void setMultipartUpload(const std::size_t threshold,
+                                   const std::size_t partSize=std::size_t(16) << 20) {
+        auto & config = detail::multipartConfig();
+        config.threshold = threshold;
+        config.partSize = std::max(partSize, std::size_t(5) << 20);
+    }
+
+    inline std::size_t multipartThreshold() {
+        return detail::multipartConfig().threshold;
+    }
+
+    inline std::size_t multipartPartSize() {
+        return detail::multipartConfig().partSize;
+    }
+
+
+    // Retry requests that fail with a transient error (503 SlowDown and other
+    // throttling, 5xx, dropped connections) up to `maxRetries` times (default 10), with
+    // exponential backoff and full jitter: the n-th retry waits a random time of up to
+    // min(baseDelayMs * 2^n, 20 s) (default base: 50 ms). Applies to all clients.
+    inline void setRetries(const long maxRetries, const long baseDelayMs=50) {
+        auto & config = detail::retryConfig();
+        config.maxRetries = std::max(maxRetries, 0L);
+        config.baseDelayMs = std::max(baseDelayMs, 1L);
+    }
+
+    // Hedge GETs against slow responses: if a GET has not finished after the given
+    // `percentile` (e.g. 0.95) of the latencies of the recent GETs, the same GET is
+    // issued again and whichever copy finishes first is used; the other is aborted. At
+    // the 0.95 percentile about one GET in twenty is sent twice, and the latency of a
+    // read of many objects no longer follows the slowest of them. Hedged attempts run on
+    // their own threads and receive into their own buffers. 0 disables hedging (the
+    // default); changing the percentile discards the recorded latencies.
+    inline void setHedging(const double percentile) {
+        detail::hedgeConfig().percentile = std::clamp(percentile, 0., 1.);
+        detail::resetLatencies();
+    }
+
+    inline double hedgingPercentile() {
+        return detail::hedgeConfig().percentile;
+    }
+
+    // what the retries and hedging did (counted since the start or the last reset)
+    struct RequestMetrics {
+        // retried requests, of which were throttled (503 SlowDown, 429, ...)
+        std::size_t retries;
+        std::size_t throttleRetries;
+        // hedged GETs, and how many of them the hedge (the second copy) won
+        std::size_t hedges;
+        std::size_t hedgeWins;
+        // the current hedging delay in microseconds; -1 while there are too few samples
+        int64_t hedgeDelay;
+    };
+
+    inline RequestMetrics requestMetrics() {
+        const auto & counters = detail::requestCounters();
+        return RequestMetrics{counters.retries, counters.throttleRetries,
+                              counters.hedges, counters.hedgeWins, detail::hedgeConfig().delay};
+    }
+
+    inline void resetRequestMetrics() {
+        auto & counters = detail::requestCounters();
+        counters.retries = 0;
+        counters.throttleRetries = 0;
+        counters.hedges = 0;
+        counters.hedgeWins = 0;
+    }
+
+
+    // Stage the chunks and shards written to S3 in `directory` on a local disk and
+    // upload them with `nUploaders` threads in the background, so writes do not wait
+    // for S3. Reads, chunkExists and deletes see the staged objects; flushWrites (or
+    // Dataset::flush) waits until everything is uploaded and reports upload errors.
+    // Staged objects take at most `maxBytes` on disk, further writes wait for uploads.
+    // Objects still staged when the process exits are uploaded by the next process that
+    // enables write-behind on the directory (with the endpoint, region and anonymous
+    // access they were written with, and the default credentials). Metadata and
+    // attributes are written directly. An empty directory uploads all staged objects and
+    // disables write-behind (the default).
+    inline void setWriteBehind(const fs::path & directory, const std::size_t nUploaders=32,
+                               const std::size_t maxBytes=std::size_t(4) << 30) {
+        auto & config = detail::writeBehindConfig();
+        std::shared_ptr<util::WriteBehind> previous;
+        {
+            std::lock_guard<std::mutex> lock(config.mutex);
+            previous = std::move(config.writeBehind);
+        }
+        if(previous) {
+            previous->flush();
+            previous.reset();
+        }
+        if(!directory.empty()) {
+            auto writeBehind = std::make_shared<util::WriteBehind>(directory, nUploaders, maxBytes,
+                                                                   &detail::uploadStaged);
+            std::lock_guard<std::mutex> lock(config.mutex);
+            config.writeBehind = std::move(writeBehind);
+        }
+    }
+
+    // upload all staged writes (see setWriteBehind); rethrows the first upload error
+    inline void flushWrites() {
+        if(const auto staging = detail::writeBehind()) {
+            staging->flush();
+        }
+    }
+
+
 namespace handle {
 
     // common functionality for S3 File and Group handles. Stores the bucket /
@@ -366,60 +1360,46 @@ namespace handle {
             return anyObjectWithPrefix(*client, prefix);
         }
 
+        // the names of the children (sub-groups / datasets): the common prefixes of a
+        // listing delimited by "/", so the objects below the children are not listed
         inline void keysImpl(std::vector<std::string> & out) const {
             auto client = makeClient();
-            Aws::S3::Model::ListObjectsV2Request request;
-            request.WithBucket(Aws::String(bucketName_.c_str(), bucketName_.size()));
-            // add delimiter to the prefix
-            const std::string bucketPrefix = nameInBucket_ == "" ? "" : nameInBucket_ + "/";
-            request.WithPrefix(Aws::String(bucketPrefix.c_str(), bucketPrefix.size()));
-            request.WithDelimiter("/");
-
-            Aws::S3::Model::ListObjectsV2Result object_list;
-            do {
-                auto outcome = client->ListObjectsV2(request);
-                if(!outcome.IsSuccess()) {
-                    break;
-                }
-                object_list = outcome.GetResult();
-                for(const auto & common_prefix : object_list.GetCommonPrefixes()) {
-                    const std::string prefix(common_prefix.GetPrefix().c_str(),
-                                             common_prefix.GetPrefix().size());
-                    if(!prefix.empty() && prefix.back() == '/') {
-                        std::vector<std::string> prefixSplit;
-                        util::split(prefix, prefixSplit, "/");
-                        out.emplace_back(prefixSplit.rbegin()[1]);
-                    }
-                }
-                request.SetContinuationToken(object_list.GetNextContinuationToken());
-            } while(object_list.GetIsTruncated());
+            const std::string prefix = nameInBucket_ == "" ? "" : nameInBucket_ + "/";
+            std::vector<std::string> objects, prefixes;
+            detail::listLevel(*client, bucketName_, prefix, "/", objects, prefixes);
+            for(const auto & childPrefix : prefixes) {
+                // strip the prefix and the trailing delimiter
+                out.emplace_back(childPrefix.substr(prefix.size(), childPrefix.size() - prefix.size() - 1));
+            }
         }
 
+        // an object (metadata file or zarr v2 "."-delimited chunk) or a sub-group /
+        // sub-dataset (anything under "name/"); one LIST request
         inline bool inImpl(const std::string & name) const {
             auto client = makeClient();
-            const std::string key = detail::joinKey(nameInBucket_, name);
-            // exact object (metadata file or zarr v2 "."-delimited chunk)
-            if(detail::objectExists(*client, bucketName_, key)) {
-                return true;
-            }
-            // sub-group / sub-dataset: anything under "name/"
-            return anyObjectWithPrefix(*client, key + "/");
+            return detail::objectOrPrefixExists(*client, bucketName_, detail::joinKey(nameInBucket_, name));
         }
 
         // remove every object under this handle's prefix
         inline void removeImpl() const {
             auto client = makeClient();
             const std::string prefix = nameInBucket_ == "" ? "" : nameInBucket_ + "/";
+            detail::eraseStagedPrefix(bucketName_, prefix);
             detail::deletePrefix(*client, bucketName_, prefix);
         }
 
+        // the metadata are objects, so a HEAD each is enough
         inline bool isZarrGroup() const {
             // zarr v2 uses .zgroup, zarr v3 uses zarr.json
-            return inImpl(".zgroup") || inImpl("zarr.json");
+            return metadataExists(".zgroup") || metadataExists("zarr.json");
         }
         inline bool isZarrDataset() const {
             // zarr v2 uses .zarray, zarr v3 uses zarr.json
-            return inImpl(".zarray") || inImpl("zarr.json");
+            return metadataExists(".zarray") || metadataExists("zarr.json");
+        }
+        inline bool metadataExists(const std::string & name) const {
+            auto client = makeClient();
+            return detail::objectExists(*client, bucketName_, detail::joinKey(nameInBucket_, name));
         }
 
         inline const std::string & bucketNameImpl() const {return bucketName_;}
@@ -642,6 +1622,7 @@ namespace handle {
                 const std::string err = "Cannot remove chunk in file mode " + mode().printMode();
                 throw std::invalid_argument(err.c_str());
             }
+            detail::eraseStaged(bucketName(), nameInBucket());
             auto client = makeClient();
             detail::deleteObject(*client, bucketName(), nameInBucket());
         }
@@ -652,6 +1633,9 @@ namespace handle {
         // chunks are single objects: check the exact key, NOT the prefix
         // (prefix matching would make chunk "1.1" exist whenever "1.10" does)
         inline bool exists() const {
+            if(detail::stagedObject(bucketName(), nameInBucket())) {
+                return true;
+            }
             auto client = makeClient();
             return detail::objectExists(*client, bucketName(), nameInBucket());
         }
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+
 #include "z5/s3/handle.hxx"
 #include "z5/generic/store.hxx"
 
@@ -11,7 +14,12 @@ namespace s3 {
     // format-related (codec, shard index, read-modify-write) lives in the
     // generic dataset implementations in z5/generic/, which are parameterized
     // on this policy. The S3 client is a process-wide cached shared_ptr per
-    // configuration, so acquiring it per call costs no round trips.
+    // configuration, so acquiring it per call costs no round trips. With write-behind
+    // (s3::setWriteBehind) writes are staged on a local disk and uploaded in the
+    // background; reads of an object with a pending upload are served from its staged file.
+    // Batched chunk reads and the byte ranges of a shard are requested concurrently on
+    // dedicated I/O threads (s3::setRequestConcurrency). Datasets are removed by listing
+    // their objects and deleting them in batches rather than chunk by chunk.
     struct ChunkStore {
 
         typedef handle::Dataset DatasetHandleType;
@@ -25,23 +33,165 @@ namespace s3 {
         // (no separate exists() round trip, no TOCTOU window)
         static inline bool read(const ChunkHandleType & chunk, std::vector<char> & buffer,
                                 const char * = "chunk") {
+            if(const auto staged = detail::stagedObject(chunk.bucketName(), chunk.nameInBucket())) {
+                buffer.resize(staged->size());
+                readStaged(*staged, 0, buffer.size(), buffer.data());
+                return true;
+            }
             auto client = chunk.makeClient();
             // getObject reads the raw bytes binary-safe (sized by Content-Length)
             return detail::getObject(*client, chunk.bucketName(), chunk.nameInBucket(), buffer);
         }
 
+        // every range is its own GET, so gaps of up to 1 MiB are read along
+        static constexpr std::size_t rangeCoalesceGap = std::size_t(1) << 20;
+
+        // ranged GET: the object's head and its size in one request
+        static inline bool readHead(const ChunkHandleType & chunk, const std::size_t nBytes,
+                                    std::vector<char> & buffer, std::size_t & size,
+                                    const char * = "chunk") {
+            if(const auto staged = detail::stagedObject(chunk.bucketName(), chunk.nameInBucket())) {
+                size = staged->size();
+                buffer.resize(std::min(nBytes, size));
+                readStaged(*staged, 0, buffer.size(), buffer.data());
+                return true;
+            }
+            auto client = chunk.makeClient();
+            return detail::getObjectRange(*client, chunk.bucketName(), chunk.nameInBucket(),
+                                          "bytes=0-" + std::to_string(nBytes - 1), buffer, size);
+        }
+
+        // suffix GET: the object's tail and its size in one request
+        static inline bool readTail(const ChunkHandleType & chunk, const std::size_t nBytes,
+                                    std::vector<char> & buffer, std::size_t & size,
+                                    const char * = "chunk") {
+            if(const auto staged = detail::stagedObject(chunk.bucketName(), chunk.nameInBucket())) {
+                size = staged->size();
+                buffer.resize(std::min(nBytes, size));
+                readStaged(*staged, size - buffer.size(), buffer.size(), buffer.data());
+                return true;
+            }
+            auto client = chunk.makeClient();
+            return detail::getObjectRange(*client, chunk.bucketName(), chunk.nameInBucket(),
+                                          "bytes=-" + std::to_string(nBytes), buffer, size);
+        }
+
+        // the ranges are GET concurrently (see s3::setRequestConcurrency)
+        static inline bool readRanges(const ChunkHandleType & chunk,
+                                      const std::vector<generic::ByteRange> & ranges,
+                                      char * out, const char * = "chunk") {
+            if(const auto staged = detail::stagedObject(chunk.bucketName(), chunk.nameInBucket())) {
+                for(const auto & range : ranges) {
+                    readStaged(*staged, range.offset, range.nBytes, out);
+                    out += range.nBytes;
+                }
+                return true;
+            }
+            std::vector<std::size_t> outOffsets(ranges.size());
+            std::size_t outOffset = 0;
+            for(std::size_t i = 0; i < ranges.size(); ++i) {
+                outOffsets[i] = outOffset;
+                outOffset += ranges[i].nBytes;
+            }
+            auto client = chunk.makeClient();
+            std::atomic<bool> exists(true);
+            detail::runRequests(ranges.size(), [&](const std::size_t i){
+                const auto & range = ranges[i];
+                if(range.nBytes == 0 || !exists) {
+                    return;
+                }
+                // the range lands in its place in `out` without an intermediate copy
+                if(!detail::getObjectRange(*client, chunk.bucketName(), chunk.nameInBucket(),
+                                           range.offset, range.nBytes, out + outOffsets[i])) {
+                    exists = false;
+                }
+            });
+            return exists;
+        }
+
+        // GET many chunks concurrently (see s3::setRequestConcurrency); an absent chunk
+        // yields an empty buffer
+        static inline void readBatch(const std::vector<ChunkHandleType> & chunks,
+                                     const std::vector<std::vector<char> *> & buffers,
+                                     const char * what = "chunk") {
+            detail::runRequests(chunks.size(), [&](const std::size_t i){
+                if(!read(chunks[i], *buffers[i], what)) {
+                    buffers[i]->clear();
+                }
+            });
+        }
+
+        static inline std::size_t readBatchSize() {
+            return requestConcurrency();
+        }
+
         static inline void write(const ChunkHandleType & chunk, const std::vector<char> & buffer,
                                  const char * = "chunk") {
+            if(detail::stageObject(chunk, buffer)) {
+                return;
+            }
             auto client = chunk.makeClient();
             detail::putObject(*client, chunk.bucketName(), chunk.nameInBucket(),
                               buffer.data(), buffer.size());
         }
 
         static inline void erase(const ChunkHandleType & chunk) {
+            detail::eraseStaged(chunk.bucketName(), chunk.nameInBucket());
             auto client = chunk.makeClient();
             detail::deleteObject(*client, chunk.bucketName(), chunk.nameInBucket());
         }
 
+        // erase many chunks with batched DeleteObjects requests
+        static inline void eraseBatch(const std::vector<ChunkHandleType> & chunks) {
+            if(chunks.empty()) {
+                return;
+            }
+            std::vector<std::string> keys;
+            keys.reserve(chunks.size());
+            for(const auto & chunk : chunks) {
+                detail::eraseStaged(chunk.bucketName(), chunk.nameInBucket());
+                keys.push_back(chunk.nameInBucket());
+            }
+            auto client = chunks.front().makeClient();
+            detail::deleteObjects(*client, chunks.front().bucketName(), keys);
+        }
+
+        // list the objects under the dataset's prefix (concurrently, see
+        // detail::listAllKeys) and parse their keys; staged writes are uploaded first, so
+        // their objects are listed too
+        static inline void listChunks(const DatasetHandleType & ds, const std::size_t ndim,
+                                      std::vector<types::ShapeType> & chunkIds) {
+            flushWrites();
+            auto client = ds.makeClient();
+            const std::string prefix = ds.nameInBucket() + "/";
+            std::vector<std::string> keys;
+            detail::listAllKeys(*client, ds.bucketName(), prefix, keys);
+            const bool isZarr = ds.isZarr();
+            types::ShapeType chunkId;
+            for(const auto & key : keys) {
+                if(ds.parseChunkKey(key.substr(prefix.size()), isZarr, ndim, chunkId)) {
+                    chunkIds.push_back(chunkId);
+                }
+            }
+        }
+
+        // HEAD request: size and ETag
+        static inline bool stat(const ChunkHandleType & chunk, generic::ObjectVersion & version) {
+            if(const auto staged = detail::stagedObject(chunk.bucketName(), chunk.nameInBucket())) {
+                version.size = staged->size();
+                version.etag = "staged-" + std::to_string(staged->sequence());
+                return true;
+            }
+            auto client = chunk.makeClient();
+            return detail::headObject(*client, chunk.bucketName(), chunk.nameInBucket(),
+                                      version.size, version.etag);
+        }
+
+        // wait for the staged writes of all datasets (see s3::flushWrites)
+        static inline void flush() {
+            flushWrites();
+        }
+
         // dummy path impls: there are no filesystem paths on s3
         static inline const fs::path & path(const DatasetHandleType &) {
             static const fs::path p;
@@ -50,9 +200,22 @@ namespace s3 {
 
         static inline void chunkPath(const ChunkHandleType &, fs::path &) {}
 
+    private:
+        // staged files stay until the last reader lets go, so failing to read is an error
+        static inline void readStaged(const util::WriteBehind::Staged & staged,
+                                      const std::size_t offset, const std::size_t nBytes, char * out) {
+            if(!staged.read(offset, nBytes, out)) {
+                throw std::runtime_error("z5: could not read staged S3 object: " + staged.object());
+            }
+        }
+
     };
 
     static_assert(z5::generic::ChunkStorePolicy<ChunkStore>);
+    static_assert(z5::generic::BatchedChunkStorePolicy<ChunkStore>);
+    static_assert(z5::generic::VersionedChunkStorePolicy<ChunkStore>);
+    static_assert(z5::generic::FlushableChunkStorePolicy<ChunkStore>);
+    static_assert(z5::generic::ListableChunkStorePolicy<ChunkStore>);
 
 }
 }
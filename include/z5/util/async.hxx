@@ -0,0 +1,196 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "z5/util/threadpool.hxx"
+
+
+namespace z5 {
+namespace util {
+
+    //
+    // asynchronous requests
+    //
+    // submitAsync runs a request (e.g. a readSubarray call) as a single task on the shared
+    // thread pool and returns an AsyncRequest handle. The task is the first runner of the
+    // request's own parallel loops, so a request in flight does not block a thread of the
+    // caller, and many requests share the pool's workers. Requests are cancelled
+    // cooperatively: the staged read / write pipelines check the request's cancellation
+    // flag before each chunk (or shard), so a cancelled write may be partially applied.
+    //
+
+    // error of a cancelled request
+    class RequestCancelled : public std::runtime_error {
+    public:
+        RequestCancelled() : std::runtime_error("z5: request was cancelled") {}
+    };
+
+    namespace async_detail {
+
+        struct RequestState {
+            std::mutex mutex;
+            std::condition_variable cv;
+            bool done = false;
+            bool cancelled = false;
+            std::exception_ptr error;
+            std::atomic<bool> cancelRequested{false};
+            std::vector<std::function<void()>> callbacks;
+        };
+
+        inline const std::atomic<bool> *& cancelToken() {
+            thread_local const std::atomic<bool> * token = nullptr;
+            return token;
+        }
+
+        // installs the cancellation flag of the request the current thread runs
+        class CancelTokenScope {
+        public:
+            CancelTokenScope(const std::atomic<bool> * token) : previous_(cancelToken()) {
+                cancelToken() = token;
+            }
+            ~CancelTokenScope() {
+                cancelToken() = previous_;
+            }
+        private:
+            const std::atomic<bool> * previous_;
+        };
+
+    }
+
+    // Cancellation flag of the asynchronous request run by the calling thread (nullptr
+    // outside of a request). Long-running loops check it between work items.
+    inline const std::atomic<bool> * currentCancelToken() {
+        return async_detail::cancelToken();
+    }
+
+
+    // Future-like handle of a request started with submitAsync. Copies share the request.
+    class AsyncRequest {
+    public:
+        AsyncRequest() {}
+        explicit AsyncRequest(std::shared_ptr<async_detail::RequestState> state)
+            : state_(std::move(state)) {}
+
+        // false for a default-constructed handle
+        inline bool valid() const {
+            return bool(state_);
+        }
+
+        // true once the request has finished (successfully, with an error or cancelled)
+        inline bool ready() const {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            return state_->done;
+        }
+
+        inline void wait() const {
+            std::unique_lock<std::mutex> lock(state_->mutex);
+            state_->cv.wait(lock, [this]{ return state_->done; });
+        }
+
+        // wait at most `timeout`; returns true if the request has finished
+        template<class REP, class PERIOD>
+        inline bool waitFor(const std::chrono::duration<REP, PERIOD> & timeout) const {
+            std::unique_lock<std::mutex> lock(state_->mutex);
+            return state_->cv.wait_for(lock, timeout, [this]{ return state_->done; });
+        }
+
+        // wait and rethrow the request's error (RequestCancelled if it was cancelled)
+        inline void get() const {
+            wait();
+            if(state_->error) {
+                std::rethrow_exception(state_->error);
+            }
+        }
+
+        // Ask the request to stop; returns false if it has already finished. A request that
+        // has not started yet does not run at all, a running one stops before its next
+        // chunk. Either way it finishes with RequestCancelled.
+        inline bool cancel() {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            if(state_->done) {
+                return false;
+            }
+            state_->cancelRequested = true;
+            return true;
+        }
+
+        // true if the request finished because it was cancelled
+        inline bool cancelled() const {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            return state_->cancelled;
+        }
+
+        // Call `f()` once the request has finished: right away (on the calling thread) if it
+        // already has, otherwise on the thread that completes it. `f` must not throw.
+        inline void onDone(std::function<void()> f) {
+            {
+                std::lock_guard<std::mutex> lock(state_->mutex);
+                if(!state_->done) {
+                    state_->callbacks.push_back(std::move(f));
+                    return;
+                }
+            }
+            f();
+        }
+
+    private:
+        std::shared_ptr<async_detail::RequestState> state_;
+    };
+
+
+    // Run `f()` asynchronously on the shared thread pool (grown to at least one worker
+    // unless its size is fixed; with a fixed size of 0, `f` runs synchronously and the
+    // returned request is finished).
+    template<class F>
+    inline AsyncRequest submitAsync(F && f) {
+        auto state = std::make_shared<async_detail::RequestState>();
+        auto & pool = growSharedThreadPool(1);
+        pool.enqueue([state, f = std::forward<F>(f)](int) mutable {
+            std::exception_ptr error;
+            if(state->cancelRequested) {
+                error = std::make_exception_ptr(RequestCancelled());
+            } else {
+                async_detail::CancelTokenScope scope(&state->cancelRequested);
+                try {
+                    f();
+                } catch(...) {
+                    error = std::current_exception();
+                }
+            }
+
+            bool cancelled = false;
+            if(error) {
+                try {
+                    std::rethrow_exception(error);
+                } catch(const RequestCancelled &) {
+                    cancelled = true;
+                } catch(...) {
+                }
+            }
+
+            std::vector<std::function<void()>> callbacks;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->done = true;
+                state->cancelled = cancelled;
+                state->error = error;
+                callbacks.swap(state->callbacks);
+            }
+            state->cv.notify_all();
+            for(auto & callback : callbacks) {
+                callback();
+            }
+        });
+        return AsyncRequest(state);
+    }
+
+}
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "z5/types/types.hxx"
+#include "z5/util/lru_cache.hxx"
+
+
+namespace z5 {
+namespace util {
+
+    // When a chunk cache stores a chunk it has just read.
+    enum class CacheAdmission {
+        // every chunk
+        always,
+        // a chunk that missed before, as long as the earlier miss is still remembered
+        // (the cache remembers the most recent misses worth its budget), and only if it
+        // takes at most 1/8 of the budget: a one-off scan or a single large object does
+        // not evict the working set
+        secondAccess
+    };
+
+    namespace chunk_cache_detail {
+        inline std::atomic<std::size_t> & chunkCacheBytes() {
+            static std::atomic<std::size_t> n(0);
+            return n;
+        }
+
+        inline std::atomic<std::size_t> & storedChunkCacheBytes() {
+            static std::atomic<std::size_t> n(0);
+            return n;
+        }
+
+        inline std::atomic<CacheAdmission> & storedChunkCacheAdmission() {
+            static std::atomic<CacheAdmission> admission(CacheAdmission::secondAccess);
+            return admission;
+        }
+    }
+
+    // Set the byte budget of the per-dataset cache of decoded chunks (default: 0, no
+    // cache). readSubarray copies cached chunks into the output without reading or
+    // decompressing them, so overlapping reads decode each chunk only once. Applies to
+    // datasets opened afterwards; Dataset::chunkCache().setMaxBytes changes the budget
+    // of an open dataset.
+    inline void setChunkCacheBytes(const std::size_t nBytes) {
+        chunk_cache_detail::chunkCacheBytes() = nBytes;
+    }
+
+    inline std::size_t chunkCacheBytes() {
+        return chunk_cache_detail::chunkCacheBytes();
+    }
+
+    // Set the byte budget of the per-dataset cache of the stored bytes of chunks
+    // (default: 0, no cache) and when it admits a chunk (default: on its second access).
+    // Compressed chunks are several times smaller than decoded ones, so for stores where
+    // fetching dominates (S3, network filesystems) a budget covers a larger working set
+    // here than in the decoded-chunk cache. Chunk reads and the sub-array reads of
+    // compressed datasets check it before going to the store; for sharded datasets it
+    // holds the blobs of the inner chunks. Applies to datasets opened afterwards.
+    inline void setStoredChunkCacheBytes(const std::size_t nBytes) {
+        chunk_cache_detail::storedChunkCacheBytes() = nBytes;
+    }
+
+    inline std::size_t storedChunkCacheBytes() {
+        return chunk_cache_detail::storedChunkCacheBytes();
+    }
+
+    inline void setStoredChunkCacheAdmission(const CacheAdmission admission) {
+        chunk_cache_detail::storedChunkCacheAdmission() = admission;
+    }
+
+    inline CacheAdmission storedChunkCacheAdmission() {
+        return chunk_cache_detail::storedChunkCacheAdmission();
+    }
+
+    // a decoded chunk: its values (native byte order, C order) laid out in `shape`, the
+    // shape the chunk is stored at (zarr stores edge chunks at the full chunk shape)
+    struct DecodedChunk {
+        types::ShapeType shape;
+        std::vector<char> data;
+    };
+
+    // LRU cache of the chunks of a dataset (decoded chunks or their stored bytes), keyed
+    // by chunk id (for sharded datasets: the inner chunk id), counting hits and misses.
+    // Writes through the dataset invalidate the chunks they touch. A read that overlaps a
+    // write must not cache what it read before the write: readers take the generation
+    // before reading and only cache while it is unchanged; every invalidation bumps it.
+    template<class VALUE>
+    class ChunkCache {
+    public:
+        typedef typename LruCache<types::ShapeType, VALUE>::ValuePtr ValuePtr;
+
+        explicit ChunkCache(const std::size_t maxBytes,
+                            const CacheAdmission admission=CacheAdmission::always)
+            : cache_(maxBytes),
+              misses_(admission == CacheAdmission::secondAccess ? maxBytes : 0),
+              admission_(admission) {}
+
+        inline bool enabled() const {return cache_.maxBytes() > 0;}
+        inline std::uint64_t generation() const {return generation_;}
+
+        // the cached chunk (counted as a hit) or a null pointer (counted as a miss)
+        inline ValuePtr get(const types::ShapeType & chunkId) {
+            auto chunk = cache_.get(chunkId);
+            if(chunk) {
+                ++nHits_;
+            } else {
+                ++nMisses_;
+            }
+            return chunk;
+        }
+
+        // cache a chunk of `nBytes` read by a read that started at `generation`, if the
+        // admission policy lets it in
+        inline void put(const types::ShapeType & chunkId, ValuePtr chunk,
+                        const std::size_t nBytes, const std::uint64_t generation) {
+            if(generation_ != generation || !admit(chunkId, nBytes)) {
+                return;
+            }
+            cache_.put(chunkId, std::move(chunk), nBytes);
+            // an invalidation in between may have run before the entry was inserted
+            if(generation_ != generation) {
+                cache_.erase(chunkId);
+            }
+        }
+
+        // drop one chunk / the chunks matching `pred` / all chunks; called after the
+        // write that changed them
+        inline void invalidate(const types::ShapeType & chunkId) {
+            ++generation_;
+            cache_.erase(chunkId);
+        }
+
+        template<class PRED>
+        inline void invalidateIf(PRED && pred) {
+            ++generation_;
+            cache_.eraseIf(pred);
+        }
+
+        inline void clear() {
+            ++generation_;
+            cache_.clear();
+            misses_.clear();
+        }
+
+        inline void setMaxBytes(const std::size_t maxBytes) {
+            cache_.setMaxBytes(maxBytes);
+            if(admission_ == CacheAdmission::secondAccess) {
+                misses_.setMaxBytes(maxBytes);
+            }
+        }
+
+        inline std::size_t maxBytes() const {return cache_.maxBytes();}
+        inline std::size_t bytes() const {return cache_.bytes();}
+        inline std::size_t size() const {return cache_.size();}
+        inline CacheAdmission admission() const {return admission_;}
+        inline std::size_t hits() const {return nHits_;}
+        inline std::size_t misses() const {return nMisses_;}
+
+        inline void resetCounters() {
+            nHits_ = 0;
+            nMisses_ = 0;
+        }
+
+    private:
+        inline bool admit(const types::ShapeType & chunkId, const std::size_t nBytes) {
+            if(admission_ == CacheAdmission::always) {
+                return true;
+            }
+            if(nBytes > cache_.maxBytes() / 8) {
+                return false;
+            }
+            if(misses_.get(chunkId)) {
+                misses_.erase(chunkId);
+                return true;
+            }
+            misses_.put(chunkId, std::make_shared<const std::size_t>(nBytes), nBytes);
+            return false;
+        }
+
+        LruCache<types::ShapeType, VALUE> cache_;
+        // the recent misses that were not admitted (secondAccess), with their sizes
+        LruCache<types::ShapeType, std::size_t> misses_;
+        CacheAdmission admission_;
+        std::atomic<std::uint64_t> generation_{0};
+        std::atomic<std::size_t> nHits_{0};
+        std::atomic<std::size_t> nMisses_{0};
+    };
+
+    // the decoded chunks of a dataset (see setChunkCacheBytes)
+    typedef ChunkCache<DecodedChunk> DecodedChunkCache;
+
+    // the stored (compressed) bytes of the chunks of a dataset (see
+    // setStoredChunkCacheBytes); for sharded datasets the inner chunks' slot blobs
+    typedef ChunkCache<std::vector<char>> StoredChunkCache;
+
+}
+}
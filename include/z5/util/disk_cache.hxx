@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "z5/common.hxx"
+#include "z5/util/local_file.hxx"
+
+
+namespace z5 {
+namespace util {
+
+    // Persistent read-through cache of remote objects (or byte ranges of them) in a local
+    // directory, e.g. on an SSD, that survives process restarts and is shared by all
+    // processes on a node that use the same directory. Each entry is one file
+    // <dir>/<hash of object>/<hash of part> holding the object's ETag, its total size, the
+    // time it was last validated against the remote store, the size and a checksum of the
+    // bytes and the bytes. Entries are written to a temporary file and renamed into place,
+    // so readers in other processes see either the old or the new entry, never a partial
+    // one; removing an entry does not disturb readers that have it open. Entries are not
+    // synced to the disk: one cut off by a power loss fails its checksum and is dropped.
+    // Hits update the modification time of an entry, and the least recently used entries
+    // are removed once the directory exceeds its byte budget. The cache is best effort:
+    // IO errors make lookups miss and inserts no-ops, they never fail the read that uses
+    // the cache.
+    class DiskCache {
+    public:
+        struct Entry {
+            std::string etag;
+            // size of the whole object (entries of a byte range hold only the range)
+            std::size_t objectSize = 0;
+            // seconds since the epoch at which the entry was known to be current
+            int64_t validated = 0;
+            std::vector<char> data;
+        };
+
+        DiskCache(const fs::path & directory, const std::size_t maxBytes) : directory_(directory),
+                                                                             maxBytes_(maxBytes) {
+            std::error_code ec;
+            fs::create_directories(directory_, ec);
+        }
+
+        inline const fs::path & directory() const {return directory_;}
+        inline std::size_t maxBytes() const {return maxBytes_;}
+
+        static inline int64_t now() {
+            return std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        // the entry of `part` ("" for the whole object) of `object`; false if there is none
+        inline bool get(const std::string & object, const std::string & part, Entry & entry) const {
+            const auto path = entryPath(object, part);
+            std::ifstream file(path, std::ios::binary);
+            if(!file) {
+                return false;
+            }
+            char magic[sizeof(MAGIC)];
+            uint64_t validated, objectSize, size, checksum;
+            std::string storedObject, storedPart;
+            if(!file.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+               !local_file::readValue(file, validated) || !local_file::readValue(file, objectSize) ||
+               !local_file::readString(file, storedObject) || !local_file::readString(file, storedPart) ||
+               !local_file::readString(file, entry.etag) ||
+               !local_file::readValue(file, size) || !local_file::readValue(file, checksum)) {
+                drop(object);
+                return false;
+            }
+            // hash collision
+            if(storedObject != object || storedPart != part) {
+                return false;
+            }
+            // an entry that was cut off or damaged: revalidating it would keep serving it,
+            // since its ETag still matches
+            const auto begin = file.tellg();
+            file.seekg(0, std::ios::end);
+            const auto end = file.tellg();
+            file.seekg(begin);
+            if(static_cast<uint64_t>(end - begin) != size) {
+                drop(object);
+                return false;
+            }
+            entry.data.resize(size);
+            if(!file.read(entry.data.data(), size)) {
+                return false;
+            }
+            if(local_file::fnv1a(entry.data.data(), size) != checksum) {
+                drop(object);
+                return false;
+            }
+            entry.validated = static_cast<int64_t>(validated);
+            entry.objectSize = static_cast<std::size_t>(objectSize);
+            // mark the entry as recently used
+            std::error_code ec;
+            fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+            return true;
+        }
+
+        // insert or replace an entry; entries larger than the budget are not stored
+        inline void put(const std::string & object, const std::string & part, const Entry & entry) {
+            if(entry.data.size() > maxBytes_) {
+                return;
+            }
+            const auto path = entryPath(object, part);
+            const auto tmp = path.string() + ".tmp" + uniqueSuffix();
+            std::error_code ec;
+            fs::create_directories(path.parent_path(), ec);
+            {
+                std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+                if(!file) {
+                    return;
+                }
+                file.write(MAGIC, sizeof(MAGIC));
+                local_file::writeValue(file, static_cast<uint64_t>(entry.validated));
+                local_file::writeValue(file, static_cast<uint64_t>(entry.objectSize));
+                local_file::writeString(file, object);
+                local_file::writeString(file, part);
+                local_file::writeString(file, entry.etag);
+                local_file::writeValue(file, entry.data.size());
+                local_file::writeValue(file, local_file::fnv1a(entry.data.data(), entry.data.size()));
+                file.write(entry.data.data(), entry.data.size());
+                if(!file) {
+                    file.close();
+                    fs::remove(tmp, ec);
+                    return;
+                }
+            }
+            fs::rename(tmp, path, ec);
+            if(ec) {
+                fs::remove(tmp, ec);
+                return;
+            }
+            // look at the size of the directory every 1/16 of the budget written
+            const std::size_t written = written_ += entry.data.size();
+            if(written >= maxBytes_ / 16) {
+                written_ = 0;
+                evict();
+            }
+        }
+
+        // record that an entry was found to be current (revalidated) at `validated`
+        inline void setValidated(const std::string & object, const std::string & part,
+                                 const int64_t validated) {
+            const auto path = entryPath(object, part);
+            std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+            if(!file) {
+                return;
+            }
+            file.seekp(sizeof(MAGIC));
+            local_file::writeValue(file, static_cast<uint64_t>(validated));
+        }
+
+        // drop all entries of an object (after it was written or deleted)
+        inline void erase(const std::string & object) {
+            drop(object);
+        }
+
+        // remove the least recently used entries until the cache takes at most 7/8 of its
+        // budget, if it exceeds the budget. Only one process evicts at a time; the others
+        // skip eviction while it runs.
+        inline void evict() {
+#ifdef Z5_HAVE_FLOCK
+            const auto lockPath = directory_ / ".lock";
+            const int fd = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if(fd < 0) {
+                return;
+            }
+            if(::flock(fd, LOCK_EX | LOCK_NB) != 0) {
+                ::close(fd);
+                return;
+            }
+#endif
+            struct File {
+                fs::path path;
+                std::size_t size;
+                fs::file_time_type used;
+            };
+            std::vector<File> files;
+            std::size_t total = 0;
+            std::error_code ec;
+            for(auto it = fs::recursive_directory_iterator(directory_, ec);
+                !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+                if(!it->is_regular_file(ec) || it->path().filename() == ".lock") {
+                    continue;
+                }
+                const std::size_t size = static_cast<std::size_t>(it->file_size(ec));
+                const auto used = it->last_write_time(ec);
+                if(ec) {
+                    ec.clear();
+                    continue;
+                }
+                files.push_back(File{it->path(), size, used});
+                total += size;
+            }
+            if(total > maxBytes_) {
+                std::sort(files.begin(), files.end(), [](const File & a, const File & b){
+                    return a.used < b.used;
+                });
+                const std::size_t target = maxBytes_ - maxBytes_ / 8;
+                for(const auto & file : files) {
+                    if(total <= target) {
+                        break;
+                    }
+                    if(fs::remove(file.path, ec)) {
+                        total -= file.size;
+                    }
+                    // drop the object's directory once it is empty
+                    fs::remove(file.path.parent_path(), ec);
+                }
+            }
+#ifdef Z5_HAVE_FLOCK
+            ::flock(fd, LOCK_UN);
+            ::close(fd);
+#endif
+        }
+
+    private:
+        static constexpr char MAGIC[8] = {'z', '5', 'c', 'a', 'c', 'h', 'e', '2'};
+
+        // FNV-1a, as 16 hex digits
+        static inline std::string hashName(const std::string & s) {
+            uint64_t hash = local_file::fnv1a(s.data(), s.size());
+            static const char * digits = "0123456789abcdef";
+            std::string name(16, '0');
+            for(int i = 15; i >= 0; --i) {
+                name[i] = digits[hash & 0xf];
+                hash >>= 4;
+            }
+            return name;
+        }
+
+        // remove all entries of an object
+        inline void drop(const std::string & object) const {
+            std::error_code ec;
+            fs::remove_all(directory_ / hashName(object), ec);
+        }
+
+        inline fs::path entryPath(const std::string & object, const std::string & part) const {
+            return directory_ / hashName(object) / hashName(part);
+        }
+
+        // unique among the processes and threads writing to the cache
+        static inline std::string uniqueSuffix() {
+            static std::atomic<uint64_t> counter(0);
+#ifdef Z5_HAVE_FLOCK
+            const long pid = static_cast<long>(::getpid());
+#else
+            const long pid = 0;
+#endif
+            return "." + std::to_string(pid) + "." + std::to_string(counter++);
+        }
+
+        fs::path directory_;
+        std::size_t maxBytes_;
+        std::atomic<std::size_t> written_{0};
+    };
+
+}
+}
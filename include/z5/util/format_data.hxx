@@ -167,12 +167,13 @@ namespace util {
     // `header_length` to the header's byte length -- the payload starts at
     // buffer.data() + header_length (the header is NOT removed from the buffer,
     // which would memmove the whole compressed payload).
-    inline bool read_n5_header(const std::vector<char> & buffer,
+    inline bool read_n5_header(const char * buffer,
+                               const std::size_t bufferSize,
                                std::size_t & data_size,
                                std::size_t & header_length) {
         // every read below is validated against the buffer size first: a truncated
         // or corrupt chunk file must produce a clean error, not out-of-bounds reads
-        if(buffer.size() < 4) {
+        if(bufferSize < 4) {
             throw std::runtime_error("z5: invalid n5 chunk: truncated header");
         }
 
@@ -188,7 +189,7 @@ namespace util {
 
         const bool is_varlen = mode == 1;
         const std::size_t fullHeaderLen = (ndim + 1) * 4 + (is_varlen ? 4 : 0);
-        if(buffer.size() < fullHeaderLen) {
+        if(bufferSize < fullHeaderLen) {
             throw std::runtime_error("z5: invalid n5 chunk: truncated header");
         }
 
@@ -220,6 +221,12 @@ namespace util {
         return is_varlen;
     }
 
+    inline bool read_n5_header(const std::vector<char> & buffer,
+                               std::size_t & data_size,
+                               std::size_t & header_length) {
+        return read_n5_header(buffer.data(), buffer.size(), data_size, header_length);
+    }
+
 
     template<class T, class CHUNK, class COMPRESSOR>
     inline bool buffer_to_data(const z5::handle::Chunk<CHUNK> & chunk,
@@ -39,21 +39,48 @@ namespace util {
             throw std::invalid_argument(err.c_str());
         }
 
-        // delete trivial chunks in parallel
-        parallel_for_each_chunk(dataset, nThreads, [removeSpecificValue,
-                                                    value](const int tid,
-                                                           const Dataset & ds,
-                                                           const types::ShapeType & chunk) {
-            if(!ds.chunkExists(chunk)) {
-                return;
-            }
+        auto isTrivial = [removeSpecificValue, value](const Dataset & ds, const types::ShapeType & chunk) {
             std::vector<T> data;
             const std::size_t dataSize = prepareChunkReadBuffer(ds, chunk, data);
             ds.readChunk(chunk, &data[0]);
             // check vector for number of uniques and if we only have a single unique, remove it
             const auto uniques = std::set<T>(data.begin(), data.begin() + dataSize);
-            const bool remove = (uniques.size() == 1) ? (removeSpecificValue ? (*uniques.begin() == value ? true : false) : true) : false;
-            if(remove) {
+            return (uniques.size() == 1) ? (removeSpecificValue ? (*uniques.begin() == value ? true : false) : true) : false;
+        };
+
+        // stores that list their chunks (S3): visit only the chunks that exist and remove
+        // the trivial ones with batched requests at the end
+        if(dataset.listsChunks()) {
+            std::vector<types::ShapeType> chunks;
+            dataset.listChunks(chunks);
+            ParallelOptions pOpts(nThreads);
+            std::vector<std::vector<types::ShapeType>> threadTrivial(pOpts.getActualNumThreads());
+            const bool isSharded = dataset.isSharded();
+            parallel_foreach(nThreads, chunks.size(), [&](const int tid, const std::size_t i){
+                // the listing of sharded datasets names the shards, not their inner chunks
+                if(isSharded && !dataset.chunkExists(chunks[i])) {
+                    return;
+                }
+                if(isTrivial(dataset, chunks[i])) {
+                    threadTrivial[tid].push_back(chunks[i]);
+                }
+            });
+            std::vector<types::ShapeType> trivial;
+            for(auto & t : threadTrivial) {
+                trivial.insert(trivial.end(), std::make_move_iterator(t.begin()), std::make_move_iterator(t.end()));
+            }
+            dataset.removeChunks(trivial, nThreads);
+            return;
+        }
+
+        // delete trivial chunks in parallel
+        parallel_for_each_chunk(dataset, nThreads, [&isTrivial](const int tid,
+                                                                const Dataset & ds,
+                                                                const types::ShapeType & chunk) {
+            if(!ds.chunkExists(chunk)) {
+                return;
+            }
+            if(isTrivial(ds, chunk)) {
                 ds.removeChunk(chunk);
             }
         });
@@ -69,6 +96,13 @@ namespace util {
             throw std::invalid_argument(err.c_str());
         }
 
+        // stores that list their chunks (S3) remove all objects of the dataset with
+        // batched deletes, without visiting every position of the chunk grid
+        if(dataset.listsChunks()) {
+            dataset.remove();
+            return;
+        }
+
         // delete chunks in parallel
         parallel_for_each_chunk(dataset, nThreads, [](const int tid,
                                                       const Dataset & ds,
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define Z5_HAVE_FLOCK
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+#include "z5/common.hxx"
+
+
+namespace z5 {
+namespace util {
+
+// Helpers for the files that z5 keeps in local directories next to a remote store
+// (the disk cache and the write-behind staging): binary header fields, checksums
+// and syncing to the disk.
+namespace local_file {
+
+    // FNV-1a of `size` bytes
+    inline uint64_t fnv1a(const char * data, const std::size_t size) {
+        uint64_t hash = 14695981039346656037ULL;
+        for(std::size_t i = 0; i < size; ++i) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    template<class STREAM>
+    inline bool readValue(STREAM & file, uint64_t & value) {
+        return static_cast<bool>(file.read(reinterpret_cast<char *>(&value), sizeof(value)));
+    }
+
+    template<class STREAM>
+    inline void writeValue(STREAM & file, const uint64_t value) {
+        file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    // strings are stored with their size; larger sizes than 1 MiB mean a corrupt file
+    template<class STREAM>
+    inline bool readString(STREAM & file, std::string & s) {
+        uint64_t size;
+        if(!readValue(file, size) || size > (std::size_t(1) << 20)) {
+            return false;
+        }
+        s.resize(size);
+        return static_cast<bool>(file.read(s.data(), size));
+    }
+
+    template<class STREAM>
+    inline void writeString(STREAM & file, const std::string & s) {
+        writeValue(file, s.size());
+        file.write(s.data(), s.size());
+    }
+
+    // flush a file or directory to the disk
+    inline bool syncPath(const fs::path & path) {
+#ifdef Z5_HAVE_FLOCK
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0) {
+            return false;
+        }
+        const bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+#else
+        return true;
+#endif
+    }
+
+} // namespace local_file
+
+}
+}
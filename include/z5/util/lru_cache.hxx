@@ -0,0 +1,132 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+
+namespace z5 {
+namespace util {
+
+    // Thread-safe least-recently-used cache of immutable values, bounded by the sum of
+    // the values' byte sizes (as given to put). Values are handed out as shared pointers,
+    // so an entry that is evicted or replaced stays valid for the callers still using it.
+    // A cache with a budget of 0 bytes stores nothing.
+    template<class KEY, class VALUE>
+    class LruCache {
+    public:
+        typedef std::shared_ptr<const VALUE> ValuePtr;
+
+        explicit LruCache(const std::size_t maxBytes) : maxBytes_(maxBytes) {}
+
+        // the cached value of `key` (marked as most recently used) or a null pointer
+        inline ValuePtr get(const KEY & key) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = index_.find(key);
+            if(it == index_.end()) {
+                return ValuePtr();
+            }
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return it->second->value;
+        }
+
+        // insert or replace the value of `key`, then evict the least recently used
+        // entries until the cache fits its budget again; values larger than the whole
+        // budget are not cached
+        inline void put(const KEY & key, ValuePtr value, const std::size_t nBytes) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            eraseUnlocked(key);
+            if(nBytes > maxBytes_) {
+                return;
+            }
+            entries_.push_front(Entry{key, std::move(value), nBytes});
+            index_.emplace(key, entries_.begin());
+            bytes_ += nBytes;
+            shrinkUnlocked();
+        }
+
+        inline void erase(const KEY & key) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            eraseUnlocked(key);
+        }
+
+        // erase all entries whose key satisfies `pred`
+        template<class PRED>
+        inline void eraseIf(PRED && pred) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for(auto it = entries_.begin(); it != entries_.end();) {
+                if(pred(it->key)) {
+                    bytes_ -= it->nBytes;
+                    index_.erase(it->key);
+                    it = entries_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        inline void clear() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_.clear();
+            index_.clear();
+            bytes_ = 0;
+        }
+
+        inline void setMaxBytes(const std::size_t maxBytes) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            maxBytes_ = maxBytes;
+            shrinkUnlocked();
+        }
+
+        inline std::size_t maxBytes() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return maxBytes_;
+        }
+
+        inline std::size_t bytes() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return bytes_;
+        }
+
+        inline std::size_t size() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return index_.size();
+        }
+
+    private:
+        struct Entry {
+            KEY key;
+            ValuePtr value;
+            std::size_t nBytes;
+        };
+
+        inline void eraseUnlocked(const KEY & key) {
+            auto it = index_.find(key);
+            if(it == index_.end()) {
+                return;
+            }
+            bytes_ -= it->second->nBytes;
+            entries_.erase(it->second);
+            index_.erase(it);
+        }
+
+        inline void shrinkUnlocked() {
+            while(bytes_ > maxBytes_ && !entries_.empty()) {
+                const auto & last = entries_.back();
+                bytes_ -= last.nBytes;
+                index_.erase(last.key);
+                entries_.pop_back();
+            }
+        }
+
+        mutable std::mutex mutex_;
+        std::size_t maxBytes_;
+        std::size_t bytes_ = 0;
+        // most recently used first
+        std::list<Entry> entries_;
+        std::map<KEY, typename std::list<Entry>::iterator> index_;
+    };
+
+}
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define Z5_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "z5/common.hxx"
+
+
+namespace z5 {
+namespace util {
+
+    // Read-only memory mapping of a whole file, used by the zero-copy read paths: the
+    // bytes of uncompressed chunks / shard slots are copied from the page cache straight
+    // into the output instead of being read into a buffer first. Only available on POSIX
+    // systems (MappedFile::supported()).
+    class MappedFile {
+    public:
+        MappedFile() {}
+
+        ~MappedFile() {
+            unmap();
+        }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile & operator=(const MappedFile &) = delete;
+
+        MappedFile(MappedFile && other) noexcept : data_(std::exchange(other.data_, nullptr)),
+                                                   size_(std::exchange(other.size_, 0)) {}
+
+        MappedFile & operator=(MappedFile && other) noexcept {
+            if(this != &other) {
+                unmap();
+                data_ = std::exchange(other.data_, nullptr);
+                size_ = std::exchange(other.size_, 0);
+            }
+            return *this;
+        }
+
+        static constexpr bool supported() {
+#ifdef Z5_HAVE_MMAP
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        // Map `path`, replacing the current mapping; returns false if the file does not
+        // exist. If `populate` is set, the pages are read ahead (prefaulted where the
+        // platform supports it), so the I/O happens here rather than in the first access;
+        // otherwise callers that only touch parts of the file announce them with willNeed.
+        // 'what' names the object kind ("chunk" / "shard") in error messages.
+        inline bool map(const fs::path & path, const char * what = "chunk", const bool populate = true) {
+            unmap();
+#ifdef Z5_HAVE_MMAP
+            const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd < 0) {
+                if(errno == ENOENT || errno == ENOTDIR) {
+                    return false;
+                }
+                throw std::runtime_error(std::string("z5: cannot open ") + what + " file for reading: " + path.string());
+            }
+            struct stat st;
+            if(::fstat(fd, &st) != 0) {
+                ::close(fd);
+                throw std::runtime_error(std::string("z5: failed to read ") + what + " file: " + path.string());
+            }
+            size_ = static_cast<std::size_t>(st.st_size);
+            // an empty file cannot be mapped (and has no data)
+            if(size_ > 0) {
+                int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+                if(populate) {
+                    flags |= MAP_POPULATE;
+                }
+#endif
+                void * data = ::mmap(nullptr, size_, PROT_READ, flags, fd, 0);
+                if(data == MAP_FAILED) {
+                    size_ = 0;
+                    ::close(fd);
+                    throw std::runtime_error(std::string("z5: failed to map ") + what + " file: " + path.string());
+                }
+                data_ = static_cast<const char *>(data);
+#ifndef MAP_POPULATE
+                if(populate) {
+                    ::madvise(data, size_, MADV_WILLNEED);
+                }
+#endif
+            }
+            // the mapping stays valid after closing the file
+            ::close(fd);
+            return true;
+#else
+            throw std::runtime_error("z5: memory mapped reads are not supported on this platform");
+#endif
+        }
+
+        inline void unmap() {
+#ifdef Z5_HAVE_MMAP
+            if(data_) {
+                ::munmap(const_cast<char *>(data_), size_);
+            }
+#endif
+            data_ = nullptr;
+            size_ = 0;
+        }
+
+        // start reading the bytes [offset, offset + nBytes) ahead of their first access
+        inline void willNeed(const std::size_t offset, const std::size_t nBytes) const {
+#ifdef Z5_HAVE_MMAP
+            if(!data_ || offset >= size_) {
+                return;
+            }
+            // madvise wants a page aligned start
+            static const std::size_t pageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            const std::size_t begin = offset - offset % pageSize;
+            const std::size_t end = std::min(offset + nBytes, size_);
+            ::madvise(const_cast<char *>(data_) + begin, end - begin, MADV_WILLNEED);
+#endif
+        }
+
+        inline const char * data() const {return data_;}
+        inline std::size_t size() const {return size_;}
+
+    private:
+        const char * data_ = nullptr;
+        std::size_t size_ = 0;
+    };
+
+}
+}
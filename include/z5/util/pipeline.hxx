@@ -0,0 +1,359 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "z5/util/threadpool.hxx"
+#include "z5/util/async.hxx"
+#include "z5/util/mapped_file.hxx"
+
+
+namespace z5 {
+namespace util {
+
+    //
+    // staged read / write pipelines
+    //
+    // The sub-array paths used to run `read -> decompress -> copy` (and `fill -> compress
+    // -> write`) serially in each task, so on high-latency stores (network filesystems,
+    // S3) a thread blocked in the store leaves its core idle unless the caller
+    // over-subscribes threads, and with slow codecs the store sits idle. The pipelines
+    // below split this into a storage stage and a codec stage connected by a bounded
+    // queue: up to `nIo` store requests are in flight while at most `nCodec` threads
+    // compress / decompress, so the cores stay busy without running more CPU-bound
+    // threads than there are cores.
+    //
+
+    namespace pipeline_detail {
+        // process-wide I/O concurrency of the pipelines (0: use the requested number of
+        // threads) and the byte budget of the write queue
+        inline std::atomic<int> & readIoConcurrency() {
+            static std::atomic<int> n(0);
+            return n;
+        }
+
+        inline std::atomic<int> & writeIoConcurrency() {
+            static std::atomic<int> n(0);
+            return n;
+        }
+
+        inline std::atomic<std::size_t> & writeQueueBytes() {
+            static std::atomic<std::size_t> n(std::size_t(256) << 20);
+            return n;
+        }
+
+        inline std::size_t ioLimit(const int configured, const int numberOfThreads) {
+            return configured > 0 ? static_cast<std::size_t>(configured)
+                                  : static_cast<std::size_t>(ParallelOptions(numberOfThreads).getActualNumThreads());
+        }
+    }
+
+    // Set the maximal number of concurrent storage reads of the staged read path.
+    // `n = 0` (default) uses the number of threads passed to the read call, so passing a
+    // large thread count for a high-latency store raises the number of in-flight reads
+    // while decoding stays capped at the number of cores.
+    inline void setReadIoConcurrency(const int n) {
+        pipeline_detail::readIoConcurrency() = std::max(n, 0);
+    }
+
+    inline int readIoConcurrency() {
+        return pipeline_detail::readIoConcurrency();
+    }
+
+    // Likewise for the storage writes of the staged write path.
+    inline void setWriteIoConcurrency(const int n) {
+        pipeline_detail::writeIoConcurrency() = std::max(n, 0);
+    }
+
+    inline int writeIoConcurrency() {
+        return pipeline_detail::writeIoConcurrency();
+    }
+
+    // Set the (soft) byte budget of the compressed blobs queued for the writers of the
+    // staged write path; compressors wait while it is exhausted (default: 256 MiB).
+    inline void setWriteQueueBytes(const std::size_t nBytes) {
+        pipeline_detail::writeQueueBytes() = nBytes;
+    }
+
+    inline std::size_t writeQueueBytes() {
+        return pipeline_detail::writeQueueBytes();
+    }
+
+    // number of codec threads for a call with `numberOfThreads` threads: the requested
+    // number, capped at the number of cores
+    inline std::size_t codecConcurrency(const int numberOfThreads) {
+        const std::size_t requested = ParallelOptions(numberOfThreads).getActualNumThreads();
+        const std::size_t nCores = std::max(std::thread::hardware_concurrency(), 1u);
+        return std::min(requested, nCores);
+    }
+
+
+    namespace pipeline_detail {
+
+        // Items that hold more memory than this after a pipeline are released instead of
+        // retained for the thread's next call, so that one large read (e.g. of whole
+        // shards) does not pin hundreds of MiB on every thread that ran a pipeline.
+        constexpr std::size_t maxRetainedItemBytes = std::size_t(4) << 20;
+
+        inline std::size_t retainedBytes(const std::vector<char> & item) {
+            return item.capacity();
+        }
+
+        inline std::size_t retainedBytes(const std::vector<std::vector<char>> & item) {
+            std::size_t nBytes = 0;
+            for(const auto & blob : item) {
+                nBytes += blob.capacity();
+            }
+            return nBytes;
+        }
+
+        // a retained mapping also keeps the file mapped: always release it
+        inline std::size_t retainedBytes(const MappedFile & item) {
+            return item.data() ? maxRetainedItemBytes + 1 : 0;
+        }
+
+        // other items report their memory themselves, or hold none outside of the object
+        template<typename ITEM>
+        requires requires(const ITEM & item) {
+            { item.retainedBytes() } -> std::convertible_to<std::size_t>;
+        }
+        inline std::size_t retainedBytes(const ITEM & item) {
+            return item.retainedBytes();
+        }
+
+        template<typename ITEM>
+        inline std::size_t retainedBytes(const ITEM &) {
+            return 0;
+        }
+
+        // Run `first(i, n, items)` on batches of up to `maxBatch` consecutive items
+        // [i, i + n) and then `second(item, i)` for each item, for all i in [0, nItems),
+        // with at most `limit1` / `limit2` concurrent calls of the two stages, on `nRunners`
+        // runners of the shared pool. Runners are not tied to a stage: each one runs the second
+        // stage if a queued item and a slot are available (draining first keeps the queue
+        // short), otherwise the first stage if a slot, an item buffer and byte budget are
+        // free, otherwise waits. So the pipeline also makes progress if a fixed-size pool
+        // provides fewer runners, down to a single one (the caller), which alternates
+        // between the stages. At most `nItemBuffers` items are between the stages, and
+        // the bytes of the queued items (as reported by `itemBytes`) only exceed
+        // `byteBudget` by the items that were in the first stage when it ran out. The ITEM
+        // objects are recycled and retained by the calling thread across calls (see
+        // ThreadLocalScratch), so their buffers are not reallocated per item; items larger
+        // than maxRetainedItemBytes are released at the end of the call. The first
+        // exception stops the pipeline and is rethrown. Inside an asynchronous request, the
+        // runners check its cancellation flag before each item (-> RequestCancelled).
+        template<typename ITEM, typename FIRST, typename SECOND, typename ITEM_BYTES>
+        inline void runTwoStages(const std::size_t nItems,
+                                 const std::size_t nRunners,
+                                 const std::size_t limit1,
+                                 const std::size_t limit2,
+                                 const std::size_t nItemBuffers,
+                                 const std::size_t byteBudget,
+                                 const std::size_t maxBatch,
+                                 FIRST && first,
+                                 SECOND && second,
+                                 ITEM_BYTES && itemBytes) {
+            ThreadLocalScratch<std::vector<ITEM>> itemScratch([]{ return std::vector<ITEM>(); });
+            auto & items = itemScratch.get();
+            if(items.size() < nItemBuffers) {
+                items.resize(nItemBuffers);
+            }
+
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::vector<ITEM *> freeItems;
+            for(std::size_t k = 0; k < nItemBuffers; ++k) {
+                freeItems.push_back(&items[k]);
+            }
+            struct Job {
+                std::size_t index;
+                ITEM * item;
+                std::size_t nBytes;
+            };
+            std::deque<Job> queue;
+            std::size_t nextItem = 0, nFinished = 0, active1 = 0, active2 = 0, queuedBytes = 0;
+            bool cancelled = false;
+            std::exception_ptr error;
+
+            // record the first error and stop all runners (called without the lock)
+            auto fail = [&](std::unique_lock<std::mutex> & lock) {
+                lock.lock();
+                if(!error) {
+                    error = std::current_exception();
+                }
+                cancelled = true;
+                cv.notify_all();
+            };
+
+            // the cancellation flag of the request run by the calling thread, if any
+            const std::atomic<bool> * cancelToken = currentCancelToken();
+
+            auto runStages = [&]() {
+                std::vector<ITEM *> batch;
+                std::vector<std::size_t> batchBytes;
+                std::unique_lock<std::mutex> lock(mutex);
+                while(!cancelled && nFinished < nItems) {
+                    if(cancelToken && cancelToken->load()) {
+                        if(!error) {
+                            error = std::make_exception_ptr(RequestCancelled());
+                        }
+                        cancelled = true;
+                        cv.notify_all();
+                        break;
+                    }
+                    // second stage
+                    if(!queue.empty() && active2 < limit2) {
+                        const Job job = queue.front();
+                        queue.pop_front();
+                        ++active2;
+                        lock.unlock();
+                        try {
+                            second(*job.item, job.index);
+                        } catch(...) {
+                            fail(lock);
+                            return;
+                        }
+                        lock.lock();
+                        --active2;
+                        queuedBytes -= job.nBytes;
+                        freeItems.push_back(job.item);
+                        ++nFinished;
+                        cv.notify_all();
+                        continue;
+                    }
+                    // first stage
+                    if(nextItem < nItems && active1 < limit1 && !freeItems.empty() &&
+                       (queuedBytes < byteBudget || queuedBytes == 0)) {
+                        const std::size_t i = nextItem;
+                        const std::size_t n = std::min({maxBatch, nItems - nextItem, freeItems.size()});
+                        nextItem += n;
+                        batch.assign(freeItems.end() - n, freeItems.end());
+                        freeItems.resize(freeItems.size() - n);
+                        ++active1;
+                        lock.unlock();
+                        batchBytes.resize(n);
+                        try {
+                            first(i, n, batch.data());
+                            for(std::size_t k = 0; k < n; ++k) {
+                                batchBytes[k] = itemBytes(*batch[k]);
+                            }
+                        } catch(...) {
+                            fail(lock);
+                            return;
+                        }
+                        lock.lock();
+                        --active1;
+                        for(std::size_t k = 0; k < n; ++k) {
+                            queuedBytes += batchBytes[k];
+                            queue.push_back(Job{i + k, batch[k], batchBytes[k]});
+                        }
+                        cv.notify_all();
+                        continue;
+                    }
+                    cv.wait(lock);
+                }
+            };
+
+            parallel_foreach_shared(nRunners, nRunners, [&](const int, const std::size_t){
+                runStages();
+            }, 1);
+
+            for(auto & item : items) {
+                if(retainedBytes(item) > maxRetainedItemBytes) {
+                    item = ITEM();
+                }
+            }
+
+            if(error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+    }
+
+
+    // Run `readBatch(i, n, items)` on batches of up to `batchSize` consecutive items
+    // [i, i + n) and then `decode(item, i)` for each item, for all i in [0, nItems), with
+    // at most `readIoConcurrency` (default: numberOfThreads) concurrent batch reads and at
+    // most codecConcurrency(numberOfThreads) concurrent decodes; a single-threaded call
+    // runs both stages on the calling thread. `readBatch` fills the ITEMs `*items[k]`
+    // (e.g. the raw bytes of chunks; stores with batched requests read them at once),
+    // `decode` consumes one. The stages run on `nIo + nDecode` runners of the shared
+    // pool; the I/O runners spend most of their time blocked in the store. At most
+    // `nIo * batchSize + 2 * nDecode` items are read but not yet decoded.
+    template<typename ITEM, typename READ_BATCH, typename DECODE>
+    inline void runBatchedReadPipeline(const std::size_t nItems,
+                                       const int numberOfThreads,
+                                       const std::size_t batchSize,
+                                       READ_BATCH && readBatch,
+                                       DECODE && decode) {
+        if(nItems == 0) {
+            return;
+        }
+        const std::size_t batch = std::max(batchSize, std::size_t(1));
+        const bool parallel = ParallelOptions(numberOfThreads).getActualNumThreads() > 1;
+        const std::size_t nIo = parallel ? std::min(pipeline_detail::ioLimit(readIoConcurrency(), numberOfThreads), nItems) : 1;
+        const std::size_t nDecode = parallel ? std::min(codecConcurrency(numberOfThreads), nItems) : 1;
+        const std::size_t nRunners = parallel ? std::min(nIo + nDecode, nItems) : 1;
+        // enough buffers for all reads in flight plus one queued item per decoder
+        const std::size_t nItemBuffers = std::min(nIo * batch + 2 * nDecode, nItems);
+        pipeline_detail::runTwoStages<ITEM>(nItems, nRunners, nIo, nDecode, nItemBuffers,
+                                            std::size_t(-1), batch, readBatch, decode,
+                                            [](const ITEM &){ return std::size_t(0); });
+    }
+
+
+    // Run `read(i, item)` and then `decode(item, i)` for all i in [0, nItems), staged as
+    // in runBatchedReadPipeline with one item per read.
+    template<typename ITEM, typename READ, typename DECODE>
+    inline void runReadPipeline(const std::size_t nItems,
+                                const int numberOfThreads,
+                                READ && read,
+                                DECODE && decode) {
+        runBatchedReadPipeline<ITEM>(nItems, numberOfThreads, 1,
+                                     [&read](const std::size_t i, const std::size_t, ITEM * const * items){
+                                         read(i, *items[0]);
+                                     },
+                                     decode);
+    }
+
+
+    // Run `encode(i, item)` and then `store(item, i)` for all i in [0, nItems), with at
+    // most codecConcurrency(numberOfThreads) concurrent encodes (fill + compress) and at
+    // most `writeIoConcurrency` (default: numberOfThreads) concurrent stores; a
+    // single-threaded call runs both stages on the calling thread. `encode` fills an ITEM
+    // with compressed data, `store` writes it. The encoded items waiting for the writers
+    // are bounded by count (`nIo + 2 * nEncode`) and by writeQueueBytes(), measured with
+    // `itemBytes(item)`, so fast compressors cannot run arbitrarily far ahead of a slow
+    // store.
+    template<typename ITEM, typename ENCODE, typename STORE_ITEM, typename ITEM_BYTES>
+    inline void runWritePipeline(const std::size_t nItems,
+                                 const int numberOfThreads,
+                                 ENCODE && encode,
+                                 STORE_ITEM && store,
+                                 ITEM_BYTES && itemBytes) {
+        if(nItems == 0) {
+            return;
+        }
+        const bool parallel = ParallelOptions(numberOfThreads).getActualNumThreads() > 1;
+        const std::size_t nEncode = parallel ? std::min(codecConcurrency(numberOfThreads), nItems) : 1;
+        const std::size_t nIo = parallel ? std::min(pipeline_detail::ioLimit(writeIoConcurrency(), numberOfThreads), nItems) : 1;
+        const std::size_t nRunners = parallel ? std::min(nIo + nEncode, nItems) : 1;
+        const std::size_t nItemBuffers = std::min(nIo + 2 * nEncode, nItems);
+        pipeline_detail::runTwoStages<ITEM>(nItems, nRunners, nEncode, nIo, nItemBuffers,
+                                            writeQueueBytes(), 1,
+                                            [&encode](const std::size_t i, const std::size_t, ITEM * const * items){
+                                                encode(i, *items[0]);
+                                            },
+                                            store, itemBytes);
+    }
+
+}
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <limits>
@@ -17,18 +19,103 @@
 //   [ shard index: nSlots * (offset uint64 LE, nbytes uint64 LE) ]
 //   [ crc32c of the index bytes, uint32 LE ]
 //
+// With index_location == "start" the index (and its checksum) precede the blobs
+// instead, and the offsets count from the start of the shard as well. The index
+// codecs are ``bytes`` (little endian) optionally followed by ``crc32c``; other
+// index codecs (e.g. compressors) are not supported, because readers locate the
+// index by its size, which must follow from the number of slots alone.
+//
 // The index has one entry per inner-chunk slot of the shard, in C order over
 // the chunks-per-shard grid; ``nSlots`` is always the full product (out-of-array
 // / never-written slots are stored as "empty" = both fields all-ones). The inner
 // chunk blobs are exactly what a non-sharded chunk file would contain (the
 // output of the inner codec pipeline), so the dataset's existing compressor can
 // produce / consume them unchanged.
+//
+// Blobs may be stored in any order (see setShardBlobOrder) and the data region
+// may contain bytes no entry points to: in-place updates of shards with the
+// index at the end append the new blobs behind the existing ones and replace the
+// index (see ShardedDataset::updateShardSlots).
 
 namespace z5 {
 namespace util {
 
     constexpr uint64_t SHARD_EMPTY = std::numeric_limits<uint64_t>::max();
 
+    // order of the inner chunk blobs in the data region of the shards written by z5
+    // (the index itself is always in C order): C order of the slots, or along a Morton
+    // (Z-order) or Hilbert curve through the chunks-per-shard grid, which keep the
+    // chunks of spatially compact regions close together in the shard
+    enum class ShardBlobOrder { c, morton, hilbert };
+
+    namespace sharding_detail {
+        inline std::atomic<std::size_t> & shardIndexCacheBytes() {
+            static std::atomic<std::size_t> n(std::size_t(64) << 20);
+            return n;
+        }
+
+        inline std::atomic<std::size_t> & shardWriteBackBytes() {
+            static std::atomic<std::size_t> n(0);
+            return n;
+        }
+
+        inline std::atomic<double> & shardCompactionRatio() {
+            static std::atomic<double> ratio(0.5);
+            return ratio;
+        }
+
+        inline std::atomic<ShardBlobOrder> & shardBlobOrder() {
+            static std::atomic<ShardBlobOrder> order(ShardBlobOrder::c);
+            return order;
+        }
+    }
+
+    // Set the byte budget of the parsed shard indices each sharded dataset caches
+    // (default: 64 MiB; 0 disables the cache). Applies to datasets opened afterwards.
+    inline void setShardIndexCacheBytes(const std::size_t nBytes) {
+        sharding_detail::shardIndexCacheBytes() = nBytes;
+    }
+
+    inline std::size_t shardIndexCacheBytes() {
+        return sharding_detail::shardIndexCacheBytes();
+    }
+
+    // Set the byte budget of the inner chunks written with writeChunk / removeChunk that
+    // a sharded dataset holds back, so that each shard is written once for many inner
+    // chunks (default: 0, i.e. write through). Pending chunks are written by
+    // Dataset::flush, when the budget is exceeded, before the shard is read, and when
+    // the dataset is destroyed. Applies to datasets opened afterwards.
+    inline void setShardWriteBackBytes(const std::size_t nBytes) {
+        sharding_detail::shardWriteBackBytes() = nBytes;
+    }
+
+    inline std::size_t shardWriteBackBytes() {
+        return sharding_detail::shardWriteBackBytes();
+    }
+
+    // Set the fraction of dead bytes (inner chunks that were replaced or removed) above
+    // which an in-place shard update rewrites the whole shard instead of appending to it
+    // (default: 0.5; 1 or more never compacts, 0 always rewrites).
+    inline void setShardCompactionRatio(const double ratio) {
+        sharding_detail::shardCompactionRatio() = ratio;
+    }
+
+    inline double shardCompactionRatio() {
+        return sharding_detail::shardCompactionRatio();
+    }
+
+    // Set the order in which shards written by z5 store their inner chunk blobs (default:
+    // ShardBlobOrder::c). With Morton or Hilbert order a compact region of a shard is
+    // read with a few large ranges instead of one per row of chunks. Applies to datasets
+    // opened afterwards; the shards stay readable by any zarr v3 reader.
+    inline void setShardBlobOrder(const ShardBlobOrder order) {
+        sharding_detail::shardBlobOrder() = order;
+    }
+
+    inline ShardBlobOrder shardBlobOrder() {
+        return sharding_detail::shardBlobOrder();
+    }
+
     struct ShardEntry {
         uint64_t offset = SHARD_EMPTY;
         uint64_t nbytes = SHARD_EMPTY;
@@ -72,6 +159,109 @@ namespace util {
         return slot;
     }
 
+    // inner chunk id of a slot of a shard (the inverse of shardId and shardSlot)
+    inline types::ShapeType innerChunkId(const types::ShapeType & shardCoord,
+                                         std::size_t slot,
+                                         const types::ShapeType & cps) {
+        types::ShapeType innerId(shardCoord.size());
+        for(std::size_t d = shardCoord.size(); d-- > 0;) {
+            innerId[d] = shardCoord[d] * cps[d] + slot % cps[d];
+            slot /= cps[d];
+        }
+        return innerId;
+    }
+
+    namespace sharding_detail {
+        // number of bits needed to address n positions
+        inline unsigned bitsFor(const std::size_t n) {
+            unsigned bits = 0;
+            while((std::size_t(1) << bits) < n) {
+                ++bits;
+            }
+            return bits;
+        }
+
+        // interleave the lowest `bits` bits of the coordinates, the first dimension
+        // most significant
+        inline uint64_t interleaveBits(const types::ShapeType & coord, const unsigned bits) {
+            uint64_t key = 0;
+            for(unsigned b = bits; b-- > 0;) {
+                for(const auto c : coord) {
+                    key = (key << 1) | ((c >> b) & 1u);
+                }
+            }
+            return key;
+        }
+
+        // position along the Hilbert curve through the 2^bits grid (Skilling's transform
+        // of the coordinates to the transposed Hilbert index, then interleaved)
+        inline uint64_t hilbertKey(types::ShapeType x, const unsigned bits) {
+            if(bits == 0) {
+                return 0;
+            }
+            const std::size_t n = x.size();
+            const std::size_t m = std::size_t(1) << (bits - 1);
+            for(std::size_t q = m; q > 1; q >>= 1) {
+                const std::size_t p = q - 1;
+                for(std::size_t i = 0; i < n; ++i) {
+                    if(x[i] & q) {
+                        x[0] ^= p;
+                    } else {
+                        const std::size_t t = (x[0] ^ x[i]) & p;
+                        x[0] ^= t;
+                        x[i] ^= t;
+                    }
+                }
+            }
+            for(std::size_t i = 1; i < n; ++i) {
+                x[i] ^= x[i - 1];
+            }
+            std::size_t t = 0;
+            for(std::size_t q = m; q > 1; q >>= 1) {
+                if(x[n - 1] & q) {
+                    t ^= q - 1;
+                }
+            }
+            for(std::size_t i = 0; i < n; ++i) {
+                x[i] ^= t;
+            }
+            return interleaveBits(x, bits);
+        }
+    }
+
+    // the slots of a shard in the order their blobs are stored (empty: C order, which
+    // is also used if the curve's keys would not fit 64 bits)
+    inline void shardBlobPlacement(const types::ShapeType & cps, const ShardBlobOrder order,
+                                   std::vector<std::size_t> & placement) {
+        placement.clear();
+        if(order == ShardBlobOrder::c || cps.empty()) {
+            return;
+        }
+        const unsigned bits = sharding_detail::bitsFor(*std::max_element(cps.begin(), cps.end()));
+        if(bits * cps.size() > 64) {
+            return;
+        }
+        const std::size_t nSlots = numShardSlots(cps);
+        std::vector<std::pair<uint64_t, std::size_t>> keys(nSlots);
+        types::ShapeType coord(cps.size());
+        for(std::size_t slot = 0; slot < nSlots; ++slot) {
+            // C-order unravel of the slot
+            std::size_t rest = slot;
+            for(std::size_t d = cps.size(); d-- > 0;) {
+                coord[d] = rest % cps[d];
+                rest /= cps[d];
+            }
+            const uint64_t key = order == ShardBlobOrder::morton ? sharding_detail::interleaveBits(coord, bits)
+                                                                 : sharding_detail::hilbertKey(coord, bits);
+            keys[slot] = std::make_pair(key, slot);
+        }
+        std::sort(keys.begin(), keys.end());
+        placement.resize(nSlots);
+        for(std::size_t k = 0; k < nSlots; ++k) {
+            placement[k] = keys[k].second;
+        }
+    }
+
     // little-endian (de)serialization
     inline uint64_t readLE64(const char * p) {
         uint64_t v = 0;
@@ -98,37 +288,78 @@ namespace util {
         }
     }
 
-    // parse the index located at the end of the shard buffer; returns false if
-    // the shard is too small, the index checksum does not match, or an entry
-    // points outside of the data region (i.e. the shard is corrupt)
-    inline bool parseShardIndex(const std::vector<char> & shard, std::size_t nSlots,
-                                std::vector<ShardEntry> & entries) {
-        const std::size_t footer = 16 * nSlots + 4;  // index + crc32c
-        if(shard.size() < footer) {
+    // where the shard index is stored and how it is encoded
+    struct ShardIndexLayout {
+        bool atStart = false;   // index_location "start" (default: "end")
+        bool checksum = true;   // crc32c index codec behind the bytes codec
+    };
+
+    // size of the encoded shard index (index + crc32c, if any)
+    inline std::size_t shardIndexSize(const std::size_t nSlots,
+                                      const ShardIndexLayout & layout = ShardIndexLayout()) {
+        return 16 * nSlots + (layout.checksum ? 4 : 0);
+    }
+
+    // offset of the encoded index in a shard of `shardSize` bytes (at least as large
+    // as the index)
+    inline std::size_t shardIndexOffset(const std::size_t shardSize, const std::size_t nSlots,
+                                        const ShardIndexLayout & layout = ShardIndexLayout()) {
+        return layout.atStart ? 0 : shardSize - shardIndexSize(nSlots, layout);
+    }
+
+    // parse the encoded shard index `index` (shardIndexSize(nSlots, layout) bytes) of a
+    // shard with `shardSize` bytes in total; returns false if the shard is too small, the
+    // index checksum does not match, or an entry points outside of the data region
+    // (i.e. the shard is corrupt)
+    inline bool parseShardIndexBytes(const char * index, const std::size_t shardSize, std::size_t nSlots,
+                                     std::vector<ShardEntry> & entries,
+                                     const ShardIndexLayout & layout = ShardIndexLayout()) {
+        const std::size_t indexSize = shardIndexSize(nSlots, layout);
+        if(shardSize < indexSize) {
             return false;
         }
-        const std::size_t indexStart = shard.size() - footer;
+        const std::size_t dataBegin = layout.atStart ? indexSize : 0;
+        const std::size_t dataEnd = layout.atStart ? shardSize : shardSize - indexSize;
         // validate the crc32c that buildShard stores behind the index
-        const uint32_t storedCrc = readLE32(shard.data() + shard.size() - 4);
-        if(crc32c(shard.data() + indexStart, 16 * nSlots) != storedCrc) {
-            return false;
+        if(layout.checksum) {
+            const uint32_t storedCrc = readLE32(index + 16 * nSlots);
+            if(crc32c(index, 16 * nSlots) != storedCrc) {
+                return false;
+            }
         }
         entries.resize(nSlots);
         for(std::size_t s = 0; s < nSlots; ++s) {
-            const char * p = shard.data() + indexStart + 16 * s;
+            const char * p = index + 16 * s;
             entries[s].offset = readLE64(p);
             entries[s].nbytes = readLE64(p + 8);
             // bound non-empty entries by the data region so corrupt offsets can
             // never cause out-of-bounds reads downstream
             if(!entries[s].empty() &&
-               (entries[s].offset > indexStart ||
-                entries[s].nbytes > indexStart - entries[s].offset)) {
+               (entries[s].offset < dataBegin || entries[s].offset > dataEnd ||
+                entries[s].nbytes > dataEnd - entries[s].offset)) {
                 return false;
             }
         }
         return true;
     }
 
+    // parse the index of a whole shard buffer
+    inline bool parseShardIndex(const char * shard, const std::size_t shardSize, std::size_t nSlots,
+                                std::vector<ShardEntry> & entries,
+                                const ShardIndexLayout & layout = ShardIndexLayout()) {
+        if(shardSize < shardIndexSize(nSlots, layout)) {
+            return false;
+        }
+        return parseShardIndexBytes(shard + shardIndexOffset(shardSize, nSlots, layout),
+                                    shardSize, nSlots, entries, layout);
+    }
+
+    inline bool parseShardIndex(const std::vector<char> & shard, std::size_t nSlots,
+                                std::vector<ShardEntry> & entries,
+                                const ShardIndexLayout & layout = ShardIndexLayout()) {
+        return parseShardIndex(shard.data(), shard.size(), nSlots, entries, layout);
+    }
+
     // extract the per-slot inner chunk blobs from a shard (empty slots -> empty vector)
     inline void extractShardBlobs(const std::vector<char> & shard,
                                   const std::vector<ShardEntry> & entries,
@@ -148,15 +379,44 @@ namespace util {
         }
     }
 
+    // append the encoded shard index (index region + crc32c over the index bytes, if
+    // any) to `out`
+    inline void appendShardIndex(const std::vector<ShardEntry> & entries,
+                                 std::vector<char> & out,
+                                 const ShardIndexLayout & layout = ShardIndexLayout()) {
+        const std::size_t indexStart = out.size();
+        out.reserve(indexStart + shardIndexSize(entries.size(), layout));
+        for(const auto & entry : entries) {
+            writeLE64(out, entry.offset);
+            writeLE64(out, entry.nbytes);
+        }
+        if(layout.checksum) {
+            const uint32_t crc = crc32c(out.data() + indexStart, out.size() - indexStart);
+            writeLE32(out, crc);
+        }
+    }
+
     // build a shard file from per-slot inner chunk blobs (empty vector -> empty slot)
+    // and report its index entries; the blobs are stored in the order of `placement`
+    // (see shardBlobPlacement; empty: C order)
     inline void buildShard(const std::vector<std::vector<char>> & blobs,
-                           std::vector<char> & out) {
+                           std::vector<char> & out,
+                           std::vector<ShardEntry> & entries,
+                           const ShardIndexLayout & layout = ShardIndexLayout(),
+                           const std::vector<std::size_t> & placement = std::vector<std::size_t>()) {
         const std::size_t nSlots = blobs.size();
         out.clear();
-        std::vector<ShardEntry> entries(nSlots);
+        entries.resize(nSlots);
+
+        // the index goes in front of the data region, so make room for it first
+        const std::size_t indexSize = shardIndexSize(nSlots, layout);
+        if(layout.atStart) {
+            out.resize(indexSize);
+        }
 
         // data region
-        for(std::size_t s = 0; s < nSlots; ++s) {
+        for(std::size_t k = 0; k < nSlots; ++k) {
+            const std::size_t s = placement.empty() ? k : placement[k];
             if(blobs[s].empty()) {
                 entries[s] = ShardEntry{SHARD_EMPTY, SHARD_EMPTY};
             } else {
@@ -166,16 +426,19 @@ namespace util {
             }
         }
 
-        // index region + crc32c over the index bytes
-        std::vector<char> index;
-        index.reserve(16 * nSlots);
-        for(std::size_t s = 0; s < nSlots; ++s) {
-            writeLE64(index, entries[s].offset);
-            writeLE64(index, entries[s].nbytes);
+        if(layout.atStart) {
+            std::vector<char> index;
+            appendShardIndex(entries, index, layout);
+            std::copy(index.begin(), index.end(), out.begin());
+        } else {
+            appendShardIndex(entries, out, layout);
         }
-        const uint32_t crc = crc32c(index.data(), index.size());
-        out.insert(out.end(), index.begin(), index.end());
-        writeLE32(out, crc);
+    }
+
+    inline void buildShard(const std::vector<std::vector<char>> & blobs,
+                           std::vector<char> & out) {
+        std::vector<ShardEntry> entries;
+        buildShard(blobs, out, entries);
     }
 
     // true if every slot is empty (used to decide whether to delete the shard file)
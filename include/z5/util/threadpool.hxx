@@ -2,6 +2,7 @@
 #include <functional>
 #include <thread>
 #include <atomic>
+#include <chrono>
 #include <vector>
 #include <future>
 #include <mutex>
@@ -9,7 +10,9 @@
 #include <condition_variable>
 #include <stdexcept>
 #include <cmath>
+#include <memory>
 #include <numeric>
+#include <type_traits>
 
 /*
  * Copied and slightly adapted from
@@ -128,6 +131,7 @@ class ThreadPool
      */
     ThreadPool(const ParallelOptions & options)
     :   stop(false),
+        nActive(0),
         busy(0),
         processed(0)
     {
@@ -146,6 +150,7 @@ class ThreadPool
      */
     ThreadPool(const int n)
     :   stop(false),
+        nActive(0),
         busy(0),
         processed(0)
     {
@@ -183,18 +188,32 @@ class ThreadPool
     }
 
     /**
-     * Return the number of worker threads.
+     * Return the number of (active) worker threads.
      */
     std::size_t nThreads() const
     {
-        return workers.size();
+        return nActive.load();
     }
 
+    /**
+     * Change the number of active workers. Growing launches the missing threads,
+     * shrinking parks the surplus workers: they finish their current task and then
+     * sleep until the pool grows again. Hence resizing is safe while tasks are
+     * queued or running (this is what lets the process-wide pool, see
+     * sharedThreadPool, adapt to the requested number of threads). Shrinking to
+     * zero workers runs the tasks still queued on the calling thread before it
+     * returns, since no worker is left to pick them up.
+     */
+    void resize(const std::size_t n);
+
 private:
 
     // helper function to init the thread pool
     void init(const ParallelOptions & options);
 
+    // the loop run by worker 'ti'
+    void workerLoop(const std::size_t ti);
+
     // need to keep track of threads so we can join them
     std::vector<std::thread> workers;
 
@@ -204,52 +223,103 @@ private:
     // synchronization
     std::mutex queue_mutex;
     std::condition_variable worker_condition;
+    std::condition_variable park_condition;
     std::condition_variable finish_condition;
     bool stop;
+    // workers with an id >= nActive are parked (written under queue_mutex)
+    std::atomic<std::size_t> nActive;
     std::atomic<unsigned int> busy, processed;
 };
 
 inline void ThreadPool::init(const ParallelOptions & options)
 {
-    const std::size_t actualNThreads = options.getNumThreads();
-    for(std::size_t ti = 0; ti<actualNThreads; ++ti)
+    resize(options.getNumThreads());
+}
+
+inline void ThreadPool::workerLoop(const std::size_t ti)
+{
+    for(;;)
     {
-        workers.emplace_back(
-            [ti,this]
+        std::function<void(int)> task;
+        {
+            std::unique_lock<std::mutex> lock(this->queue_mutex);
+
+            // parked workers sleep on their own condition, so the notify_one of
+            // enqueue always reaches an active worker
+            this->park_condition.wait(lock, [this, ti]{ return this->stop || ti < this->nActive; });
+            // wait while stop == false AND the queue is empty
+            this->worker_condition.wait(lock, [this, ti]{
+                return this->stop || ti >= this->nActive || !this->tasks.empty();
+            });
+            // parked by a concurrent resize: hand a possibly consumed wakeup on
+            // to an active worker and go to sleep
+            if(!stop && ti >= nActive)
             {
-                for(;;)
-                {
-                    std::function<void(int)> task;
-                    {
-                        std::unique_lock<std::mutex> lock(this->queue_mutex);
-
-                        // wait while stop == false AND the queue is empty
-                        this->worker_condition.wait(lock, [this]{ return this->stop || !this->tasks.empty(); });
-                        // once stop is set (the pool is being destroyed) remaining tasks are
-                        // DISCARDED, not executed: the destructor may run while an exception
-                        // unwinds the enqueueing caller's stack, so queued tasks could touch
-                        // captures that are already destroyed. Callers that need completion
-                        // wait on the task futures (as parallel_foreach does).
-                        if(stop)
-                        {
-                            return;
-                        }
-                        ++busy;
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
-                        lock.unlock();
-                        task(ti);
-                        // update the state under the mutex so a waitFinished caller that just
-                        // evaluated its predicate cannot miss the notification (lost wakeup)
-                        lock.lock();
-                        ++processed;
-                        --busy;
-                        lock.unlock();
-                        finish_condition.notify_one();
-                    }
-                }
+                if(!tasks.empty())
+                    worker_condition.notify_one();
+                continue;
             }
-        );
+            // once stop is set (the pool is being destroyed) remaining tasks are
+            // DISCARDED, not executed: the destructor may run while an exception
+            // unwinds the enqueueing caller's stack, so queued tasks could touch
+            // captures that are already destroyed. Callers that need completion
+            // wait on the task futures (as parallel_foreach does).
+            if(stop)
+            {
+                return;
+            }
+            ++busy;
+            task = std::move(this->tasks.front());
+            this->tasks.pop();
+            lock.unlock();
+            task(ti);
+            // update the state under the mutex so a waitFinished caller that just
+            // evaluated its predicate cannot miss the notification (lost wakeup)
+            lock.lock();
+            ++processed;
+            --busy;
+            lock.unlock();
+            finish_condition.notify_one();
+        }
+    }
+}
+
+inline void ThreadPool::resize(const std::size_t n)
+{
+    std::queue<std::function<void(int)> > orphaned;
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        if(stop)
+            throw std::runtime_error("resize on stopped ThreadPool");
+        // workers are only ever added; ids >= nActive are parked, not joined
+        for(std::size_t ti = workers.size(); ti < n; ++ti)
+        {
+            workers.emplace_back([ti, this]{ workerLoop(ti); });
+        }
+        nActive = n;
+        // no worker is left for the queued tasks: take them over (they count as
+        // busy, so waitFinished keeps waiting for them)
+        if(n == 0)
+        {
+            std::swap(orphaned, tasks);
+            busy += static_cast<unsigned int>(orphaned.size());
+        }
+    }
+    // wake re-activated workers and let surplus workers park
+    park_condition.notify_all();
+    worker_condition.notify_all();
+
+    while(!orphaned.empty())
+    {
+        auto task = std::move(orphaned.front());
+        orphaned.pop();
+        task(0);
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            ++processed;
+            --busy;
+        }
+        finish_condition.notify_one();
     }
 }
 
@@ -259,6 +329,7 @@ inline ThreadPool::~ThreadPool()
         std::unique_lock<std::mutex> lock(queue_mutex);
         stop = true;
     }
+    park_condition.notify_all();
     worker_condition.notify_all();
     for(std::thread &worker: workers)
         worker.join();
@@ -274,21 +345,27 @@ ThreadPool::enqueueReturning(F&& f)
     auto task = std::make_shared<PackageType>(f);
     auto res = task->get_future();
 
-    if(workers.size()>0){
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
+    // decide under the lock, so that a concurrent resize(0) cannot strand the task
+    // in the queue after the check
+    bool queued = false;
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
 
-            // don't allow enqueueing after stopping the pool
-            if(stop)
-                throw std::runtime_error("enqueue on stopped ThreadPool");
+        // don't allow enqueueing after stopping the pool
+        if(stop)
+            throw std::runtime_error("enqueue on stopped ThreadPool");
 
+        if(nActive>0){
             tasks.emplace(
                 [task](int tid)
                 {
                     (*task)(tid);
                 }
             );
+            queued = true;
         }
+    }
+    if(queued){
         worker_condition.notify_one();
     }
     else{
@@ -478,6 +555,395 @@ inline void parallel_foreach_single_thread(
     // NIFTY_CHECK(n == nItems || nItems == 0, "parallel_foreach(): Mismatch between num items and begin/end.");
 }
 
+/********************************************************/
+/*                                                      */
+/*               work-stealing parallel loop            */
+/*                                                      */
+/********************************************************/
+
+namespace stealing_detail {
+
+    // Grains are sized adaptively so that one grain takes about this long:
+    // cheap items are claimed in bulk (amortizing the range lock), expensive
+    // ones (chunk IO / codecs) one at a time (keeping the rest stealable).
+    constexpr double TARGET_GRAIN_NS = 50000.;
+
+    // A runner's share of the iteration space. The owner claims grains from the
+    // front, idle runners steal the back half. Each range has its own lock and
+    // cache line, so runners never contend on a shared queue or counter.
+    struct alignas(64) WorkRange {
+        std::mutex mutex;
+        std::size_t begin = 0;
+        std::size_t end = 0;
+    };
+
+    // State of one parallel loop. The caller waits until every item is
+    // accounted for in 'done'. Runners that start after all items were claimed
+    // return without touching the functor, so queued runners may outlive the
+    // call (they only hold the state).
+    struct LoopState {
+        LoopState(const std::size_t n, const std::size_t nRunners, const std::size_t grain)
+        :   nItems(n), grainSize(grain), ranges(nRunners), cancelled(false), done(0)
+        {
+            for(std::size_t r = 0; r < nRunners; ++r)
+            {
+                ranges[r].begin = r * n / nRunners;
+                ranges[r].end = (r + 1) * n / nRunners;
+            }
+        }
+        const std::size_t nItems;
+        // 0: adaptive, else fixed number of items per claim
+        const std::size_t grainSize;
+        std::vector<WorkRange> ranges;
+        std::atomic<bool> cancelled;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::size_t done;
+        std::exception_ptr error;
+    };
+
+    // claim up to 'grain' items from the front of the own range (at most half of
+    // what is left, so the rest stays stealable)
+    inline bool claim(WorkRange & range, const std::size_t grain,
+                      std::size_t & first, std::size_t & last)
+    {
+        std::lock_guard<std::mutex> lock(range.mutex);
+        const std::size_t remaining = range.end - range.begin;
+        if(remaining == 0)
+            return false;
+        const std::size_t n = (std::min)(grain, (std::max<std::size_t>)(remaining / 2, 1));
+        first = range.begin;
+        last = first + n;
+        range.begin = last;
+        return true;
+    }
+
+    // move the back half of another runner's range into the (empty) own range
+    inline bool steal(LoopState & state, const std::size_t runner)
+    {
+        const std::size_t nRunners = state.ranges.size();
+        for(std::size_t k = 1; k < nRunners; ++k)
+        {
+            WorkRange & victim = state.ranges[(runner + k) % nRunners];
+            std::size_t first, last;
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                const std::size_t remaining = victim.end - victim.begin;
+                if(remaining == 0)
+                    continue;
+                first = victim.end - (remaining + 1) / 2;
+                last = victim.end;
+                victim.end = first;
+            }
+            WorkRange & own = state.ranges[runner];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.begin = first;
+            own.end = last;
+            return true;
+        }
+        return false;
+    }
+
+    // drop all unclaimed items after a failure; returns how many were dropped
+    inline std::size_t cancel(LoopState & state)
+    {
+        state.cancelled = true;
+        std::size_t dropped = 0;
+        for(auto & range : state.ranges)
+        {
+            std::lock_guard<std::mutex> lock(range.mutex);
+            dropped += range.end - range.begin;
+            range.begin = range.end;
+        }
+        return dropped;
+    }
+
+    template<class F>
+    inline void runLoop(LoopState & state, F & f, const std::size_t runner)
+    {
+        typedef std::chrono::steady_clock Clock;
+        const bool adaptive = state.grainSize == 0;
+        std::size_t grain = adaptive ? 1 : state.grainSize;
+        double nsPerItem = 0.;
+        std::size_t nDone = 0;
+        for(;;)
+        {
+            std::size_t first, last;
+            if(!claim(state.ranges[runner], grain, first, last))
+            {
+                if(state.cancelled || !steal(state, runner))
+                    break;
+                continue;
+            }
+            const auto t0 = Clock::now();
+            for(std::size_t i = first; i < last; ++i)
+            {
+                // items of a claimed grain are skipped (but counted) after a failure
+                if(!state.cancelled)
+                {
+                    try {
+                        f(static_cast<int>(runner), i);
+                    }
+                    catch(...) {
+                        nDone += cancel(state);
+                        std::lock_guard<std::mutex> lock(state.mutex);
+                        if(!state.error)
+                            state.error = std::current_exception();
+                    }
+                }
+                ++nDone;
+            }
+            if(adaptive)
+            {
+                const double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+                const double perItem = ns / double(last - first);
+                nsPerItem = nsPerItem == 0. ? perItem : 0.5 * (nsPerItem + perItem);
+                grain = nsPerItem > 0. ?
+                    static_cast<std::size_t>((std::max)(1., TARGET_GRAIN_NS / nsPerItem)) : 2 * grain;
+            }
+        }
+        bool finished;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.done += nDone;
+            finished = state.done == state.nItems;
+        }
+        if(finished)
+            state.cv.notify_all();
+    }
+
+} // namespace stealing_detail
+
+/** \brief Call <tt>f(runnerId, i)</tt> for all <tt>i</tt> in <tt>[0, nItems)</tt> with work stealing.
+
+    The iteration space is split into one contiguous range per runner (at most
+    <tt>pool.nThreads() + 1</tt> runners: the calling thread is runner 0 and
+    takes part, so nested loops cannot deadlock). A runner claims grains from
+    the front of its range; once it is empty it steals the back half of another
+    runner's range, which evens out uneven item costs at the tail.
+    <tt>runnerId</tt> is unique among the runners, so it can index per-thread
+    state. With <tt>grainSize = 0</tt> the grain adapts to the measured item
+    cost (cheap items are claimed in bulk, expensive ones one by one);
+    otherwise at most <tt>grainSize</tt> items are claimed at once. The first
+    exception is rethrown once all running items have finished; the remaining
+    items are skipped.
+*/
+template<class F>
+inline void parallel_foreach_stealing(
+    ThreadPool & pool,
+    std::size_t nRunners,
+    const std::size_t nItems,
+    F && f,
+    const std::size_t grainSize = 0)
+{
+    if(nItems == 0)
+        return;
+    nRunners = (std::min)((std::min)(nRunners, pool.nThreads() + 1), nItems);
+    if(nRunners <= 1)
+    {
+        for(std::size_t i = 0; i < nItems; ++i)
+            f(0, i);
+        return;
+    }
+
+    auto state = std::make_shared<stealing_detail::LoopState>(nItems, nRunners, grainSize);
+    for(std::size_t r = 1; r < nRunners; ++r)
+    {
+        pool.enqueue([state, &f, r](int)
+        {
+            stealing_detail::runLoop(*state, f, r);
+        });
+    }
+    stealing_detail::runLoop(*state, f, 0);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&state]{ return state->done == state->nItems; });
+    if(state->error)
+        std::rethrow_exception(state->error);
+}
+
+
+/********************************************************/
+/*                                                      */
+/*                  shared thread pool                  */
+/*                                                      */
+/********************************************************/
+
+namespace shared_pool_detail {
+
+    struct PoolConfig {
+        std::mutex mutex;
+        // false: grow on demand to the largest requested number of threads,
+        // true: fixed size set via setSharedThreadPoolSize
+        bool fixed = false;
+    };
+
+    inline PoolConfig & config()
+    {
+        static PoolConfig cfg;
+        return cfg;
+    }
+
+} // namespace shared_pool_detail
+
+/** \brief The process-wide thread pool.
+
+    Created lazily (without workers) on first use and shared by all
+    <tt>parallel_foreach(nThreads, ...)</tt> calls, hence by the sub-array
+    drivers and the <tt>parallel_for_each_*</tt> helpers. Calls never construct
+    or join threads: by default the pool grows on demand to the largest number
+    of threads requested so far, see <tt>setSharedThreadPoolSize</tt>.
+*/
+inline ThreadPool & sharedThreadPool()
+{
+    static ThreadPool pool(ParallelOptions::NoThreads);
+    return pool;
+}
+
+/** \brief Fix the number of workers of the shared pool.
+
+    <tt>n</tt> may be one of the <tt>ParallelOptions</tt> constants. A loop
+    runs on the calling thread plus at most <tt>n</tt> workers, so
+    <tt>n = 0</tt> makes every call sequential (the tasks still queued then run
+    on the thread that sets the size). Safe to call at any time.
+*/
+inline void setSharedThreadPoolSize(const int n)
+{
+    auto & cfg = shared_pool_detail::config();
+    std::lock_guard<std::mutex> lock(cfg.mutex);
+    cfg.fixed = true;
+    sharedThreadPool().resize(ParallelOptions(n).getNumThreads());
+}
+
+/** \brief Current number of workers of the shared pool.
+*/
+inline std::size_t sharedThreadPoolSize()
+{
+    return sharedThreadPool().nThreads();
+}
+
+/** \brief Grow the shared pool to at least <tt>n</tt> workers (unless its size is fixed).
+*/
+inline ThreadPool & growSharedThreadPool(const std::size_t n)
+{
+    auto & pool = sharedThreadPool();
+    auto & cfg = shared_pool_detail::config();
+    std::lock_guard<std::mutex> lock(cfg.mutex);
+    if(!cfg.fixed && pool.nThreads() < n)
+        pool.resize(n);
+    return pool;
+}
+
+/** \brief Call <tt>f(runnerId, i)</tt> for all <tt>i</tt> in <tt>[0, nItems)</tt> on the shared pool.
+
+    Runs <tt>parallel_foreach_stealing</tt> with at most
+    <tt>ParallelOptions(nThreads).getActualNumThreads()</tt> runners, so
+    <tt>runnerId</tt> is in <tt>[0, nThreads)</tt>; grows the pool first if
+    it is not fixed and too small.
+*/
+template<class F>
+inline void parallel_foreach_shared(
+    const int64_t nThreads,
+    const std::size_t nItems,
+    F && f,
+    const std::size_t grainSize = 0)
+{
+    const std::size_t nRunners = (std::min)(
+        static_cast<std::size_t>(ParallelOptions(nThreads).getActualNumThreads()), nItems);
+    auto & pool = nRunners > 1 ? growSharedThreadPool(nRunners - 1) : sharedThreadPool();
+    parallel_foreach_stealing(pool, nRunners, nItems, std::forward<F>(f), grainSize);
+}
+
+
+/********************************************************/
+/*                                                      */
+/*                  ThreadLocalScratch                  */
+/*                                                      */
+/********************************************************/
+
+namespace scratch_detail {
+    inline std::atomic<std::size_t> & generation()
+    {
+        static std::atomic<std::size_t> gen(0);
+        return gen;
+    }
+}
+
+// drop all ThreadLocalScratch objects (e.g. to release large buffers after a
+// big request): each thread recreates its object on its next acquisition
+inline void releaseThreadScratch()
+{
+    ++scratch_detail::generation();
+}
+
+/** \brief Per-thread scratch object of type <tt>S</tt> that persists across calls.
+
+    Lives in thread-local storage, so the workers of the shared pool (and the
+    calling threads) keep their buffers between parallel loops and small
+    requests pay no allocation. A nested acquisition on the same thread gets a
+    temporary object instead. The contents of a reused object are whatever
+    the previous user left.
+*/
+template<class S>
+class ThreadLocalScratch
+{
+  public:
+
+    template<class MAKE>
+    explicit ThreadLocalScratch(MAKE && make)
+    {
+        Slot & slot = threadSlot();
+        const std::size_t gen = scratch_detail::generation().load();
+        if(slot.inUse)
+        {
+            temp_.reset(new S(make()));
+            obj_ = temp_.get();
+            return;
+        }
+        if(!slot.obj || slot.generation != gen)
+        {
+            slot.obj.reset(new S(make()));
+            slot.generation = gen;
+        }
+        slot.inUse = true;
+        obj_ = slot.obj.get();
+        slot_ = &slot;
+    }
+
+    ~ThreadLocalScratch()
+    {
+        if(slot_)
+            slot_->inUse = false;
+    }
+
+    ThreadLocalScratch(const ThreadLocalScratch &) = delete;
+    ThreadLocalScratch & operator=(const ThreadLocalScratch &) = delete;
+
+    S & get()
+    {
+        return *obj_;
+    }
+
+  private:
+
+    struct Slot {
+        std::unique_ptr<S> obj;
+        std::size_t generation = 0;
+        bool inUse = false;
+    };
+
+    static Slot & threadSlot()
+    {
+        thread_local Slot slot;
+        return slot;
+    }
+
+    S * obj_ = nullptr;
+    Slot * slot_ = nullptr;
+    std::unique_ptr<S> temp_;
+};
+
+
 /** \brief Apply a functor to all items in a range in parallel.
 
     Create a thread pool (or use an existing one) to apply the functor \arg f
@@ -490,8 +956,10 @@ inline void parallel_foreach_single_thread(
     can provide the optional argument <tt>nItems</tt> to avoid the a
     <tt>std::distance(begin, end)</tt> call to compute the range's length.
 
-    Parameter <tt>nThreads</tt> controls the number of threads. <tt>parallel_foreach</tt>
-    will split the work into about three times as many parallel tasks.
+    Parameter <tt>nThreads</tt> controls the number of threads. With an explicit
+    pool, <tt>parallel_foreach</tt> will split the work into about three times as
+    many parallel tasks. The <tt>nThreads</tt> overloads run on the process-wide
+    pool (see <tt>parallel_foreach_shared</tt>) and never create threads per call.
     If <tt>nThreads = ParallelOptions::Auto</tt>, the number of threads is set to
     the machine default (<tt>std::thread::hardware_concurrency()</tt>).
 
@@ -506,7 +974,7 @@ inline void parallel_foreach_single_thread(
     namespace nifty {
     namespace parallel{
         // pass the desired number of threads or ParallelOptions::Auto
-        // (creates an internal thread pool accordingly)
+        // (runs on the process-wide shared pool)
         template<class ITER, class F>
         void parallel_foreach(int64_t nThreads,
                               ITER begin, ITER end,
@@ -608,9 +1076,29 @@ inline void parallel_foreach(
     F && f,
     const std::ptrdiff_t nItems = 0)
 {
-
-    ThreadPool pool(nThreads);
-    parallel_foreach(pool, begin, end, f, nItems);
+    typedef typename std::iterator_traits<ITER>::iterator_category Category;
+    if constexpr(std::is_base_of_v<std::random_access_iterator_tag, Category>)
+    {
+        parallel_foreach_shared(nThreads, static_cast<std::size_t>(std::distance(begin, end)),
+            [&f, begin](const int id, const std::size_t i){ f(id, begin[i]); });
+    }
+    else
+    {
+        // advance the shared iterator under a lock; the item is copied out so
+        // the call itself runs unlocked
+        std::mutex iterMutex;
+        ITER iter = begin;
+        const std::size_t n = nItems > 0 ? static_cast<std::size_t>(nItems)
+                                         : static_cast<std::size_t>(std::distance(begin, end));
+        parallel_foreach_shared(nThreads, n,
+            [&](const int id, const std::size_t){
+                std::unique_lock<std::mutex> lock(iterMutex);
+                auto item = *iter;
+                ++iter;
+                lock.unlock();
+                f(id, item);
+            });
+    }
 }
 
 template<class F>
@@ -619,11 +1107,8 @@ inline void parallel_foreach(
     std::ptrdiff_t nItems,
     F && f)
 {
-    std::vector<int64_t> indices(nItems);
-    std::iota(indices.begin(), indices.end(), 0);
-
-    parallel_foreach(nThreads, indices.begin(), indices.end(), std::forward<F>(f), nItems);
-
+    parallel_foreach_shared(nThreads, static_cast<std::size_t>(nItems),
+        [&f](const int id, const std::size_t i){ f(id, static_cast<int64_t>(i)); });
 }
 
 
@@ -633,10 +1118,8 @@ inline void parallel_foreach(
     std::ptrdiff_t nItems,
     F && f)
 {
-    std::vector<int64_t> indices(nItems);
-    std::iota(indices.begin(), indices.end(), 0);
-
-    parallel_foreach(threadpool, indices.begin(), indices.end(), std::forward<F>(f), nItems);
+    parallel_foreach_stealing(threadpool, threadpool.nThreads(), static_cast<std::size_t>(nItems),
+        [&f](const int id, const std::size_t i){ f(id, static_cast<int64_t>(i)); });
 }
 
 //@}
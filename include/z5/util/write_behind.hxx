@@ -0,0 +1,477 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "z5/common.hxx"
+#include "z5/util/local_file.hxx"
+
+
+namespace z5 {
+namespace util {
+
+    // Write-behind staging of remote objects: writes are committed to files in a local
+    // staging directory and uploaded by a fixed set of uploader threads, so the threads
+    // that produce the data do not wait for the remote store. Reads of an object with a
+    // pending upload are served from its staged file (see find), deletes drop the
+    // pending upload, and a newer write of an object replaces a pending one without
+    // reordering: the uploads of one object never overlap.
+    //
+    // Every staged file holds the object name, an opaque `context` (e.g. the client
+    // configuration), the size and a checksum of the bytes and the bytes; it is synced to
+    // the disk before the write returns. Files are removed once uploaded; the files left
+    // by a process that exited before uploading them are uploaded by the next WriteBehind
+    // opened on the directory (incomplete ones are set aside as *.corrupt). A directory
+    // is used by one process at a time (it is locked while open). Staged data takes at
+    // most `maxBytes`: further writes wait for uploads to finish, or fail with the upload
+    // error while uploads are failing. Failed uploads stay staged; flush retries them and
+    // reports the first error.
+    class WriteBehind {
+    public:
+        // uploads `data` to `object`; throws on failure
+        typedef std::function<void(const std::string & object, const std::string & context,
+                                   const std::vector<char> & data)> UploadFunction;
+
+        // a staged object; the file stays valid while a Staged is held
+        class Staged {
+        public:
+            Staged(const fs::path & path, const std::string & object, const std::string & context,
+                   const std::size_t headerSize, const std::size_t size, const uint64_t sequence)
+                : path_(path), object_(object), context_(context),
+                  headerSize_(headerSize), size_(size), sequence_(sequence) {}
+
+            ~Staged() {
+                if(done_) {
+                    std::error_code ec;
+                    fs::remove(path_, ec);
+                }
+            }
+
+            inline const std::string & object() const {return object_;}
+            inline const std::string & context() const {return context_;}
+            // size of the object (without the staging header)
+            inline std::size_t size() const {return size_;}
+            // increases with every staged write (of any object)
+            inline uint64_t sequence() const {return sequence_;}
+
+            // read `nBytes` from `offset` of the object
+            inline bool read(const std::size_t offset, const std::size_t nBytes, char * out) const {
+                if(offset + nBytes > size_) {
+                    return false;
+                }
+                std::ifstream file(path_, std::ios::binary);
+                file.seekg(headerSize_ + offset);
+                return static_cast<bool>(file.read(out, nBytes));
+            }
+
+            inline bool read(std::vector<char> & out) const {
+                out.resize(size_);
+                return read(0, size_, out.data());
+            }
+
+        private:
+            friend class WriteBehind;
+            fs::path path_;
+            std::string object_;
+            std::string context_;
+            std::size_t headerSize_;
+            std::size_t size_;
+            uint64_t sequence_;
+            // uploaded, replaced or deleted: the file goes with the last reference
+            bool done_ = false;
+        };
+        typedef std::shared_ptr<const Staged> StagedPtr;
+
+        WriteBehind(const fs::path & directory, const std::size_t nUploaders,
+                    const std::size_t maxBytes, UploadFunction upload)
+            : directory_(directory), maxBytes_(maxBytes), upload_(std::move(upload)) {
+            fs::create_directories(directory_);
+            lock();
+            resume();
+            const std::size_t n = std::max(nUploaders, std::size_t(1));
+            for(std::size_t i = 0; i < n; ++i) {
+                uploaders_.emplace_back([this](){uploadLoop();});
+            }
+        }
+
+        // Stops after the uploads in flight; objects not uploaded yet stay staged and
+        // are uploaded when the directory is opened again. Call flush before to upload
+        // everything.
+        ~WriteBehind() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            queued_.notify_all();
+            for(auto & uploader : uploaders_) {
+                uploader.join();
+            }
+#ifdef Z5_HAVE_FLOCK
+            if(lockFd_ >= 0) {
+                ::flock(lockFd_, LOCK_UN);
+                ::close(lockFd_);
+            }
+#endif
+        }
+
+        WriteBehind(const WriteBehind &) = delete;
+        WriteBehind & operator=(const WriteBehind &) = delete;
+
+        inline const fs::path & directory() const {return directory_;}
+        inline std::size_t maxBytes() const {return maxBytes_;}
+
+        // stage `size` bytes of `data` for upload to `object`; rethrows the error of a
+        // failed upload if the staged data is over budget
+        inline void stage(const std::string & object, const std::string & context,
+                          const char * data, const std::size_t size) {
+            uint64_t sequence;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                auto fits = [&](){
+                    return stagedBytes_ == 0 || stagedBytes_ + size <= maxBytes_;
+                };
+                done_.wait(lock, [&](){return fits() || error_;});
+                // failed uploads keep their bytes staged until flush retries them: do
+                // not wait for them, and do not stage beyond the budget either
+                if(!fits()) {
+                    std::rethrow_exception(error_);
+                }
+                sequence = nextSequence_++;
+                stagedBytes_ += size;
+            }
+            std::shared_ptr<Staged> staged;
+            try {
+                staged = writeStaged(sequence, object, context, data, size);
+            } catch(...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stagedBytes_ -= size;
+                done_.notify_all();
+                throw;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            enqueue(std::move(staged));
+        }
+
+        // the pending upload of `object` or a null pointer
+        inline StagedPtr find(const std::string & object) const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = slots_.find(object);
+            return it == slots_.end() ? StagedPtr() : StagedPtr(it->second.latest);
+        }
+
+        // Drop the pending upload of `object` before deleting it; waits for an upload of
+        // it in flight, so that it cannot land after the delete.
+        inline void erase(const std::string & object) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_.wait(lock, [&](){
+                auto it = slots_.find(object);
+                return it == slots_.end() || !it->second.inFlight;
+            });
+            auto it = slots_.find(object);
+            if(it != slots_.end()) {
+                finish(it->second.latest);
+                slots_.erase(it);
+            }
+        }
+
+        // erase the pending uploads of all objects whose name starts with `prefix`
+        inline void erasePrefix(const std::string & prefix) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto inPrefix = [&](const std::string & object){
+                return object.compare(0, prefix.size(), prefix) == 0;
+            };
+            done_.wait(lock, [&](){
+                for(auto it = slots_.lower_bound(prefix); it != slots_.end() && inPrefix(it->first); ++it) {
+                    if(it->second.inFlight) {
+                        return false;
+                    }
+                }
+                return true;
+            });
+            auto it = slots_.lower_bound(prefix);
+            while(it != slots_.end() && inPrefix(it->first)) {
+                finish(it->second.latest);
+                it = slots_.erase(it);
+            }
+        }
+
+        // Wait until every staged object is uploaded (retrying failed uploads once) and
+        // rethrow the first error of an upload that failed again, if any.
+        inline void flush() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            // let the uploads in flight finish first, so that they are retried if they fail
+            done_.wait(lock, [&](){
+                return std::none_of(slots_.begin(), slots_.end(), [](const auto & kv){
+                    return static_cast<bool>(kv.second.inFlight);
+                });
+            });
+            // the errors of the retried uploads are reported again if they fail again
+            error_ = nullptr;
+            for(auto & kv : slots_) {
+                if(kv.second.failed) {
+                    kv.second.failed = false;
+                    queue_.push_back(kv.first);
+                }
+            }
+            queued_.notify_all();
+            done_.wait(lock, [&](){
+                return std::all_of(slots_.begin(), slots_.end(), [](const auto & kv){
+                    return kv.second.failed;
+                });
+            });
+            // only the failed uploads are left
+            if(!slots_.empty()) {
+                auto error = error_;
+                error_ = nullptr;
+                if(error) {
+                    std::rethrow_exception(error);
+                }
+                throw std::runtime_error("z5: could not upload " + std::to_string(slots_.size()) +
+                                         " staged objects from " + directory_.string());
+            }
+        }
+
+        // number and bytes of the objects waiting for upload
+        inline std::size_t pending() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return slots_.size();
+        }
+
+        inline std::size_t stagedBytes() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return stagedBytes_;
+        }
+
+    private:
+        static constexpr char MAGIC[8] = {'z', '5', 's', 't', 'a', 'g', 'e', '2'};
+
+        struct Slot {
+            // the newest write of the object
+            std::shared_ptr<Staged> latest;
+            // the write being uploaded (the same or an older one)
+            std::shared_ptr<Staged> inFlight;
+            // the latest write failed to upload and waits for flush
+            bool failed = false;
+        };
+
+        // take the directory for this process
+        inline void lock() {
+#ifdef Z5_HAVE_FLOCK
+            const auto lockPath = directory_ / ".lock";
+            lockFd_ = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if(lockFd_ < 0) {
+                throw std::runtime_error("z5: cannot open staging directory " + directory_.string());
+            }
+            if(::flock(lockFd_, LOCK_EX | LOCK_NB) != 0) {
+                ::close(lockFd_);
+                throw std::runtime_error("z5: staging directory " + directory_.string() +
+                                         " is used by another process");
+            }
+#endif
+        }
+
+        // Pick up the objects staged by an earlier process, in the order they were written.
+        // Files that are not complete staged objects (cut off by a power loss, or foreign)
+        // are renamed to *.corrupt and left for inspection instead of being uploaded.
+        inline void resume() {
+            std::vector<std::pair<uint64_t, fs::path>> files;
+            for(const auto & entry : fs::directory_iterator(directory_)) {
+                const auto & path = entry.path();
+                if(path.extension() == ".tmp") {
+                    fs::remove(path);
+                } else if(path.extension() == ".obj") {
+                    const std::string stem = path.stem().string();
+                    if(stem.empty() || stem.size() > 16 ||
+                       stem.find_first_not_of("0123456789abcdef") != std::string::npos) {
+                        quarantine(path);
+                        continue;
+                    }
+                    files.emplace_back(std::stoull(stem, nullptr, 16), path);
+                }
+            }
+            std::sort(files.begin(), files.end());
+            for(const auto & file : files) {
+                std::ifstream in(file.second, std::ios::binary);
+                char magic[sizeof(MAGIC)];
+                std::string object, context;
+                uint64_t size, checksum;
+                if(!in.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+                   !local_file::readString(in, object) || !local_file::readString(in, context) ||
+                   !local_file::readValue(in, size) || !local_file::readValue(in, checksum)) {
+                    quarantine(file.second);
+                    continue;
+                }
+                const std::size_t headerSize = static_cast<std::size_t>(in.tellg());
+                std::error_code ec;
+                const auto fileSize = fs::file_size(file.second, ec);
+                std::vector<char> data;
+                if(ec || fileSize != headerSize + size) {
+                    quarantine(file.second);
+                    continue;
+                }
+                data.resize(size);
+                if(!in.read(data.data(), size) || local_file::fnv1a(data.data(), size) != checksum) {
+                    quarantine(file.second);
+                    continue;
+                }
+                stagedBytes_ += size;
+                enqueue(std::make_shared<Staged>(file.second, object, context,
+                                                 headerSize, size, file.first));
+                nextSequence_ = file.first + 1;
+            }
+        }
+
+        inline void quarantine(const fs::path & path) const {
+            std::error_code ec;
+            fs::rename(path, fs::path(path).replace_extension(".corrupt"), ec);
+        }
+
+        // write the staged file: to a temporary file first, which is synced before it is
+        // renamed into place (and the directory after), so that neither a crash nor a
+        // power loss leaves a partial object to resume
+        inline std::shared_ptr<Staged> writeStaged(const uint64_t sequence,
+                                                   const std::string & object,
+                                                   const std::string & context,
+                                                   const char * data, const std::size_t size) const {
+            char name[17];
+            std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(sequence));
+            const auto path = directory_ / (std::string(name) + ".obj");
+            const auto tmp = directory_ / (std::string(name) + ".tmp");
+            std::size_t headerSize;
+            bool ok;
+            {
+                std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+                file.write(MAGIC, sizeof(MAGIC));
+                local_file::writeString(file, object);
+                local_file::writeString(file, context);
+                local_file::writeValue(file, size);
+                local_file::writeValue(file, local_file::fnv1a(data, size));
+                headerSize = static_cast<std::size_t>(file.tellp());
+                file.write(data, size);
+                file.close();
+                ok = static_cast<bool>(file) && local_file::syncPath(tmp);
+            }
+            if(!ok) {
+                std::error_code ec;
+                fs::remove(tmp, ec);
+                throw std::runtime_error("z5: could not stage object " + object + " in " +
+                                         directory_.string());
+            }
+            fs::rename(tmp, path);
+            local_file::syncPath(directory_);
+            return std::make_shared<Staged>(path, object, context, headerSize, size, sequence);
+        }
+
+        // make `staged` the newest write of its object (mutex_ held)
+        inline void enqueue(std::shared_ptr<Staged> staged) {
+            auto & slot = slots_[staged->object()];
+            if(slot.latest && slot.latest != slot.inFlight) {
+                finish(slot.latest);
+            }
+            const bool queued = slot.latest && !slot.failed;
+            slot.latest = std::move(staged);
+            slot.failed = false;
+            // an object in flight is queued again when its upload is done
+            if(!queued && !slot.inFlight) {
+                queue_.push_back(slot.latest->object());
+                queued_.notify_one();
+            }
+        }
+
+        // release a write that was uploaded or is no longer needed (mutex_ held)
+        inline void finish(const std::shared_ptr<Staged> & staged) {
+            staged->done_ = true;
+            stagedBytes_ -= staged->size();
+            done_.notify_all();
+        }
+
+        inline void uploadLoop() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while(true) {
+                queued_.wait(lock, [&](){return stop_ || !queue_.empty();});
+                if(stop_) {
+                    return;
+                }
+                const std::string object = std::move(queue_.front());
+                queue_.pop_front();
+                auto it = slots_.find(object);
+                if(it == slots_.end() || it->second.inFlight || it->second.failed) {
+                    continue;
+                }
+                auto staged = it->second.latest;
+                it->second.inFlight = staged;
+                lock.unlock();
+
+                std::exception_ptr error;
+                try {
+                    std::vector<char> data;
+                    if(!staged->read(data)) {
+                        throw std::runtime_error("z5: could not read staged object " + staged->path_.string());
+                    }
+                    upload_(object, staged->context(), data);
+                } catch(...) {
+                    error = std::current_exception();
+                }
+
+                lock.lock();
+                it = slots_.find(object);
+                // erase waits for uploads in flight, so the slot is still there
+                auto & slot = it->second;
+                slot.inFlight.reset();
+                if(slot.latest != staged) {
+                    // replaced while uploading: upload the newer write
+                    finish(staged);
+                    queue_.push_back(object);
+                    queued_.notify_one();
+                } else if(error) {
+                    slot.failed = true;
+                    if(!error_) {
+                        error_ = error;
+                    }
+                } else {
+                    finish(staged);
+                    slots_.erase(it);
+                }
+                done_.notify_all();
+            }
+        }
+
+        fs::path directory_;
+        std::size_t maxBytes_;
+        UploadFunction upload_;
+#ifdef Z5_HAVE_FLOCK
+        int lockFd_ = -1;
+#endif
+
+        mutable std::mutex mutex_;
+        // signals new work for the uploaders / finished uploads and released bytes
+        std::condition_variable queued_;
+        std::condition_variable done_;
+        // the objects with pending writes, by name
+        std::map<std::string, Slot> slots_;
+        // the objects to upload, in the order they were written
+        std::deque<std::string> queue_;
+        std::size_t stagedBytes_ = 0;
+        uint64_t nextSequence_ = 0;
+        std::exception_ptr error_;
+        bool stop_ = false;
+        std::vector<std::thread> uploaders_;
+    };
+
+}
+}
@@ -1,6 +1,8 @@
+#include <chrono>
 #include <complex>
 #include <memory>
 #include <numeric>
+#include <tuple>
 
 #include <nanobind/nanobind.h>
 #include <nanobind/ndarray.h>
@@ -13,6 +15,7 @@
 #include "z5/multiarray/array_view.hxx"
 #include "z5/multiarray/array_access.hxx"
 #include "z5/multiarray/broadcast.hxx"
+#include "z5/util/async.hxx"
 
 
 namespace nb = nanobind;
@@ -68,6 +71,51 @@ namespace z5 {
     }
 
 
+    // Keep the python objects used by an asynchronous request (dataset, numpy array) alive
+    // until it has finished; the references are dropped on the completing thread, with
+    // the GIL held.
+    template<class... OBJECTS>
+    inline void keepAliveUntilDone(util::AsyncRequest & request, OBJECTS... objects) {
+        auto holder = std::make_shared<std::tuple<OBJECTS...>>(std::move(objects)...);
+        request.onDone([holder]() {
+            nb::gil_scoped_acquire gil;
+            *holder = std::tuple<OBJECTS...>();
+        });
+    }
+
+
+    template<class T>
+    inline util::AsyncRequest writePySubarrayAsync(const Dataset & ds,
+                                                   const nb::ndarray<nb::numpy, const T, nb::c_contig> in,
+                                                   const std::vector<std::size_t> & roiBegin,
+                                                   const int numberOfThreads) {
+        const auto view = constViewFromArray<T>(in);
+        util::AsyncRequest request;
+        {
+            nb::gil_scoped_release lift_gil;
+            request = multiarray::writeSubarrayAsync<T>(ds, view, roiBegin.begin(), numberOfThreads);
+        }
+        keepAliveUntilDone(request, nb::find(ds), in);
+        return request;
+    }
+
+
+    template<class T>
+    inline util::AsyncRequest readPySubarrayAsync(const Dataset & ds,
+                                                  nb::ndarray<nb::numpy, T, nb::c_contig> out,
+                                                  const std::vector<std::size_t> & roiBegin,
+                                                  const int numberOfThreads) {
+        const auto view = viewFromArray<T>(out);
+        util::AsyncRequest request;
+        {
+            nb::gil_scoped_release lift_gil;
+            request = multiarray::readSubarrayAsync<T>(ds, view, roiBegin.begin(), numberOfThreads);
+        }
+        keepAliveUntilDone(request, nb::find(ds), out);
+        return request;
+    }
+
+
     template<class T>
     inline void writePyScalar(const Dataset & ds,
                               const std::vector<std::size_t> & roiBegin,
@@ -194,6 +242,20 @@ namespace z5 {
                    nb::arg("n_threads")=1,
                    nb::call_guard<nb::gil_scoped_release>());
 
+        // export asynchronous sub-array IO (returns an AsyncRequest)
+        module.def("write_subarray_async",
+                   &writePySubarrayAsync<T>,
+                   nb::arg("ds"),
+                   nb::arg("in").noconvert(),
+                   nb::arg("roi_begin"),
+                   nb::arg("n_threads")=1);
+        module.def("read_subarray_async",
+                   &readPySubarrayAsync<T>,
+                   nb::arg("ds"),
+                   nb::arg("out").noconvert(),
+                   nb::arg("roi_begin"),
+                   nb::arg("n_threads")=1);
+
         // export write_chunk
         module.def("write_chunk",
                    &writePyChunk<T>,
@@ -208,8 +270,53 @@ namespace z5 {
     }
 
 
+    // handle of an asynchronous request, see util::AsyncRequest; wrapped into
+    // concurrent.futures.Future / awaitables on the python side
+    void exportAsyncRequest(nb::module_ & module) {
+        nb::class_<util::AsyncRequest>(module, "AsyncRequest")
+            .def("done", &util::AsyncRequest::ready)
+            .def("cancel", &util::AsyncRequest::cancel)
+            .def("cancelled", &util::AsyncRequest::cancelled)
+            // wait (at most timeout seconds); returns whether the request has finished
+            .def("wait", [](const util::AsyncRequest & request, const nb::object & timeout){
+                if(timeout.is_none()) {
+                    nb::gil_scoped_release lift_gil;
+                    request.wait();
+                    return true;
+                }
+                const double seconds = nb::cast<double>(timeout);
+                nb::gil_scoped_release lift_gil;
+                return request.waitFor(std::chrono::duration<double>(seconds));
+            }, nb::arg("timeout")=nb::none())
+            // wait and raise the request's error
+            .def("result", [](const util::AsyncRequest & request){
+                {
+                    nb::gil_scoped_release lift_gil;
+                    request.wait();
+                }
+                request.get();
+            })
+            // call fn() once the request has finished (on the thread that finished it)
+            .def("add_done_callback", [](util::AsyncRequest & request, nb::object fn){
+                auto holder = std::make_shared<nb::object>(std::move(fn));
+                request.onDone([holder]() {
+                    nb::gil_scoped_acquire gil;
+                    try {
+                        (*holder)();
+                    } catch(nb::python_error & e) {
+                        e.discard_as_unraisable("z5py.AsyncRequest done callback");
+                    }
+                    *holder = nb::object();
+                });
+            }, nb::arg("fn"))
+        ;
+    }
+
+
     void exportDataset(nb::module_ & module) {
 
+        exportAsyncRequest(module);
+
         auto dsClass = nb::class_<Dataset>(module, "DatasetImpl");
 
         dsClass
@@ -256,6 +363,20 @@ namespace z5 {
 
             .def("remove_chunk", &Dataset::removeChunk, nb::arg("chunk_id"),
                  nb::call_guard<nb::gil_scoped_release>())
+            .def("flush", &Dataset::flush, nb::call_guard<nb::gil_scoped_release>())
+
+            // decoded-chunk and stored-chunk caches (see set_chunk_cache_bytes and
+            // set_stored_chunk_cache_bytes)
+            .def_prop_ro("chunk_cache_hits", [](const Dataset & ds){return ds.chunkCache().hits();})
+            .def_prop_ro("chunk_cache_misses", [](const Dataset & ds){return ds.chunkCache().misses();})
+            .def_prop_ro("stored_chunk_cache_hits", [](const Dataset & ds){return ds.storedChunkCache().hits();})
+            .def_prop_ro("stored_chunk_cache_misses", [](const Dataset & ds){return ds.storedChunkCache().misses();})
+            .def("clear_chunk_cache", [](const Dataset & ds){
+                ds.chunkCache().clear();
+                ds.chunkCache().resetCounters();
+                ds.storedChunkCache().clear();
+                ds.storedChunkCache().resetCounters();
+            })
         ;
 
         // export I/O for all dtypes
@@ -28,10 +28,12 @@ namespace z5 {
                                    const std::string & dimension_separator,
                                    const int zarr_format,
                                    const std::vector<std::size_t> & shards,
-                                   const std::string & chunk_key_encoding){
+                                   const std::string & chunk_key_encoding,
+                                   const std::string & shard_index_location){
                 const nlohmann::json j = nlohmann::json::parse(copts);
                 return createDataset(root, key, dtype, shape, chunk_shape, compression, j, fill_value,
-                                     dimension_separator, zarr_format, chunk_key_encoding, shards);
+                                     dimension_separator, zarr_format, chunk_key_encoding, shards,
+                                     shard_index_location);
             },
             nb::arg("root"), nb::arg("key"),
             nb::arg("dtype"), nb::arg("shape"), nb::arg("chunks"),
@@ -42,6 +44,7 @@ namespace z5 {
             nb::arg("zarr_format")=2,
             nb::arg("shards")=std::vector<std::size_t>(),
             nb::arg("chunk_key_encoding")=std::string("default"),
+            nb::arg("shard_index_location")=std::string("end"),
             nb::call_guard<nb::gil_scoped_release>());
     }
 
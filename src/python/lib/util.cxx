@@ -1,8 +1,17 @@
+#include <stdexcept>
+
 #include <nanobind/nanobind.h>
 #include <nanobind/stl/string.h>
 
 #include "z5/dataset.hxx"
+#include "z5/filesystem/store.hxx"
 #include "z5/util/functions.hxx"
+#include "z5/util/pipeline.hxx"
+#include "z5/util/sharding.hxx"
+
+#ifdef WITH_S3
+#include "z5/s3/handle.hxx"
+#endif
 
 namespace nb = nanobind;
 
@@ -40,6 +49,112 @@ namespace z5 {
                    nb::arg("ds"), nb::arg("n_threads"),
                    nb::call_guard<nb::gil_scoped_release>());
 
+        // the process-wide thread pool used by all multi-threaded IO
+        module.def("set_thread_pool_size", &util::setSharedThreadPoolSize,
+                   nb::arg("n_threads"),
+                   nb::call_guard<nb::gil_scoped_release>());
+        module.def("get_thread_pool_size", &util::sharedThreadPoolSize);
+        module.def("release_thread_scratch", &util::releaseThreadScratch);
+        // number of concurrent storage reads of the staged read path (0: n_threads of the call)
+        module.def("set_read_io_concurrency", &util::setReadIoConcurrency, nb::arg("n"));
+        module.def("get_read_io_concurrency", &util::readIoConcurrency);
+        // likewise for the writers of the staged write path, and the byte budget of the
+        // compressed blobs queued for them
+        module.def("set_write_io_concurrency", &util::setWriteIoConcurrency, nb::arg("n"));
+        module.def("get_write_io_concurrency", &util::writeIoConcurrency);
+        module.def("set_write_queue_bytes", &util::setWriteQueueBytes, nb::arg("n_bytes"));
+        module.def("get_write_queue_bytes", &util::writeQueueBytes);
+        // batched filesystem reads via io_uring (where available)
+        module.def("set_use_io_uring", &filesystem::setUseIoUring, nb::arg("use"));
+        module.def("io_uring_enabled", &filesystem::ioUringEnabled);
+        // memory mapped reads of uncompressed chunks and shards (off by default: a file
+        // shortened while it is read raises SIGBUS)
+        module.def("set_use_mapped_reads", &filesystem::setUseMappedReads, nb::arg("use"));
+        // per-dataset cache of decoded chunks consulted by sub-array reads
+        module.def("set_chunk_cache_bytes", &util::setChunkCacheBytes, nb::arg("n_bytes"));
+        module.def("get_chunk_cache_bytes", &util::chunkCacheBytes);
+        // per-dataset cache of the stored (compressed) bytes of chunks and when it admits
+        // a chunk ("always" or "second_access")
+        module.def("set_stored_chunk_cache_bytes", &util::setStoredChunkCacheBytes, nb::arg("n_bytes"));
+        module.def("get_stored_chunk_cache_bytes", &util::storedChunkCacheBytes);
+        module.def("set_stored_chunk_cache_admission", [](const std::string & admission){
+            if(admission == "always") {
+                util::setStoredChunkCacheAdmission(util::CacheAdmission::always);
+            } else if(admission == "second_access") {
+                util::setStoredChunkCacheAdmission(util::CacheAdmission::secondAccess);
+            } else {
+                throw std::invalid_argument("Invalid cache admission " + admission +
+                                            ", expected 'always' or 'second_access'");
+            }
+        }, nb::arg("admission"));
+        module.def("get_stored_chunk_cache_admission", []() -> std::string {
+            return util::storedChunkCacheAdmission() == util::CacheAdmission::always ? "always" : "second_access";
+        });
+        // per-dataset cache of parsed shard indices
+        module.def("set_shard_index_cache_bytes", &util::setShardIndexCacheBytes, nb::arg("n_bytes"));
+        module.def("get_shard_index_cache_bytes", &util::shardIndexCacheBytes);
+        // write-back of write_chunk calls on sharded datasets
+        module.def("set_shard_write_back_bytes", &util::setShardWriteBackBytes, nb::arg("n_bytes"));
+        module.def("get_shard_write_back_bytes", &util::shardWriteBackBytes);
+        // in-place shard updates on the filesystem and when to compact shards
+        module.def("set_use_shard_append", &filesystem::setUseShardAppend, nb::arg("use"));
+        module.def("set_shard_compaction_ratio", &util::setShardCompactionRatio, nb::arg("ratio"));
+        module.def("get_shard_compaction_ratio", &util::shardCompactionRatio);
+        // order of the inner chunk blobs in newly written shards ("c", "morton", "hilbert")
+        module.def("set_shard_blob_order", [](const std::string & order){
+            if(order == "c") {
+                util::setShardBlobOrder(util::ShardBlobOrder::c);
+            } else if(order == "morton") {
+                util::setShardBlobOrder(util::ShardBlobOrder::morton);
+            } else if(order == "hilbert") {
+                util::setShardBlobOrder(util::ShardBlobOrder::hilbert);
+            } else {
+                throw std::invalid_argument("Invalid shard blob order " + order + ", expected c, morton or hilbert");
+            }
+        }, nb::arg("order"));
+        module.def("get_shard_blob_order", []() -> std::string {
+            switch(util::shardBlobOrder()) {
+                case util::ShardBlobOrder::morton: return "morton";
+                case util::ShardBlobOrder::hilbert: return "hilbert";
+                default: return "c";
+            }
+        });
+
+        #ifdef WITH_S3
+        // local disk cache of the objects read from S3 (revalidated by ETag)
+        module.def("set_s3_disk_cache", [](const std::string & directory, const std::size_t nBytes){
+            s3::setDiskCache(directory, nBytes);
+        }, nb::arg("directory"), nb::arg("n_bytes"));
+        module.def("set_s3_disk_cache_max_age", &s3::setDiskCacheMaxAge, nb::arg("seconds"));
+        // write-behind: chunks and shards are staged on a local disk and uploaded in the background
+        module.def("set_s3_write_behind", [](const std::string & directory, const std::size_t nUploaders,
+                                             const std::size_t maxBytes){
+            s3::setWriteBehind(directory, nUploaders, maxBytes);
+        }, nb::arg("directory"), nb::arg("n_uploaders"), nb::arg("max_bytes"),
+           nb::call_guard<nb::gil_scoped_release>());
+        module.def("flush_s3_writes", &s3::flushWrites, nb::call_guard<nb::gil_scoped_release>());
+        // number of S3 requests a batched read issues at once
+        module.def("set_s3_request_concurrency", &s3::setRequestConcurrency, nb::arg("n"));
+        module.def("get_s3_request_concurrency", &s3::requestConcurrency);
+        // large objects are uploaded in parts, concurrently
+        module.def("set_s3_multipart_upload", &s3::setMultipartUpload,
+                   nb::arg("threshold"), nb::arg("part_size"));
+        // retries with backoff, hedged GETs and what they did
+        module.def("set_s3_retries", &s3::setRetries, nb::arg("max_retries"), nb::arg("base_delay_ms"));
+        module.def("set_s3_hedging", &s3::setHedging, nb::arg("percentile"));
+        module.def("get_s3_request_metrics", [](){
+            const auto metrics = s3::requestMetrics();
+            nb::dict out;
+            out["retries"] = metrics.retries;
+            out["throttle_retries"] = metrics.throttleRetries;
+            out["hedges"] = metrics.hedges;
+            out["hedge_wins"] = metrics.hedgeWins;
+            out["hedge_delay_us"] = metrics.hedgeDelay;
+            return out;
+        });
+        module.def("reset_s3_request_metrics", &s3::resetRequestMetrics);
+        #endif
+
         exportFileMode(module);
     }
 
@@ -34,12 +34,67 @@ performance comparison against zarr-python and tensorstore.
 __docformat__ = "google"
 
 from .file import File, N5File, ZarrFile, S3File
+# objects read from S3 can be cached on a local disk (s3 builds only)
+from .file import set_s3_disk_cache, set_s3_disk_cache_max_age
+# ... and writes to S3 can be staged there and uploaded in the background
+from .file import set_s3_write_behind, flush_s3_writes
+# number of concurrent S3 requests of a read
+from .file import set_s3_request_concurrency, get_s3_request_concurrency
+# ... and of the multipart uploads of large objects
+from .file import set_s3_multipart_upload
+# ... and of retries and hedging against slow or throttled requests
+from .file import (set_s3_retries, set_s3_hedging,
+                   get_s3_request_metrics, reset_s3_request_metrics)
 from .dataset import Dataset
 from .group import Group
 from .attribute_manager import set_json_encoder, set_json_decoder
+# multi-threaded reads / writes share one lazily created process-wide thread pool
+from ._z5py import set_thread_pool_size, get_thread_pool_size
+# reads / writes overlap storage requests with (de)compression; these bound the requests
+# in flight and the compressed data waiting to be written
+from ._z5py import set_read_io_concurrency, get_read_io_concurrency
+from ._z5py import set_write_io_concurrency, get_write_io_concurrency
+from ._z5py import set_write_queue_bytes, get_write_queue_bytes
+# on linux, filesystem reads are batched with io_uring where the kernel supports it
+from ._z5py import set_use_io_uring, io_uring_enabled
+# uncompressed chunks and shards can be memory mapped for reading (opt-in)
+from ._z5py import set_use_mapped_reads
+# datasets can cache decoded chunks, so overlapping reads decompress each chunk once
+from ._z5py import set_chunk_cache_bytes, get_chunk_cache_bytes
+# ... and the stored (compressed) bytes of chunks, so repeated reads skip the fetch
+from ._z5py import set_stored_chunk_cache_bytes, get_stored_chunk_cache_bytes
+from ._z5py import set_stored_chunk_cache_admission, get_stored_chunk_cache_admission
+# sharded datasets cache the indices of the shards they touch
+from ._z5py import set_shard_index_cache_bytes, get_shard_index_cache_bytes
+# small writes to filesystem shards append to the shard, which is compacted once it holds
+# too many replaced inner chunks
+from ._z5py import set_use_shard_append, set_shard_compaction_ratio, get_shard_compaction_ratio
+# shards can store their inner chunks along a morton or hilbert curve, so that compact
+# regions are read with few requests
+from ._z5py import set_shard_blob_order, get_shard_blob_order
+# write_chunk on sharded datasets can be held back and written once per shard (Dataset.flush)
+from ._z5py import set_shard_write_back_bytes, get_shard_write_back_bytes
 
 __all__ = ['File', 'N5File', 'ZarrFile', 'S3File', 'Dataset', 'Group',
-           'set_json_encoder', 'set_json_decoder']
+           'set_json_encoder', 'set_json_decoder',
+           'set_thread_pool_size', 'get_thread_pool_size',
+           'set_read_io_concurrency', 'get_read_io_concurrency',
+           'set_write_io_concurrency', 'get_write_io_concurrency',
+           'set_write_queue_bytes', 'get_write_queue_bytes',
+           'set_use_io_uring', 'io_uring_enabled', 'set_use_mapped_reads',
+           'set_chunk_cache_bytes', 'get_chunk_cache_bytes',
+           'set_stored_chunk_cache_bytes', 'get_stored_chunk_cache_bytes',
+           'set_stored_chunk_cache_admission', 'get_stored_chunk_cache_admission',
+           'set_shard_index_cache_bytes', 'get_shard_index_cache_bytes',
+           'set_use_shard_append', 'set_shard_compaction_ratio', 'get_shard_compaction_ratio',
+           'set_shard_write_back_bytes', 'get_shard_write_back_bytes',
+           'set_shard_blob_order', 'get_shard_blob_order',
+           'set_s3_disk_cache', 'set_s3_disk_cache_max_age',
+           'set_s3_write_behind', 'flush_s3_writes',
+           'set_s3_request_concurrency', 'get_s3_request_concurrency',
+           'set_s3_multipart_upload',
+           'set_s3_retries', 'set_s3_hedging',
+           'get_s3_request_metrics', 'reset_s3_request_metrics']
 
 # Version is single-sourced from include/z5/z5.hxx. CMake generates _version.py
 # from those macros at build time (see src/python/_version.py.in), covering the
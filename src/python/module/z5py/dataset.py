@@ -7,6 +7,8 @@ methods. Datasets are not created directly; use
 :meth:`z5py.Group.create_dataset` / :meth:`z5py.Group.require_dataset` or the
 ``[]`` operator of a :class:`z5py.File` / :class:`z5py.Group`.
 """
+import asyncio
+import concurrent.futures
 import numbers
 import json
 
@@ -33,6 +35,38 @@ def _navigate(file_obj, name):
     return obj
 
 
+def _request_future(request, result=None):
+    """ Wrap an asynchronous request of the C++ library in a Future.
+
+    Cancelling the future cancels the request; the future resolves to ``result``
+    once the request has finished.
+    """
+    future = concurrent.futures.Future()
+
+    def _cancel(fut):
+        if fut.cancelled():
+            request.cancel()
+
+    def _done(req):
+        try:
+            if req.cancelled():
+                future.cancel()
+                return
+            try:
+                req.result()
+            except Exception as e:
+                future.set_exception(e)
+            else:
+                future.set_result(result)
+        except concurrent.futures.InvalidStateError:
+            # the future was cancelled in the meantime
+            pass
+
+    future.add_done_callback(_cancel)
+    request.add_done_callback(_done)
+    return future
+
+
 def _unpickle_dataset(file_obj, name, n_threads):
     ds = _navigate(file_obj, name)
     ds.n_threads = n_threads
@@ -239,12 +273,14 @@ class Dataset:
             zarr_format = kwargs.pop('zarr_format', 2)
             shards = kwargs.pop('shards', None)
             chunk_key_encoding = kwargs.pop('chunk_key_encoding', 'default')
+            shard_index_location = kwargs.pop('shard_index_location', 'end')
             return cls._create_dataset(group, name, shape, dtype, data=data,
                                        chunks=chunks, compression=compression,
                                        fillvalue=fillvalue, n_threads=n_threads,
                                        compression_options=kwargs, dimension_separator=dimension_separator,
                                        zarr_format=zarr_format, shards=shards,
-                                       chunk_key_encoding=chunk_key_encoding)
+                                       chunk_key_encoding=chunk_key_encoding,
+                                       shard_index_location=shard_index_location)
 
     @classmethod
     def _create_dataset(cls, group, name,
@@ -256,7 +292,8 @@ class Dataset:
                         dimension_separator=".",
                         zarr_format=2,
                         shards=None,
-                        chunk_key_encoding="default"):
+                        chunk_key_encoding="default",
+                        shard_index_location="end"):
 
         # check shape, dtype and data
         ghandle = group._handle
@@ -298,6 +335,8 @@ class Dataset:
 
         if shards is not None and not (is_zarr and zarr_format == 3):
             raise ValueError("Sharding is only supported for zarr v3 datasets")
+        if shard_index_location not in ('start', 'end'):
+            raise ValueError("Invalid shard index location \"%s\", expected \"start\" or \"end\"" % shard_index_location)
 
         if is_zarr and zarr_format == 3:
             # zarr v3
@@ -311,7 +350,8 @@ class Dataset:
             shards_arg = list(shards) if shards is not None else []
             impl = _z5py.create_dataset(ghandle, name, cls._dtype_dict[parsed_dtype],
                                         shape, chunks, compression, copts, fillvalue,
-                                        separator, 3, shards_arg, chunk_key_encoding)
+                                        separator, 3, shards_arg, chunk_key_encoding,
+                                        shard_index_location)
         else:
             # zarr v2 / n5
             # check compression / get default compression if no compression is given
@@ -638,6 +678,54 @@ class Dataset:
         _z5py.read_subarray(self._impl, out, start, n_threads=self.n_threads)
         return out
 
+    def write_subarray_async(self, start, data):
+        """ Write subarray to dataset asynchronously.
+
+        Like :meth:`write_subarray`, but returns right away. The write runs on
+        the library's thread pool; ``data`` must not be modified until it has finished.
+        Cancelling the future stops the write before its next chunk, so the
+        region may be partially written.
+
+        Args:
+            start (tuple): offset of the roi to write.
+            data (np.ndarray): data to write; shape determines the roi shape.
+
+        Returns:
+            concurrent.futures.Future: resolves to None once the data is written.
+        """
+        request = _z5py.write_subarray_async(self._impl,
+                                             np.require(data, requirements='C'),
+                                             list(start),
+                                             n_threads=self.n_threads)
+        return _request_future(request)
+
+    def read_subarray_async(self, start, stop):
+        """ Read subarray from region of interest asynchronously.
+
+        Like :meth:`read_subarray`, but returns right away. The read runs on
+        the library's thread pool.
+
+        Args:
+            start (tuple): start coordinates of the roi.
+            stop (tuple): stop coordinates of the roi.
+
+        Returns:
+            concurrent.futures.Future: resolves to the np.ndarray read.
+        """
+        shape = tuple(sto - sta for sta, sto in zip(start, stop))
+        out = np.empty(shape, dtype=self.dtype)
+        request = _z5py.read_subarray_async(self._impl, out, list(start),
+                                            n_threads=self.n_threads)
+        return _request_future(request, out)
+
+    async def awrite_subarray(self, start, data):
+        """ Awaitable version of :meth:`write_subarray`. """
+        await asyncio.wrap_future(self.write_subarray_async(start, data))
+
+    async def aread_subarray(self, start, stop):
+        """ Awaitable version of :meth:`read_subarray`. """
+        return await asyncio.wrap_future(self.read_subarray_async(start, stop))
+
     def chunk_exists(self, chunk_indices):
         """ Check if chunk has data.
 
@@ -664,6 +752,53 @@ class Dataset:
             raise RuntimeError("Varlength chunks are not supported in zarr")
         _z5py.write_chunk(self._impl, chunk_indices, data, varlen)
 
+    def flush(self):
+        """ Write the chunks held back by the shard write-back.
+
+        Only sharded datasets opened with a write-back budget
+        (see z5py.set_shard_write_back_bytes) hold back chunks written with
+        write_chunk; they are also written when the budget is exceeded, before
+        their shard is read and when the dataset is garbage collected.
+        For S3 datasets with write-behind (see z5py.set_s3_write_behind) this
+        also waits until the staged writes are uploaded.
+        """
+        self._impl.flush()
+
+    @property
+    def chunk_cache_info(self):
+        """ Hits and misses of the decoded-chunk cache of this dataset.
+
+        Only datasets opened with a cache budget (see z5py.set_chunk_cache_bytes)
+        cache decoded chunks; reads copy cached chunks without decompressing them.
+
+        Returns:
+            dict: number of 'hits' and 'misses' since the dataset was opened
+                or the cache was cleared.
+        """
+        return {'hits': self._impl.chunk_cache_hits,
+                'misses': self._impl.chunk_cache_misses}
+
+    @property
+    def stored_chunk_cache_info(self):
+        """ Hits and misses of the stored-chunk cache of this dataset.
+
+        Only datasets opened with a cache budget (see z5py.set_stored_chunk_cache_bytes)
+        cache the stored (compressed) bytes of chunks; reads decompress cached
+        chunks without fetching them.
+
+        Returns:
+            dict: number of 'hits' and 'misses' since the dataset was opened
+                or the cache was cleared.
+        """
+        return {'hits': self._impl.stored_chunk_cache_hits,
+                'misses': self._impl.stored_chunk_cache_misses}
+
+    def clear_chunk_cache(self):
+        """ Drop the decoded and stored chunks cached by this dataset and reset
+        the counters of both caches.
+        """
+        self._impl.clear_chunk_cache()
+
     def read_chunk(self, chunk_indices):
         """ Read a single chunk.
 
@@ -206,6 +206,150 @@ class ZarrFile(File):
                          dimension_separator=dimension_separator, zarr_format=zarr_format)
 
 
+def set_s3_disk_cache(directory, n_bytes):
+    """ Cache the objects read from S3 in a directory on a local disk.
+
+    Entries are shared by all processes using the same directory and survive restarts;
+    the least recently used ones are removed once the cache exceeds ``n_bytes``. Cached
+    objects are revalidated with S3 by their ETag before use (see
+    :func:`set_s3_disk_cache_max_age`), which transfers no data if they did not change.
+
+    Args:
+        directory (str): cache directory; None or '' disables the cache.
+        n_bytes (int): byte budget of the cache; 0 disables the cache.
+    """
+    if not hasattr(_z5py, "set_s3_disk_cache"):
+        raise AttributeError("z5 was not compiled with s3 support")
+    _z5py.set_s3_disk_cache('' if directory is None else str(directory), n_bytes)
+
+
+def set_s3_disk_cache_max_age(seconds):
+    """ Use cached S3 objects validated less than ``seconds`` ago without revalidating them.
+
+    The default, 0, revalidates every read. Objects changed within that time are read stale.
+
+    Args:
+        seconds (int): maximal age of a validation.
+    """
+    if not hasattr(_z5py, "set_s3_disk_cache_max_age"):
+        raise AttributeError("z5 was not compiled with s3 support")
+    _z5py.set_s3_disk_cache_max_age(seconds)
+
+
+def set_s3_write_behind(directory, n_uploaders=32, max_bytes=4 * 1024**3):
+    """ Stage the chunks written to S3 on a local disk and upload them in the background.
+
+    Writes return once the data is staged; reads see the staged data. Call
+    :func:`flush_s3_writes` (or ``Dataset.flush``) to wait for the uploads and see
+    upload errors. Objects left staged by a process that exited early are uploaded
+    when write-behind is enabled on the directory again.
+
+    Args:
+        directory (str): staging directory; None or '' uploads everything staged and
+            disables write-behind.
+        n_uploaders (int): number of concurrent uploads (default: 32).
+        max_bytes (int): staged bytes at which writes wait for uploads (default: 4 GiB).
+    """
+    if not hasattr(_z5py, "set_s3_write_behind"):
+        raise AttributeError("z5 was not compiled with s3 support")
+    _z5py.set_s3_write_behind('' if directory is None else str(directory), n_uploaders, max_bytes)
+
+
+def flush_s3_writes():
+    """ Wait until all staged S3 writes are uploaded; raises the first upload error.
+    """
+    if not hasattr(_z5py, "flush_s3_writes"):
+        raise AttributeError("z5 was not compiled with s3 support")
+    _z5py.flush_s3_writes()
+
+
+def set_s3_request_concurrency(n):
+    """ Set the number of S3 requests a read issues at once (default: 64).
+
+    Reads of chunked datasets request a batch of chunks concurrently and reads of
+    sharded datasets the byte ranges of a shard; the requests run on dedicated threads,
+    independent of the ``n_threads`` that decode.
+
+    Args:
+        n (int): maximal number of requests in flight per read.
+    """
+    if not hasattr(_z5py, "set_s3_request_concurrency"):
+        raise AttributeError("z5 was not compiled with s3 support")
+    _z5py.set_s3_request_concurrency(n)
+
+
+def get_s3_request_concurrency():
+    """ Get the number of S3 requests a read issues at once.
+    """
+    if not hasattr(_z5py, "get_s3_request_concurrency"):
+        raise AttributeError("z5 was not compiled with s3 support")
+    return _z5py.get_s3_request_concurrency()
+
+
+def set_s3_multipart_upload(threshold, part_size=16 * 1024**2):
+    """ Upload S3 objects of at least ``threshold`` bytes in parts sent concurrently.
+
+    Parts are at least 5 MiB (the S3 minimum); failed uploads are aborted.
+
+    Args:
+        threshold (int): object size from which uploads use parts (default: 64 MiB);
+            0 disables multipart uploads.
+        part_size (int): size of the parts (default: 16 MiB).
+    """
+    if not hasattr(_z5py, "set_s3_multipart_upload"):
+        raise AttributeError("z5 was not compiled with s3 support")
+    _z5py.set_s3_multipart_upload(threshold, part_size)
+
+
+def set_s3_retries(max_retries, base_delay_ms=50):
+    """ Retry S3 requests that fail transiently (e.g. 503 SlowDown) with exponential backoff.
+
+    The n-th retry waits a random time of up to ``min(base_delay_ms * 2**n, 20 s)``.
+
+    Args:
+        max_retries (int): maximal number of retries of a request (default: 10).
+        base_delay_ms (int): delay bound of the first retry in milliseconds (default: 50).
+    """
+    if not hasattr(_z5py, "set_s3_retries"):
+        raise AttributeError("z5 was not compiled with s3 support")
+    _z5py.set_s3_retries(max_retries, base_delay_ms)
+
+
+def set_s3_hedging(percentile):
+    """ Re-issue S3 GETs that take longer than a percentile of the recent latencies.
+
+    Whichever copy of a hedged GET finishes first is used, the other one is aborted.
+
+    Args:
+        percentile (float): latency percentile after which a GET is hedged, e.g. 0.95;
+            0 disables hedging (the default).
+    """
+    if not hasattr(_z5py, "set_s3_hedging"):
+        raise AttributeError("z5 was not compiled with s3 support")
+    _z5py.set_s3_hedging(percentile)
+
+
+def get_s3_request_metrics():
+    """ Get the number of retries and hedged GETs since the start or the last reset.
+
+    Returns:
+        dict: ``retries``, ``throttle_retries`` (retries after throttling), ``hedges``,
+        ``hedge_wins`` (hedges that finished first) and ``hedge_delay_us`` (the current
+        hedging delay, -1 while too few GETs were timed).
+    """
+    if not hasattr(_z5py, "get_s3_request_metrics"):
+        raise AttributeError("z5 was not compiled with s3 support")
+    return _z5py.get_s3_request_metrics()
+
+
+def reset_s3_request_metrics():
+    """ Reset the counters of :func:`get_s3_request_metrics`.
+    """
+    if not hasattr(_z5py, "reset_s3_request_metrics"):
+        raise AttributeError("z5 was not compiled with s3 support")
+    _z5py.reset_s3_request_metrics()
+
+
 class S3File(Group):
     """ File to access a zarr container in an S3 (or S3-compatible) bucket.
 
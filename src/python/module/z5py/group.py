@@ -200,7 +200,8 @@ class Group(Mapping):
                        data=None, chunks=None,
                        compression=None, fillvalue=0,
                        n_threads=1, shards=None,
-                       chunk_key_encoding='default', **compression_options):
+                       chunk_key_encoding='default', shard_index_location='end',
+                       **compression_options):
         """ Create a new dataset.
 
         Create a new dataset in the group. Syntax and behaviour similar to the
@@ -225,6 +226,10 @@ class Group(Mapping):
                 If no compression is given, the default for the current format is used (default: None).
             fillvalue (float): fillvalue for empty chunks (only zarr) (default: 0).
             n_threads (int): number of threads used for chunk I/O (default: 1).
+            shards (tuple): shard shape of a sharded zarr v3 dataset (default: None).
+            chunk_key_encoding (str): zarr v3 chunk key encoding, 'default' or 'v2' (default: 'default').
+            shard_index_location (str): where sharded zarr v3 datasets store the index of
+                each shard, 'start' or 'end' (default: 'end').
             **compression_options: options for the compression library.
 
         Returns:
@@ -247,6 +252,7 @@ class Group(Mapping):
                                         fillvalue, n_threads,
                                         shards=shards,
                                         chunk_key_encoding=chunk_key_encoding,
+                                        shard_index_location=shard_index_location,
                                         **compression_options)
 
         return Dataset._create_dataset(self, name, shape, dtype,
@@ -256,7 +262,8 @@ class Group(Mapping):
                                        self._dimension_separator,
                                        zarr_format=self._zarr_format,
                                        shards=shards,
-                                       chunk_key_encoding=chunk_key_encoding)
+                                       chunk_key_encoding=chunk_key_encoding,
+                                       shard_index_location=shard_index_location)
 
     def require_dataset(self, name, shape,
                         dtype=None, chunks=None,
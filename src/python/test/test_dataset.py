@@ -1,3 +1,4 @@
+import asyncio
 import unittest
 import os
 from shutil import rmtree
@@ -186,6 +187,87 @@ class DatasetTestMixin(ABC):
             out_array = ds[:]
             self.check_array(out_array, in_array)
 
+    def test_chunk_cache(self):
+        z5py.set_chunk_cache_bytes(1 << 24)
+        try:
+            ds = self.root_file.create_dataset('data_cache', dtype='float64',
+                                               shape=(50, 50), chunks=(10, 10))
+        finally:
+            z5py.set_chunk_cache_bytes(0)
+        in_array = np.random.rand(50, 50)
+        ds[:] = in_array
+        self.check_array(ds[:], in_array)
+        self.assertEqual(ds.chunk_cache_info, {'hits': 0, 'misses': 25})
+        # the overlapping tile is copied from the cache
+        self.check_array(ds[5:25, 5:25], in_array[5:25, 5:25])
+        self.assertEqual(ds.chunk_cache_info, {'hits': 9, 'misses': 25})
+        # writes invalidate the cached chunks they change
+        ds[0:10, 0:10] = 0
+        in_array[0:10, 0:10] = 0
+        self.check_array(ds[:], in_array)
+        self.assertEqual(ds.chunk_cache_info, {'hits': 33, 'misses': 26})
+        ds.clear_chunk_cache()
+        self.assertEqual(ds.chunk_cache_info, {'hits': 0, 'misses': 0})
+
+    def test_stored_chunk_cache(self):
+        z5py.set_stored_chunk_cache_bytes(1 << 24)
+        z5py.set_stored_chunk_cache_admission('always')
+        try:
+            ds = self.root_file.create_dataset('data_stored_cache', dtype='float64',
+                                               shape=(50, 50), chunks=(10, 10),
+                                               compression='gzip')
+        finally:
+            z5py.set_stored_chunk_cache_bytes(0)
+            z5py.set_stored_chunk_cache_admission('second_access')
+        with self.assertRaises(ValueError):
+            z5py.set_stored_chunk_cache_admission('never')
+        in_array = np.random.rand(50, 50)
+        ds[:] = in_array
+        self.check_array(ds[:], in_array)
+        self.assertEqual(ds.stored_chunk_cache_info, {'hits': 0, 'misses': 25})
+        self.check_array(ds[5:25, 5:25], in_array[5:25, 5:25])
+        self.assertEqual(ds.stored_chunk_cache_info, {'hits': 9, 'misses': 25})
+        ds[0:10, 0:10] = 0
+        in_array[0:10, 0:10] = 0
+        self.check_array(ds[:], in_array)
+        self.assertEqual(ds.stored_chunk_cache_info, {'hits': 33, 'misses': 26})
+
+    def test_readwrite_async(self):
+        ds = self.root_file.create_dataset('data_async', dtype='float64',
+                                           shape=(60, 60), chunks=(10, 10),
+                                           n_threads=2)
+        in_array = np.random.rand(60, 60)
+        futures = [ds.write_subarray_async((i * 20, 0), in_array[i * 20:(i + 1) * 20])
+                   for i in range(3)]
+        for future in futures:
+            self.assertIsNone(future.result())
+        self.check_array(ds.read_subarray_async((0, 0), (60, 60)).result(), in_array)
+
+        async def read_blocks():
+            return await asyncio.gather(*[ds.aread_subarray((i * 20, 0), ((i + 1) * 20, 60))
+                                          for i in range(3)])
+        blocks = asyncio.run(read_blocks())
+        self.check_array(np.concatenate(blocks, axis=0), in_array)
+
+        # invalid requests are rejected right away, before a future is returned
+        with self.assertRaises(RuntimeError):
+            ds.write_subarray_async((50, 0), in_array)
+
+        # errors while the request runs are raised by the future: replace the first
+        # chunk by a directory, so that writing it fails inside the task
+        if self.data_format == 'zarr_v3':
+            chunk_path = os.path.join(self.path, 'data_async', 'c', '0', '0')
+        elif ds.is_zarr:
+            chunk_path = os.path.join(self.path, 'data_async', '0.0')
+        else:
+            chunk_path = os.path.join(self.path, 'data_async', '0', '0')
+        os.remove(chunk_path)
+        os.mkdir(chunk_path)
+        future = ds.write_subarray_async((0, 0), in_array[:20])
+        with self.assertRaises(RuntimeError):
+            future.result()
+        self.assertIsInstance(future.exception(), RuntimeError)
+
     def test_create_nested_dataset(self):
         self.root_file.create_dataset('group/sub_group/data',
                                       shape=self.shape,
@@ -118,7 +118,8 @@ def open_z5(path, fmt, mode="a", dimension_separator=None):
 # external write / read (always operate in z5-logical axis order)
 # ---------------------------------------------------------------------------
 def external_write(library, fmt, path, key, data, chunks, compression="raw",
-                   shards=None, fill_value=0, dimension_separator=None):
+                   shards=None, fill_value=0, dimension_separator=None,
+                   shard_index_location=None):
     """Write ``data`` (z5-logical) with the external library.
 
     After this call, ``z5py`` opening ``path``/``key`` must read back ``data``.
@@ -132,7 +133,16 @@ def external_write(library, fmt, path, key, data, chunks, compression="raw",
                       fill_value=fill_value)
         if fmt == "zarr_v3":
             kwargs["compressors"] = _zpy_v3_compressors(compression)
-            if shards is not None:
+            if shards is not None and shard_index_location is not None:
+                # the index location is only configurable on the sharding codec
+                from zarr.codecs import BytesCodec, ShardingCodec
+                compressor = kwargs.pop("compressors")
+                kwargs["chunks"] = shards
+                kwargs["serializer"] = ShardingCodec(
+                    chunk_shape=chunks,
+                    codecs=[BytesCodec()] + ([compressor] if compressor is not None else []),
+                    index_location=shard_index_location)
+            elif shards is not None:
                 kwargs["shards"] = shards
             if dimension_separator is not None:
                 kwargs["chunk_key_encoding"] = {
@@ -172,7 +182,8 @@ def external_write(library, fmt, path, key, data, chunks, compression="raw",
                                "index_codecs": [
                                    {"name": "bytes",
                                     "configuration": {"endian": "little"}},
-                                   {"name": "crc32c"}]}}]
+                                   {"name": "crc32c"}],
+                               "index_location": shard_index_location or "end"}}]
                 grid = shards
             meta = {"shape": list(shape),
                     "chunk_grid": {"name": "regular",
@@ -376,6 +387,30 @@ class InteropMixin(ABC):
                             self._msg("sharding ext->z5", comp))
 
 
+    @requires_z5_v3_sharding
+    def test_sharding_index_location(self):
+        if self.fmt != "zarr_v3":
+            self.skipTest("sharding is zarr v3 only")
+        shape, chunks, shards = (64, 64), (16, 16), (32, 32)
+        f = open_z5(self.path, self.fmt)
+        for location in ("start", "end"):
+            data = self._data("int32", shape)
+            key = "z5_%s" % location
+            f.create_dataset(key, data=data, chunks=chunks, shards=shards,
+                             compression="raw", shard_index_location=location)
+            out = external_read(self.library, self.fmt, self.path, key)
+            self.assertTrue(np.array_equal(out, data),
+                            self._msg("index location z5->ext", location))
+
+            data2 = self._data("int32", shape)
+            key2 = "ext_%s" % location
+            external_write(self.library, self.fmt, self.path, key2, data2,
+                           chunks, shards=shards, shard_index_location=location)
+            out2 = open_z5(self.path, self.fmt, mode="r")[key2][:]
+            self.assertTrue(np.array_equal(out2, data2),
+                            self._msg("index location ext->z5", location))
+
+
 # ---------------------------------------------------------------------------
 # concrete combinations
 # ---------------------------------------------------------------------------
@@ -191,10 +191,11 @@ class TestZarrV3Sharding(unittest.TestCase):
         with open(os.path.join(self.path, key, 'zarr.json')) as f:
             return json.load(f)
 
-    def _roundtrip(self, name, shape, chunks, shards, dtype, compression='raw'):
+    def _roundtrip(self, name, shape, chunks, shards, dtype, compression='raw',
+                   **kwargs):
         ds = self.root.create_dataset(name, shape=shape, chunks=chunks,
                                       shards=shards, dtype=dtype,
-                                      compression=compression)
+                                      compression=compression, **kwargs)
         data = _random(shape, dtype)
         ds[:] = data
         self.assertTrue(np.allclose(ds[:], data),
@@ -219,6 +220,25 @@ class TestZarrV3Sharding(unittest.TestCase):
                         for c in sharding['configuration']['index_codecs']]
         self.assertIn('crc32c', index_codecs)
 
+    def test_sharding_index_location(self):
+        ds, data = self._roundtrip('start', (64, 64), (16, 16), (32, 32), 'int32',
+                                   shard_index_location='start')
+        sharding = self._read_meta('start')['codecs'][0]['configuration']
+        self.assertEqual(sharding['index_location'], 'start')
+        # the index (4 slots of offset / nbytes) and its crc32c precede the blobs
+        shard_file = os.path.join(self.path, 'start', 'c', '0', '0')
+        with open(shard_file, 'rb') as fh:
+            index = np.frombuffer(fh.read(4 * 16), dtype='<u8').reshape(4, 2)
+        self.assertEqual(index[:, 0].min(), 4 * 16 + 4)
+        # partial writes rewrite the shard with the index in front
+        ds[3:5, 3:5] = -1
+        data[3:5, 3:5] = -1
+        self.assertTrue(np.array_equal(z5py.File(self.path, mode='r')['start'][:], data))
+        with self.assertRaises(ValueError):
+            self.root.create_dataset('invalid', shape=(64, 64), chunks=(16, 16),
+                                     shards=(32, 32), dtype='int32',
+                                     shard_index_location='middle')
+
     def test_sharding_single_file_per_shard(self):
         ds = self.root.create_dataset('a', shape=(64, 64), chunks=(16, 16),
                                       shards=(32, 32), dtype='uint8',
@@ -285,6 +305,54 @@ class TestZarrV3Sharding(unittest.TestCase):
         with self.assertRaises(RuntimeError):
             ds[:8, :8] = np.ones((8, 8), dtype='uint8')
 
+    def test_sharding_blob_order(self):
+        # with a hilbert / morton blob order a 2x2x2 block of inner chunks is contiguous
+        for order in ('morton', 'hilbert'):
+            z5py.set_shard_blob_order(order)
+            try:
+                ds, data = self._roundtrip(order, (32, 32, 32), (4, 4, 4),
+                                           (32, 32, 32), 'uint8')
+            finally:
+                z5py.set_shard_blob_order('c')
+            shard_file = os.path.join(self.path, order, 'c', '0', '0', '0')
+            with open(shard_file, 'rb') as fh:
+                fh.seek(-(512 * 16 + 4), os.SEEK_END)
+                index = np.frombuffer(fh.read(512 * 16), dtype='<u8').reshape(8, 8, 8, 2)
+            offsets = index[:2, :2, :2, 0]
+            self.assertEqual(offsets.max() - offsets.min(), 7 * 64)
+        with self.assertRaises(ValueError):
+            z5py.set_shard_blob_order('random')
+
+    def test_sharding_write_back(self):
+        # with a write-back budget, write_chunk calls are held back and each shard
+        # is written once by flush (or before it is read)
+        z5py.set_shard_write_back_bytes(1 << 20)
+        try:
+            ds = self.root.create_dataset('wb', shape=(32, 32), chunks=(8, 8),
+                                          shards=(16, 16), dtype='int32')
+        finally:
+            z5py.set_shard_write_back_bytes(0)
+        shard00 = os.path.join(self.path, 'wb', 'c', '0', '0')
+        shard11 = os.path.join(self.path, 'wb', 'c', '1', '1')
+        ds.write_chunk((0, 0), np.full((8, 8), 1, dtype='int32'))
+        ds.write_chunk((0, 1), np.full((8, 8), 2, dtype='int32'))
+        ds.write_chunk((3, 3), np.full((8, 8), 3, dtype='int32'))
+        self.assertFalse(os.path.exists(shard00))
+        # reads see the pending chunks
+        self.assertTrue(ds.chunk_exists((0, 1)))
+        self.assertTrue(np.allclose(ds.read_chunk((0, 1)), 2))
+        self.assertTrue(os.path.exists(shard00))
+        self.assertFalse(os.path.exists(shard11))
+        ds.flush()
+        self.assertTrue(os.path.exists(shard11))
+
+        expected = np.zeros((32, 32), dtype='int32')
+        expected[:8, :8] = 1
+        expected[:8, 8:16] = 2
+        expected[24:, 24:] = 3
+        ds_other = z5py.File(self.path, mode='r')['wb']
+        self.assertTrue(np.array_equal(ds_other[:], expected))
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -307,5 +307,67 @@ namespace multiarray {
         auto arrayN5 = openDataset(fN5, "float_irregular");
         testArrayWriteRead<float>(arrayN5, distr);
     }
+
+
+    TEST_F(ArrayTest, TestWriteChunks) {
+        for(auto * file : {&fZarr, &fN5}) {
+            auto array = openDataset(*file, "int_irregular");
+            const auto & chunks = array->chunksPerDimension();
+            // a batch with full chunks, edge chunks and an all-fill chunk (which is removed)
+            std::vector<types::ShapeType> chunkIds;
+            std::vector<std::vector<int32_t>> chunkData;
+            for(std::size_t z = 0; z < chunks[0]; z += 2) {
+                types::ShapeType chunkId({z, chunks[1] - 1, z % chunks[2]});
+                chunkIds.push_back(chunkId);
+                // zarr stores edge chunks at the full chunk shape, n5 at the clipped one
+                const std::size_t chunkSize = array->isZarr() ? array->defaultChunkSize()
+                                                              : array->getChunkSize(chunkId);
+                chunkData.emplace_back(chunkSize, static_cast<int32_t>(z + 1));
+            }
+            std::fill(chunkData.back().begin(), chunkData.back().end(), 0);
+            std::vector<const int32_t *> data;
+            for(const auto & d : chunkData) {
+                data.push_back(d.data());
+            }
+            writeChunks<int32_t>(*array, chunkIds, data, 4);
+
+            for(std::size_t i = 0; i < chunkIds.size(); ++i) {
+                if(i + 1 == chunkIds.size()) {
+                    ASSERT_FALSE(array->chunkExists(chunkIds[i]));
+                    continue;
+                }
+                std::vector<int32_t> out(array->defaultChunkSize());
+                array->readChunk(chunkIds[i], &out[0]);
+                for(std::size_t j = 0; j < chunkData[i].size(); ++j) {
+                    ASSERT_EQ(out[j], chunkData[i][j]);
+                }
+            }
+        }
+    }
+
+
+    TEST_F(ArrayTest, TestReadWriteAsync) {
+        auto array = openDataset(fZarr, "int_irregular");
+        const types::ShapeType offset({5, 10, 15});
+        const types::ShapeType shape({40, 30, 50});
+        TestArray<int32_t> in(shape);
+        for(std::size_t i = 0; i < in.data.size(); ++i) {
+            in.data[i] = static_cast<int32_t>(i % 1000);
+        }
+        auto write = writeSubarrayAsync<int32_t>(*array, in.cview(), offset.begin(), 2);
+        write.get();
+
+        TestArray<int32_t> out(shape);
+        auto read = readSubarrayAsync<int32_t>(*array, out.view(), offset.begin(), 2);
+        read.wait();
+        EXPECT_TRUE(read.ready());
+        read.get();
+        EXPECT_EQ(out.data, in.data);
+
+        // invalid requests are rejected before the request is started
+        const types::ShapeType badOffset({90, 90, 90});
+        ASSERT_THROW(readSubarrayAsync<int32_t>(*array, out.view(), badOffset.begin()),
+                     std::runtime_error);
+    }
 }
 }
@@ -15,11 +15,16 @@ echo "Running Dataset Test"
 echo "Running Factories Test"
 ./test_factories
 
+echo "Running Store Test"
+./test_store
+
 echo "Running Attributes Test"
 ./test_attributes
 
 echo "Running Util Test"
 ./util/test_util
+./util/test_threadpool
+./util/test_pipeline
 
 echo "Running Compression Tests"
 ./compression/test_raw
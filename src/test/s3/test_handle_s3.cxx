@@ -1,12 +1,18 @@
 #include <chrono>
 #include <cstdlib>
+#include <random>
+#include <set>
 #include <string>
 
 #include "gtest/gtest.h"
 
 #include <aws/s3/model/CreateBucketRequest.h>
 
+#include "z5/factory.hxx"
+#include "z5/multiarray/array_access.hxx"
 #include "z5/s3/handle.hxx"
+#include "z5/s3/store.hxx"
+#include "z5/util/functions.hxx"
 
 // These tests need a reachable S3 endpoint (a local moto server is enough):
 //   pip install 'moto[server]' && moto_server -p 5000 &
@@ -60,6 +66,34 @@ namespace {
     };
 
 
+    // the hedging delay follows the latency percentile also when the slow GETs are hedged
+    // (their slow first attempts are aborted); no endpoint needed
+    TEST_F(HandleTest, TestHedgingDelayWithSlowTail) {
+        // 90% of the GETs take 10 - 20 ms, the others 100 ms - 1 s: the 0.95 percentile is 550 ms
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<double> uniform(0., 1.);
+        auto latency = [&]() -> int64_t {
+            const double u = uniform(gen);
+            return u < 0.9 ? static_cast<int64_t>(10000 + u / 0.9 * 10000)
+                           : static_cast<int64_t>(100000 + (u - 0.9) / 0.1 * 900000);
+        };
+        s3::setHedging(0.95);
+        for(int i = 0; i < 20000; ++i) {
+            // a GET that is not done after the delay is hedged, and the faster copy wins
+            const int64_t delay = s3::requestMetrics().hedgeDelay;
+            const int64_t first = latency();
+            const int64_t observed = (delay >= 0 && first > delay) ? std::min(first, delay + latency()) : first;
+            s3::detail::recordLatency(observed);
+        }
+        // (1024 samples give a noisy percentile, but sampling only the attempts that
+        // finish would drag it down to the fast GETs, about 20 ms)
+        const int64_t delay = s3::requestMetrics().hedgeDelay;
+        EXPECT_GT(delay, 350000);
+        EXPECT_LT(delay, 750000);
+        s3::setHedging(0.);
+    }
+
+
     TEST_F(HandleTest, TestFile) {
         if(skipWithoutEndpoint()) GTEST_SKIP() << "Z5PY_S3_ENDPOINT not set";
         auto f = makeFile(endpoint_, uniquePrefix("file"));
@@ -143,6 +177,265 @@ namespace {
         // creating "data" must not fail with "already exists"
         EXPECT_NO_THROW(fresh.create());
 
+        // siblings that sort between "data" and "data/" do not hide "data" from in()
+        for(const std::string key : {"data-1/zarr.json", "data.0", "data/zarr.json"}) {
+            s3::detail::putObjectString(*client, f.bucketName(),
+                                        s3::detail::joinKey(f.nameInBucket(), key), "{}");
+        }
+        EXPECT_TRUE(f.in("data"));
+        EXPECT_TRUE(f.in("data.0"));
+        EXPECT_FALSE(f.in("data-"));
+        std::vector<std::string> keys;
+        f.keys(keys);
+        EXPECT_EQ(std::set<std::string>(keys.begin(), keys.end()),
+                  std::set<std::string>({"data", "data-1", "data2"}));
+
+        f.remove();
+    }
+
+
+
+    // writes with write-behind are visible before they are uploaded and land in the
+    // bucket with the next flush
+    TEST_F(HandleTest, TestWriteBehind) {
+        if(skipWithoutEndpoint()) GTEST_SKIP() << "Z5PY_S3_ENDPOINT not set";
+        auto f = makeFile(endpoint_, uniquePrefix("write-behind"));
+        ensureBucket(f);
+        auto client = f.makeClient();
+        const fs::path staging = fs::temp_directory_path() / "z5_test_s3_staging";
+        fs::remove_all(staging);
+        s3::setWriteBehind(staging, 4);
+
+        s3::handle::Dataset ds(f, "ds");
+        ds.setIsZarr(true);
+        s3::handle::Chunk chunk(ds, {0, 1}, {10, 10}, {100, 100});
+        const std::vector<char> data(1000, 7);
+        s3::ChunkStore::write(chunk, data);
+        EXPECT_TRUE(chunk.exists());
+        std::vector<char> out;
+        ASSERT_TRUE(s3::ChunkStore::read(chunk, out));
+        EXPECT_EQ(out, data);
+        std::size_t size;
+        ASSERT_TRUE(s3::ChunkStore::readTail(chunk, 10, out, size));
+        EXPECT_EQ(size, data.size());
+        EXPECT_EQ(out, std::vector<char>(10, 7));
+
+        s3::flushWrites();
+        EXPECT_TRUE(s3::detail::objectExists(*client, chunk.bucketName(), chunk.nameInBucket()));
+
+        // deleting drops a pending upload, so it cannot land after the delete
+        s3::ChunkStore::write(chunk, data);
+        s3::ChunkStore::erase(chunk);
+        s3::flushWrites();
+        EXPECT_FALSE(chunk.exists());
+
+        s3::setWriteBehind("");
+        fs::remove_all(staging);
+        f.remove();
+    }
+
+
+    // batched chunk reads and the ranges of a shard are requested concurrently; the
+    // results land in the right buffers / at the right offsets
+    TEST_F(HandleTest, TestConcurrentReads) {
+        if(skipWithoutEndpoint()) GTEST_SKIP() << "Z5PY_S3_ENDPOINT not set";
+        auto f = makeFile(endpoint_, uniquePrefix("concurrent"));
+        ensureBucket(f);
+        const std::size_t concurrency = s3::requestConcurrency();
+        s3::setRequestConcurrency(4);
+
+        s3::handle::Dataset ds(f, "ds");
+        ds.setIsZarr(true);
+        std::vector<s3::handle::Chunk> chunks;
+        for(std::size_t i = 0; i < 10; ++i) {
+            chunks.emplace_back(ds, types::ShapeType({i, 0}), types::ShapeType({10, 10}),
+                                types::ShapeType({100, 100}));
+            // every other chunk is missing
+            if(i % 2 == 0) {
+                s3::ChunkStore::write(chunks.back(), std::vector<char>(100 + i, static_cast<char>(i)));
+            }
+        }
+        std::vector<std::vector<char>> buffers(chunks.size(), std::vector<char>(3, 1));
+        std::vector<std::vector<char> *> bufferPtrs;
+        for(auto & buffer : buffers) {
+            bufferPtrs.push_back(&buffer);
+        }
+        s3::ChunkStore::readBatch(chunks, bufferPtrs);
+        for(std::size_t i = 0; i < chunks.size(); ++i) {
+            if(i % 2 == 0) {
+                EXPECT_EQ(buffers[i], std::vector<char>(100 + i, static_cast<char>(i)));
+            } else {
+                EXPECT_TRUE(buffers[i].empty());
+            }
+        }
+
+        std::vector<char> data(1000);
+        for(std::size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<char>(i % 251);
+        }
+        s3::ChunkStore::write(chunks[0], data);
+        const std::vector<generic::ByteRange> ranges = {{900, 100}, {0, 10}, {10, 0}, {500, 50}};
+        std::vector<char> out(160);
+        ASSERT_TRUE(s3::ChunkStore::readRanges(chunks[0], ranges, out.data()));
+        std::vector<char> expected(data.begin() + 900, data.end());
+        expected.insert(expected.end(), data.begin(), data.begin() + 10);
+        expected.insert(expected.end(), data.begin() + 500, data.begin() + 550);
+        EXPECT_EQ(out, expected);
+        EXPECT_FALSE(s3::ChunkStore::readRanges(chunks[1], ranges, out.data()));
+
+        s3::setRequestConcurrency(concurrency);
+        f.remove();
+    }
+
+
+    // objects above the multipart threshold are uploaded in parts and read back whole
+    TEST_F(HandleTest, TestMultipartUpload) {
+        if(skipWithoutEndpoint()) GTEST_SKIP() << "Z5PY_S3_ENDPOINT not set";
+        auto f = makeFile(endpoint_, uniquePrefix("multipart"));
+        ensureBucket(f);
+        const std::size_t threshold = s3::multipartThreshold();
+        const std::size_t partSize = s3::multipartPartSize();
+        s3::setMultipartUpload(std::size_t(6) << 20, std::size_t(5) << 20);
+
+        s3::handle::Dataset ds(f, "ds");
+        ds.setIsZarr(true);
+        s3::handle::Chunk chunk(ds, {0, 0}, {10, 10}, {100, 100});
+        // three parts, the last one short
+        std::vector<char> data((std::size_t(11) << 20) + 123);
+        for(std::size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<char>(i % 251);
+        }
+        s3::ChunkStore::write(chunk, data);
+        std::vector<char> out;
+        ASSERT_TRUE(s3::ChunkStore::read(chunk, out));
+        EXPECT_EQ(out, data);
+
+        // small objects still go up with a single PUT
+        const std::vector<char> small(1000, 3);
+        s3::ChunkStore::write(chunk, small);
+        ASSERT_TRUE(s3::ChunkStore::read(chunk, out));
+        EXPECT_EQ(out, small);
+
+        s3::setMultipartUpload(threshold, partSize);
+        f.remove();
+    }
+
+
+    // with hedging every read returns the object, whichever copy of a GET wins
+    TEST_F(HandleTest, TestHedgedReads) {
+        if(skipWithoutEndpoint()) GTEST_SKIP() << "Z5PY_S3_ENDPOINT not set";
+        auto f = makeFile(endpoint_, uniquePrefix("hedged"));
+        ensureBucket(f);
+        // hedge half of the GETs once the delay is known
+        s3::setHedging(0.5);
+        s3::resetRequestMetrics();
+
+        s3::handle::Dataset ds(f, "ds");
+        ds.setIsZarr(true);
+        s3::handle::Chunk chunk(ds, {0, 0}, {10, 10}, {100, 100});
+        std::vector<char> data(10000);
+        for(std::size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<char>(i % 251);
+        }
+        s3::ChunkStore::write(chunk, data);
+        std::vector<char> out;
+        std::vector<char> range(100);
+        for(int i = 0; i < 200; ++i) {
+            ASSERT_TRUE(s3::ChunkStore::read(chunk, out));
+            EXPECT_EQ(out, data);
+            ASSERT_TRUE(s3::ChunkStore::readRanges(chunk, {{1000, 100}}, range.data()));
+            EXPECT_TRUE(std::equal(range.begin(), range.end(), data.begin() + 1000));
+        }
+        const auto metrics = s3::requestMetrics();
+        EXPECT_GE(metrics.hedgeDelay, 0);
+        EXPECT_LE(metrics.hedgeWins, metrics.hedges);
+
+        s3::setHedging(0.);
+        f.remove();
+    }
+
+
+    // the chunks of a dataset are found by listing its objects (not its metadata), and
+    // removed with batched deletes
+    TEST_F(HandleTest, TestListAndBatchedDelete) {
+        if(skipWithoutEndpoint()) GTEST_SKIP() << "Z5PY_S3_ENDPOINT not set";
+        auto f = makeFile(endpoint_, uniquePrefix("listdelete"));
+        ensureBucket(f);
+        const std::size_t concurrency = s3::requestConcurrency();
+        s3::setRequestConcurrency(4);
+        auto client = f.makeClient();
+
+        // n5 layout (one level per dimension) and zarr v2 (flat keys)
+        for(const bool isZarr : {false, true}) {
+            s3::handle::Dataset ds(f, isZarr ? "zarr" : "n5");
+            ds.setIsZarr(isZarr);
+            const std::string metadata = isZarr ? "/.zarray" : "/attributes.json";
+            s3::detail::putObject(*client, TEST_BUCKET, ds.nameInBucket() + metadata, "{}", 2);
+            // more chunks than fit in one delete request
+            std::set<types::ShapeType> written;
+            std::vector<s3::handle::Chunk> chunks;
+            for(std::size_t i = 0; i < 50; ++i) {
+                for(std::size_t j = 0; j < 22; ++j) {
+                    chunks.emplace_back(ds, types::ShapeType({i, j}), types::ShapeType({10, 10}),
+                                        types::ShapeType({500, 220}));
+                    s3::ChunkStore::write(chunks.back(), std::vector<char>(1, 1));
+                    written.insert(types::ShapeType({i, j}));
+                }
+            }
+
+            std::vector<types::ShapeType> listed;
+            s3::ChunkStore::listChunks(ds, 2, listed);
+            EXPECT_EQ(std::set<types::ShapeType>(listed.begin(), listed.end()), written);
+            EXPECT_EQ(listed.size(), written.size());
+
+            s3::ChunkStore::eraseBatch(chunks);
+            listed.clear();
+            s3::ChunkStore::listChunks(ds, 2, listed);
+            EXPECT_TRUE(listed.empty());
+            EXPECT_TRUE(s3::detail::objectExists(*client, TEST_BUCKET, ds.nameInBucket() + metadata));
+        }
+
+        f.remove();
+        EXPECT_FALSE(f.exists());
+        s3::setRequestConcurrency(concurrency);
+    }
+
+
+    // trivial inner chunks of a sharded dataset are removed with one update per shard,
+    // and the shards left empty with batched deletes
+    TEST_F(HandleTest, TestRemoveTrivialShardedChunks) {
+        if(skipWithoutEndpoint()) GTEST_SKIP() << "Z5PY_S3_ENDPOINT not set";
+        auto f = makeFile(endpoint_, uniquePrefix("sharded"));
+        ensureBucket(f);
+        createFile(f, true, 3);
+        const types::ShapeType shape = {64, 64};
+        auto ds = createDataset(f, "data", "float32", shape, {16, 16}, "raw",
+                                types::CompressionOptions(), 0., "/", 3, "default", {32, 32});
+        // the first row of chunks holds data, all others are trivial
+        std::vector<float> data(64 * 64, 5.f);
+        for(std::size_t i = 0; i < 16 * 64; ++i) {
+            data[i] = static_cast<float>(i);
+        }
+        const types::ShapeType offset = {0, 0};
+        multiarray::writeSubarray<float>(*ds, multiarray::makeView(data.data(), shape), offset.begin(), 4);
+        ds->flush();
+
+        util::removeTrivialChunks<float>(*ds, 4, true, 5.f);
+        for(std::size_t y = 0; y < 4; ++y) {
+            for(std::size_t x = 0; x < 4; ++x) {
+                EXPECT_EQ(ds->chunkExists({y, x}), y == 0);
+            }
+        }
+        std::vector<types::ShapeType> listed;
+        ds->listChunks(listed);
+        // only the shards of the first row are left
+        EXPECT_EQ(listed.size(), 8);
+
+        std::vector<float> out(data.size());
+        multiarray::readSubarray<float>(*ds, multiarray::makeView(out.data(), shape), offset.begin(), 4);
+        for(std::size_t i = 0; i < out.size(); ++i) {
+            ASSERT_EQ(out[i], i < 16 * 64 ? data[i] : 0.f);
+        }
         f.remove();
     }
 
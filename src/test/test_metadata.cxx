@@ -190,4 +190,32 @@ namespace z5 {
         ASSERT_EQ(metaRead.dtype, types::Datatypes::n5ToDtype()[jN5["dataType"]]);
     }
 
+
+    TEST_F(MetadataTest, ShardIndexLayoutV3) {
+        DatasetMetadata meta(types::float32, {64, 64}, {8, 8}, true, types::raw,
+                             types::CompressionOptions(), 0, "/", 3, "default", {32, 32}, "start");
+        nlohmann::json j;
+        meta.toJson(j);
+        auto & sharding = j["codecs"][0]["configuration"];
+        ASSERT_EQ(sharding["index_location"], "start");
+        ASSERT_EQ(sharding["index_codecs"].size(), 2);
+        ASSERT_EQ(sharding["index_codecs"][1]["name"], "crc32c");
+
+        DatasetMetadata metaRead;
+        metaRead.fromJson(j, true);
+        ASSERT_EQ(metaRead.shardIndexLocation, "start");
+        ASSERT_TRUE(metaRead.shardIndexChecksum);
+
+        // index without checksum
+        sharding["index_codecs"].erase(1);
+        sharding.erase("index_location");
+        metaRead.fromJson(j, true);
+        ASSERT_EQ(metaRead.shardIndexLocation, "end");
+        ASSERT_FALSE(metaRead.shardIndexChecksum);
+
+        // variable-size (compressed) indices cannot be located
+        sharding["index_codecs"].push_back({{"name", "zstd"}, {"configuration", {{"level", 1}}}});
+        ASSERT_THROW(metaRead.fromJson(j, true), std::runtime_error);
+    }
+
 }
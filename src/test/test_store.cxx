@@ -0,0 +1,821 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <thread>
+
+#include "z5/factory.hxx"
+#include "z5/filesystem/store.hxx"
+#include "z5/multiarray/array_access.hxx"
+#include "z5/util/functions.hxx"
+
+namespace z5 {
+
+    // fixture for the filesystem chunk store test
+    class StoreTest : public ::testing::Test {
+
+    protected:
+        StoreTest() : tmp("tmp_store"){}
+
+        void SetUp() {
+            fs::create_directories(tmp);
+        }
+
+        void TearDown() {
+            filesystem::setUseIoUring(true);
+            filesystem::setUseMappedReads(false);
+            filesystem::setUseShardAppend(true);
+            util::setShardCompactionRatio(0.5);
+            util::setShardWriteBackBytes(0);
+            util::setShardBlobOrder(util::ShardBlobOrder::c);
+            util::setChunkCacheBytes(0);
+            util::setStoredChunkCacheBytes(0);
+            util::setStoredChunkCacheAdmission(util::CacheAdmission::secondAccess);
+            fs::remove_all(tmp);
+        }
+
+        fs::path tmp;
+    };
+
+
+    TEST_F(StoreTest, BatchedRawChunkReads) {
+        filesystem::handle::File f(tmp / "data.zr");
+        createFile(f, true);
+        auto ds = createDataset(f, "data", "int32", {100, 100}, {10, 10}, "raw");
+
+        // overwrite the chunk files with random bytes of different sizes (including
+        // empty and multi-MB files); every third chunk does not exist
+        std::mt19937 gen(42);
+        std::vector<types::ShapeType> chunkIds;
+        std::vector<std::vector<char>> expected;
+        for(std::size_t c = 0; c < ds->numberOfChunks(); ++c) {
+            types::ShapeType chunkId;
+            ds->chunking().blockIdToBlockCoordinate(c, chunkId);
+            chunkIds.push_back(chunkId);
+            std::vector<char> bytes;
+            if(c % 3 != 0) {
+                const std::size_t size = c == 1 ? std::size_t(3) << 20 : gen() % 5000;
+                bytes.resize(size);
+                for(auto & b : bytes) {
+                    b = static_cast<char>(gen());
+                }
+                fs::path path;
+                ds->chunkPath(chunkId, path);
+                std::ofstream file(path, std::ios::binary);
+                file.write(bytes.data(), bytes.size());
+            }
+            expected.push_back(bytes);
+        }
+
+        for(const bool useIoUring : {true, false}) {
+            filesystem::setUseIoUring(useIoUring);
+            std::vector<std::vector<char>> buffers(chunkIds.size(), std::vector<char>(7, 'x'));
+            std::vector<std::vector<char> *> bufferPtrs;
+            for(auto & buffer : buffers) {
+                bufferPtrs.push_back(&buffer);
+            }
+            ds->readRawChunks(chunkIds, bufferPtrs);
+            for(std::size_t c = 0; c < chunkIds.size(); ++c) {
+                ASSERT_EQ(buffers[c], expected[c]) << "chunk " << c << ", io_uring " << useIoUring;
+            }
+        }
+        // without io_uring there is nothing to gain from batching
+        EXPECT_EQ(ds->readBatchSize(), 1);
+    }
+
+
+    TEST_F(StoreTest, ReadSubarrayWithAndWithoutIoUring) {
+        filesystem::handle::File f(tmp / "data.n5");
+        createFile(f, false);
+        auto ds = createDataset(f, "data", "float32", {64, 64, 64}, {4, 8, 8}, "raw");
+
+        std::vector<float> data(64 * 64 * 64);
+        std::iota(data.begin(), data.end(), 0.f);
+        const types::ShapeType shape = {64, 64, 64};
+        const types::ShapeType offset = {0, 0, 0};
+        const float * dataPtr = data.data();
+        multiarray::writeSubarray<float>(*ds, multiarray::makeView(dataPtr, shape), offset.begin(), 2);
+        // remove a few chunks, they read as the fill value
+        ds->removeChunk({0, 0, 0});
+        ds->removeChunk({3, 2, 5});
+
+        const types::ShapeType roiOffset = {3, 5, 7}, roiShape = {50, 40, 30};
+        std::vector<std::vector<float>> results;
+        for(const bool useIoUring : {true, false}) {
+            filesystem::setUseIoUring(useIoUring);
+            for(const int nThreads : {1, 3}) {
+                std::vector<float> out(50 * 40 * 30, -1.f);
+                multiarray::readSubarray<float>(*ds, multiarray::makeView(out.data(), roiShape),
+                                                roiOffset.begin(), nThreads);
+                results.push_back(out);
+            }
+        }
+        for(std::size_t k = 1; k < results.size(); ++k) {
+            ASSERT_EQ(results[k], results[0]);
+        }
+        // spot-check against the written data: (10, 20, 30) is in a stored chunk
+        EXPECT_EQ(results[0][(7 * 40 + 15) * 30 + 23], data[(10 * 64 + 20) * 64 + 30]);
+        // (3, 5, 7) is in the removed chunk (0, 0, 0)
+        EXPECT_EQ(results[0][0], 0.f);
+    }
+
+
+
+    TEST_F(StoreTest, MappedRawReads) {
+        // uncompressed zarr (plain and sharded) and n5 byte datasets with chunks above
+        // the mapping threshold, including edge chunks and missing chunks / shards
+        filesystem::handle::File fZarr(tmp / "data.zr"), fZarr3(tmp / "data3.zr"), fN5(tmp / "data.n5");
+        createFile(fZarr, true);
+        createFile(fZarr3, true, 3);
+        createFile(fN5, false);
+        const types::ShapeType shape = {70, 64, 80};
+        std::vector<std::unique_ptr<Dataset>> datasets;
+        datasets.push_back(createDataset(fZarr, "float", "float32", shape, {32, 32, 32}, "raw"));
+        datasets.push_back(createDataset(fZarr3, "sharded", "float32", shape, {32, 32, 32}, "raw",
+                                         types::CompressionOptions(), 0, "/", 3, "default", {64, 64, 64}));
+
+        std::vector<float> data(70 * 64 * 80);
+        std::iota(data.begin(), data.end(), 1.f);
+        const types::ShapeType offset = {0, 0, 0};
+        const float * dataPtr = data.data();
+        for(auto & ds : datasets) {
+            multiarray::writeSubarray<float>(*ds, multiarray::makeView(dataPtr, shape), offset.begin(), 2);
+        }
+        // drop a chunk of the plain dataset and write the sharded one sparsely
+        datasets[0]->removeChunk({1, 1, 1});
+        datasets[1]->removeChunk({0, 0, 0});
+
+        const types::ShapeType roiOffset = {5, 10, 15}, roiShape = {65, 50, 60};
+        for(const auto & ds : datasets) {
+            std::vector<std::vector<float>> results;
+            for(const bool mapped : {true, false}) {
+                filesystem::setUseMappedReads(mapped);
+                EXPECT_EQ(ds->supportsMappedReads(), mapped);
+                std::vector<float> out(65 * 50 * 60, -1.f);
+                multiarray::readSubarray<float>(*ds, multiarray::makeView(out.data(), roiShape),
+                                                roiOffset.begin(), 3);
+                results.push_back(out);
+            }
+            ASSERT_EQ(results[0], results[1]);
+            // (69, 59, 74) is in a stored edge chunk
+            EXPECT_EQ(results[0].back(), data.back() - 4 * 80 - 5);
+        }
+
+        auto dsByte = createDataset(fN5, "byte", "uint8", shape, {64, 32, 32}, "raw");
+        std::vector<uint8_t> bytes(data.size());
+        for(std::size_t i = 0; i < bytes.size(); ++i) {
+            bytes[i] = static_cast<uint8_t>(i % 251);
+        }
+        const uint8_t * bytesPtr = bytes.data();
+        multiarray::writeSubarray<uint8_t>(*dsByte, multiarray::makeView(bytesPtr, shape), offset.begin(), 1);
+        filesystem::setUseMappedReads(true);
+        std::vector<uint8_t> out(bytes.size());
+        multiarray::readSubarray<uint8_t>(*dsByte, multiarray::makeView(out.data(), shape), offset.begin(), 1);
+        EXPECT_EQ(out, bytes);
+    }
+
+
+    TEST_F(StoreTest, PartialShardReads) {
+        // 512 inner chunks per shard: small requests read the index and the touched
+        // slots only, large ones the whole shard
+        filesystem::handle::File f(tmp / "data.zr");
+        createFile(f, true, 3);
+        const types::ShapeType shape = {100, 64, 64};
+        auto ds = createDataset(f, "sharded", "int32", shape, {8, 8, 8}, "raw",
+                                types::CompressionOptions(), 0, "/", 3, "default", {64, 64, 64});
+        std::vector<int32_t> data(100 * 64 * 64);
+        std::iota(data.begin(), data.end(), 1);
+        const types::ShapeType offset = {0, 0, 0};
+        const int32_t * dataPtr = data.data();
+        multiarray::writeSubarray<int32_t>(*ds, multiarray::makeView(dataPtr, shape), offset.begin(), 2);
+        // empty slots between the touched ones
+        ds->removeChunk({1, 1, 1});
+        ds->removeChunk({8, 0, 0});
+
+        auto expected = [&](const types::ShapeType & roiOffset, const types::ShapeType & roiShape) {
+            std::vector<int32_t> out;
+            for(std::size_t z = 0; z < roiShape[0]; ++z) {
+                for(std::size_t y = 0; y < roiShape[1]; ++y) {
+                    for(std::size_t x = 0; x < roiShape[2]; ++x) {
+                        const types::ShapeType pos = {z + roiOffset[0], y + roiOffset[1], x + roiOffset[2]};
+                        const bool removed = (pos[0] / 8 == 1 && pos[1] / 8 == 1 && pos[2] / 8 == 1) ||
+                                             (pos[0] / 8 == 8 && pos[1] / 8 == 0 && pos[2] / 8 == 0);
+                        out.push_back(removed ? 0 : data[(pos[0] * 64 + pos[1]) * 64 + pos[2]]);
+                    }
+                }
+            }
+            return out;
+        };
+
+        const std::vector<std::pair<types::ShapeType, types::ShapeType>> rois = {
+            {{5, 3, 2}, {12, 20, 9}}, {{60, 0, 0}, {10, 10, 40}}, {{0, 0, 0}, {100, 64, 64}}};
+        for(const bool mapped : {true, false}) {
+            filesystem::setUseMappedReads(mapped);
+            for(const auto & roi : rois) {
+                const auto & roiShape = roi.second;
+                std::vector<int32_t> out(roiShape[0] * roiShape[1] * roiShape[2], -1);
+                multiarray::readSubarray<int32_t>(*ds, multiarray::makeView(out.data(), roiShape),
+                                                  roi.first.begin(), 2);
+                ASSERT_EQ(out, expected(roi.first, roiShape)) << "mapped " << mapped;
+            }
+        }
+
+        // single chunks are read from the index and their slot
+        EXPECT_TRUE(ds->chunkExists({2, 3, 4}));
+        EXPECT_FALSE(ds->chunkExists({1, 1, 1}));
+        std::vector<int32_t> chunk(8 * 8 * 8);
+        ds->readChunk({12, 7, 7}, chunk.data());
+        EXPECT_EQ(chunk[0], data[(96 * 64 + 56) * 64 + 56]);
+        std::vector<char> raw;
+        ds->readRawChunk({1, 1, 1}, raw);
+        EXPECT_TRUE(raw.empty());
+    }
+
+
+    TEST_F(StoreTest, ShardIndexCache) {
+        filesystem::handle::File f(tmp / "data.zr");
+        createFile(f, true, 3);
+        const types::ShapeType shape = {32, 32};
+        auto ds = createDataset(f, "sharded", "int32", shape, {8, 8}, "raw",
+                                types::CompressionOptions(), 0, "/", 3, "default", {16, 16});
+        std::vector<int32_t> chunk(8 * 8, 7);
+        ds->writeChunk({0, 0}, chunk.data());
+        EXPECT_TRUE(ds->chunkExists({0, 0}));
+        EXPECT_FALSE(ds->chunkExists({0, 1}));
+
+        // another writer (a second dataset object, with its own cache) changes the shard
+        auto other = openDataset(f, "sharded");
+        std::fill(chunk.begin(), chunk.end(), 9);
+        other->writeChunk({0, 1}, chunk.data());
+        other->removeChunk({0, 0});
+        EXPECT_FALSE(ds->chunkExists({0, 0}));
+        EXPECT_TRUE(ds->chunkExists({0, 1}));
+        std::vector<int32_t> out(8 * 8);
+        ds->readChunk({0, 1}, out.data());
+        EXPECT_EQ(out, chunk);
+
+        // and writes through the dataset keep its cache up to date
+        ds->removeChunk({0, 1});
+        EXPECT_FALSE(ds->chunkExists({0, 1}));
+        ds->writeChunk({1, 1}, chunk.data());
+        EXPECT_TRUE(ds->chunkExists({1, 1}));
+        EXPECT_FALSE(other->chunkExists({0, 1}));
+        EXPECT_TRUE(other->chunkExists({1, 1}));
+
+        // a corrupt shard is detected even if its index was cached before
+        fs::path shardPath;
+        ds->chunkPath({1, 1}, shardPath);
+        {
+            std::fstream file(shardPath, std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(-1, std::ios::end);
+            file.put('x');
+        }
+        fs::last_write_time(shardPath, fs::last_write_time(shardPath) + std::chrono::seconds(1));
+        EXPECT_THROW(ds->chunkExists({1, 1}), std::runtime_error);
+    }
+
+
+    TEST_F(StoreTest, InPlaceShardUpdates) {
+        filesystem::handle::File f(tmp / "data.zr");
+        createFile(f, true, 3);
+        const types::ShapeType shape = {64, 64};
+        auto ds = createDataset(f, "sharded", "int32", shape, {8, 8}, "raw",
+                                types::CompressionOptions(), 0, "/", 3, "default", {64, 64});
+        std::vector<int32_t> data(64 * 64);
+        std::iota(data.begin(), data.end(), 1);
+        const types::ShapeType offset = {0, 0};
+        const int32_t * dataPtr = data.data();
+        multiarray::writeSubarray<int32_t>(*ds, multiarray::makeView(dataPtr, shape), offset.begin(), 1);
+
+        fs::path shardPath;
+        ds->chunkPath({0, 0}, shardPath);
+        const std::size_t blobSize = 8 * 8 * sizeof(int32_t);
+        const std::size_t fullSize = fs::file_size(shardPath);
+
+        auto check = [&](const Dataset & dataset) {
+            std::vector<int32_t> out(data.size());
+            multiarray::readSubarray<int32_t>(dataset, multiarray::makeView(out.data(), shape), offset.begin(), 1);
+            return out == data;
+        };
+
+        // writing one chunk appends its blob and a new index
+        std::vector<int32_t> chunk(8 * 8, -3);
+        ds->writeChunk({2, 5}, chunk.data());
+        for(std::size_t y = 0; y < 8; ++y) {
+            std::fill_n(data.begin() + (16 + y) * 64 + 40, 8, -3);
+        }
+        EXPECT_EQ(fs::file_size(shardPath), fullSize + blobSize);
+        EXPECT_TRUE(check(*ds));
+
+        // as does a sub-array write; partially overwritten chunks keep their other values
+        const types::ShapeType roiOffset = {3, 30}, roiShape = {4, 12};
+        std::vector<int32_t> roi(4 * 12, -7);
+        multiarray::writeSubarray<int32_t>(*ds, multiarray::makeView(roi.data(), roiShape), roiOffset.begin(), 2);
+        for(std::size_t y = 3; y < 7; ++y) {
+            std::fill_n(data.begin() + y * 64 + 30, 12, -7);
+        }
+        EXPECT_EQ(fs::file_size(shardPath), fullSize + 4 * blobSize);
+        // removing a chunk only rewrites the index
+        ds->removeChunk({7, 7});
+        for(std::size_t y = 56; y < 64; ++y) {
+            std::fill_n(data.begin() + y * 64 + 56, 8, 0);
+        }
+        EXPECT_EQ(fs::file_size(shardPath), fullSize + 4 * blobSize);
+        EXPECT_TRUE(check(*ds));
+        // the shard is a regular shard for other readers
+        auto other = openDataset(f, "sharded");
+        EXPECT_TRUE(check(*other));
+
+        // once more than half of the shard is dead, it is rewritten
+        for(int i = 0; i < 40; ++i) {
+            ds->writeChunk({2, 5}, chunk.data());
+        }
+        EXPECT_LE(fs::file_size(shardPath), 2 * fullSize);
+        EXPECT_TRUE(check(*ds));
+
+        // without in-place updates the shard is rewritten every time
+        filesystem::setUseShardAppend(false);
+        ds->writeChunk({2, 5}, chunk.data());
+        EXPECT_EQ(fs::file_size(shardPath), fullSize - blobSize);
+        EXPECT_TRUE(check(*ds));
+    }
+
+
+    TEST_F(StoreTest, ShardWriteBack) {
+        filesystem::handle::File f(tmp / "data.zr");
+        createFile(f, true, 3);
+        const types::ShapeType shape = {64, 64};
+        const std::size_t chunkBytes = 8 * 8 * sizeof(int32_t);
+        util::setShardWriteBackBytes(20 * chunkBytes);
+        auto ds = createDataset(f, "sharded", "int32", shape, {8, 8}, "raw",
+                                types::CompressionOptions(), 0, "/", 3, "default", {32, 32});
+        util::setShardWriteBackBytes(0);
+
+        // write all chunks of the first row of shards from several threads
+        std::vector<std::thread> threads;
+        for(std::size_t t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t]{
+                for(std::size_t y = t; y < 4; y += 4) {
+                    for(std::size_t x = 0; x < 8; ++x) {
+                        std::vector<int32_t> chunk(8 * 8, static_cast<int32_t>(y * 8 + x + 1));
+                        ds->writeChunk({y, x}, chunk.data());
+                    }
+                }
+            });
+        }
+        for(auto & thread : threads) {
+            thread.join();
+        }
+        // 32 chunks exceed the budget of 20, so the first 21 were written by then
+        fs::path shard0, shard1;
+        ds->chunkPath({0, 0}, shard0);
+        ds->chunkPath({0, 4}, shard1);
+        EXPECT_TRUE(fs::exists(shard0) || fs::exists(shard1));
+
+        // pending chunks are visible to reads of the dataset and written by flush
+        ds->removeChunk({0, 0});
+        EXPECT_FALSE(ds->chunkExists({0, 0}));
+        std::vector<int32_t> chunk(8 * 8);
+        ds->readChunk({3, 7}, chunk.data());
+        EXPECT_EQ(chunk[0], 3 * 8 + 7 + 1);
+        ds->writeChunk({7, 7}, chunk.data());
+        fs::path shard3;
+        ds->chunkPath({7, 7}, shard3);
+        EXPECT_FALSE(fs::exists(shard3));
+        ds->flush();
+        EXPECT_TRUE(fs::exists(shard3));
+
+        // and by the destructor
+        ds->writeChunk({0, 0}, chunk.data());
+        ds.reset();
+        auto other = openDataset(f, "sharded");
+        other->readChunk({0, 0}, chunk.data());
+        EXPECT_EQ(chunk[0], 3 * 8 + 7 + 1);
+        other->readChunk({2, 5}, chunk.data());
+        EXPECT_EQ(chunk[0], 2 * 8 + 5 + 1);
+        EXPECT_TRUE(other->chunkExists({7, 7}));
+        EXPECT_FALSE(other->chunkExists({6, 6}));
+    }
+
+
+    TEST_F(StoreTest, ShardWriteBackRetriesFailedWrites) {
+        filesystem::handle::File f(tmp / "data.zr");
+        createFile(f, true, 3);
+        util::setShardWriteBackBytes(std::size_t(1) << 20);
+        auto ds = createDataset(f, "sharded", "int32", {64, 64}, {8, 8}, "raw",
+                                types::CompressionOptions(), 0, "/", 3, "default", {32, 32});
+
+        // a directory in place of the shard makes its write fail
+        fs::path shardPath;
+        ds->chunkPath({0, 0}, shardPath);
+        fs::create_directories(shardPath);
+        std::vector<int32_t> chunk(8 * 8, 1);
+        ds->writeChunk({0, 0}, chunk.data());
+        ds->writeChunk({0, 1}, chunk.data());
+        EXPECT_THROW(ds->flush(), std::runtime_error);
+
+        // the chunks are still pending; newer writes of them win over the failed ones
+        std::fill(chunk.begin(), chunk.end(), 2);
+        ds->writeChunk({0, 1}, chunk.data());
+        fs::remove(shardPath);
+        ds->flush();
+        EXPECT_TRUE(fs::is_regular_file(shardPath));
+        ds.reset();
+        auto other = openDataset(f, "sharded");
+        other->readChunk({0, 0}, chunk.data());
+        EXPECT_EQ(chunk[0], 1);
+        other->readChunk({0, 1}, chunk.data());
+        EXPECT_EQ(chunk[0], 2);
+        EXPECT_FALSE(other->chunkExists({1, 1}));
+    }
+
+
+    TEST_F(StoreTest, ConcurrentShardWrites) {
+        // writers of the same and of different shards next to readers of those shards
+        filesystem::handle::File f(tmp / "data.zr");
+        createFile(f, true, 3);
+        const types::ShapeType shape = {64, 64};
+        auto ds = createDataset(f, "sharded", "int32", shape, {8, 8}, "raw",
+                                types::CompressionOptions(), 0, "/", 3, "default", {16, 16});
+
+        std::atomic<bool> done(false);
+        std::atomic<int> readErrors(0);
+        std::thread reader([&]{
+            std::vector<int32_t> chunk(8 * 8);
+            while(!done) {
+                for(std::size_t y = 0; y < 8; ++y) {
+                    try {
+                        if(ds->chunkExists({y, y})) {
+                            ds->readChunk({y, y}, chunk.data());
+                            if(chunk[0] != static_cast<int32_t>(y * 8 + y + 1)) {
+                                ++readErrors;
+                            }
+                        }
+                    } catch(const std::exception &) {
+                        ++readErrors;
+                    }
+                }
+            }
+        });
+
+        std::vector<std::thread> writers;
+        for(std::size_t t = 0; t < 4; ++t) {
+            writers.emplace_back([&, t]{
+                for(std::size_t y = 0; y < 8; ++y) {
+                    for(std::size_t x = t; x < 8; x += 4) {
+                        std::vector<int32_t> chunk(8 * 8, static_cast<int32_t>(y * 8 + x + 1));
+                        ds->writeChunk({y, x}, chunk.data());
+                    }
+                }
+            });
+        }
+        for(auto & writer : writers) {
+            writer.join();
+        }
+        done = true;
+        reader.join();
+        EXPECT_EQ(readErrors.load(), 0);
+
+        std::vector<int32_t> out(64 * 64);
+        const types::ShapeType offset = {0, 0};
+        multiarray::readSubarray<int32_t>(*ds, multiarray::makeView(out.data(), shape), offset.begin(), 2);
+        for(std::size_t y = 0; y < 64; ++y) {
+            for(std::size_t x = 0; x < 64; ++x) {
+                ASSERT_EQ(out[y * 64 + x], static_cast<int32_t>((y / 8) * 8 + x / 8 + 1));
+            }
+        }
+
+        // removing the chunks of a shard from several threads
+        util::removeDataset(*ds, 4);
+        EXPECT_FALSE(fs::exists(tmp / "data.zr" / "sharded"));
+    }
+
+
+    TEST_F(StoreTest, RemoveShardedChunks) {
+        filesystem::handle::File f(tmp / "data.zr");
+        createFile(f, true, 3);
+        const types::ShapeType shape = {64, 64};
+        auto ds = createDataset(f, "sharded", "int32", shape, {8, 8}, "raw",
+                                types::CompressionOptions(), 0, "/", 3, "default", {32, 32});
+        std::vector<int32_t> data(64 * 64, 1);
+        const types::ShapeType offset = {0, 0};
+        multiarray::writeSubarray<int32_t>(*ds, multiarray::makeView(data.data(), shape), offset.begin(), 2);
+
+        // all chunks of the first shard and every other chunk of the second one
+        std::vector<types::ShapeType> removed;
+        for(std::size_t y = 0; y < 4; ++y) {
+            for(std::size_t x = 0; x < 8; ++x) {
+                if(x < 4 || (x + y) % 2 == 0) {
+                    removed.push_back({y, x});
+                }
+            }
+        }
+        ds->removeChunks(removed, 4);
+        fs::path shard0, shard1;
+        ds->chunkPath({0, 0}, shard0);
+        ds->chunkPath({0, 4}, shard1);
+        EXPECT_FALSE(fs::exists(shard0));
+        EXPECT_TRUE(fs::exists(shard1));
+        for(std::size_t y = 0; y < 8; ++y) {
+            for(std::size_t x = 0; x < 8; ++x) {
+                const bool isRemoved = y < 4 && (x < 4 || (x + y) % 2 == 0);
+                EXPECT_EQ(ds->chunkExists({y, x}), !isRemoved);
+            }
+        }
+    }
+
+
+    TEST_F(StoreTest, IntraShardParallelCodec) {
+        // a single shard: its inner chunks are encoded / decoded by several threads
+        filesystem::handle::File f(tmp / "data.zr");
+        createFile(f, true, 3);
+        const types::ShapeType shape = {64, 64};
+        std::vector<int32_t> data(64 * 64);
+        std::iota(data.begin(), data.end(), 0);
+        const types::ShapeType offset = {0, 0};
+
+        for(const bool append : {true, false}) {
+            filesystem::setUseShardAppend(append);
+            const std::string name = append ? "append" : "rewrite";
+            auto ds = createDataset(f, name, "int32", shape, {8, 8}, "raw",
+                                    types::CompressionOptions(), 0, "/", 3, "default", {64, 64});
+            multiarray::writeSubarray<int32_t>(*ds, multiarray::makeView(data.data(), shape), offset.begin(), 8);
+
+            // partially overwrite chunks of the shard
+            std::vector<int32_t> patch(20 * 30, -1);
+            const types::ShapeType patchShape = {20, 30}, patchOffset = {5, 13};
+            multiarray::writeSubarray<int32_t>(*ds, multiarray::makeView(patch.data(), patchShape),
+                                               patchOffset.begin(), 8);
+            auto expected = data;
+            for(std::size_t y = 5; y < 25; ++y) {
+                for(std::size_t x = 13; x < 43; ++x) {
+                    expected[y * 64 + x] = -1;
+                }
+            }
+
+            for(const int nThreads : {1, 8}) {
+                std::vector<int32_t> out(64 * 64, 0);
+                multiarray::readSubarray<int32_t>(*ds, multiarray::makeView(out.data(), shape),
+                                                  offset.begin(), nThreads);
+                ASSERT_EQ(out, expected) << name << ", " << nThreads << " threads";
+            }
+        }
+    }
+
+
+    TEST_F(StoreTest, ShardIndexLayouts) {
+        // shards with the index at the start and / or without crc32c
+        filesystem::handle::File f(tmp / "data.zr");
+        createFile(f, true, 3);
+        const types::ShapeType shape = {64, 64};
+        const std::size_t nSlots = 16;
+        std::vector<int32_t> data(64 * 64);
+        std::iota(data.begin(), data.end(), 0);
+        const types::ShapeType offset = {0, 0};
+
+        for(const bool atStart : {true, false}) {
+            for(const bool checksum : {true, false}) {
+                const std::string name = std::string(atStart ? "start" : "end") + (checksum ? "_crc" : "");
+                DatasetMetadata metadata;
+                createDatasetMetadata("int32", shape, {8, 8}, true, "raw", types::CompressionOptions(),
+                                      0, "/", metadata, 3, "default", {32, 32}, atStart ? "start" : "end");
+                metadata.shardIndexChecksum = checksum;
+                filesystem::handle::Dataset handle(f, name, "/", 3, "default");
+                auto ds = filesystem::createDataset(handle, metadata);
+                multiarray::writeSubarray<int32_t>(*ds, multiarray::makeView(data.data(), shape), offset.begin(), 2);
+
+                // the stored shard has the requested layout
+                const util::ShardIndexLayout layout{atStart, checksum};
+                fs::path shardPath;
+                ds->chunkPath({0, 0}, shardPath);
+                std::ifstream file(shardPath, std::ios::binary);
+                const std::vector<char> shard((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+                std::vector<util::ShardEntry> entries;
+                ASSERT_TRUE(util::parseShardIndex(shard, nSlots, entries, layout)) << name;
+                ASSERT_EQ(shard.size(), util::shardIndexSize(nSlots, layout) + nSlots * 8 * 8 * sizeof(int32_t));
+                EXPECT_EQ(entries[0].offset, atStart ? util::shardIndexSize(nSlots, layout) : 0);
+
+                // the layout is stored in the metadata
+                auto reopened = filesystem::openDataset(handle);
+                ds->writeChunk({1, 1}, std::vector<int32_t>(8 * 8, -1).data());
+                std::vector<int32_t> out(64 * 64);
+                // partial reads (index first) and full shard reads
+                for(const types::ShapeType & roi : {types::ShapeType{8, 8}, shape}) {
+                    multiarray::readSubarray<int32_t>(*reopened, multiarray::makeView(out.data(), roi),
+                                                      offset.begin(), 1);
+                    for(std::size_t y = 0; y < roi[0]; ++y) {
+                        for(std::size_t x = 0; x < roi[1]; ++x) {
+                            const int32_t expected = (y >= 8 && y < 16 && x >= 8 && x < 16) ? -1 : data[y * 64 + x];
+                            ASSERT_EQ(out[y * roi[1] + x], expected) << name;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+
+    TEST_F(StoreTest, ShardBlobOrder) {
+        // the blobs of a 2x2x2 block of inner chunks are contiguous in morton / hilbert order
+        filesystem::handle::File f(tmp / "data.zr");
+        createFile(f, true, 3);
+        const types::ShapeType shape = {32, 32, 24};
+        const std::size_t blobSize = 4 * 4 * 4 * sizeof(int32_t);
+        std::vector<int32_t> data(32 * 32 * 24);
+        std::iota(data.begin(), data.end(), 0);
+        const types::ShapeType offset = {0, 0, 0};
+
+        for(const auto order : {util::ShardBlobOrder::c, util::ShardBlobOrder::morton, util::ShardBlobOrder::hilbert}) {
+            util::setShardBlobOrder(order);
+            const std::string name = "order" + std::to_string(static_cast<int>(order));
+            // 8 x 8 x 6 inner chunks per shard (not a power of two along the last axis)
+            auto ds = createDataset(f, name, "int32", shape, {4, 4, 4}, "raw",
+                                    types::CompressionOptions(), 0, "/", 3, "default", {32, 32, 24});
+            util::setShardBlobOrder(util::ShardBlobOrder::c);
+            multiarray::writeSubarray<int32_t>(*ds, multiarray::makeView(data.data(), shape), offset.begin(), 2);
+
+            fs::path shardPath;
+            ds->chunkPath({0, 0, 0}, shardPath);
+            std::ifstream file(shardPath, std::ios::binary);
+            const std::vector<char> shard((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            std::vector<util::ShardEntry> entries;
+            ASSERT_TRUE(util::parseShardIndex(shard, 8 * 8 * 6, entries));
+            // every blob is stored once
+            std::vector<uint64_t> offsets;
+            for(const auto & entry : entries) {
+                offsets.push_back(entry.offset);
+            }
+            std::sort(offsets.begin(), offsets.end());
+            for(std::size_t k = 0; k < offsets.size(); ++k) {
+                ASSERT_EQ(offsets[k], k * blobSize);
+            }
+
+            uint64_t first = util::SHARD_EMPTY, last = 0;
+            for(std::size_t z = 2; z < 4; ++z) {
+                for(std::size_t y = 2; y < 4; ++y) {
+                    for(std::size_t x = 2; x < 4; ++x) {
+                        const auto & entry = entries[util::shardSlot({z, y, x}, {8, 8, 6})];
+                        first = std::min(first, entry.offset);
+                        last = std::max(last, entry.offset);
+                    }
+                }
+            }
+            if(order == util::ShardBlobOrder::c) {
+                EXPECT_GT(last - first, 7 * blobSize);
+            } else {
+                EXPECT_EQ(last - first, 7 * blobSize);
+            }
+
+            // appended updates and reads
+            ds->writeChunk({1, 1, 1}, std::vector<int32_t>(4 * 4 * 4, -1).data());
+            std::vector<int32_t> out(data.size());
+            multiarray::readSubarray<int32_t>(*ds, multiarray::makeView(out.data(), shape), offset.begin(), 2);
+            for(std::size_t i = 0; i < out.size(); ++i) {
+                const std::size_t z = i / (32 * 24), y = (i / 24) % 32, x = i % 24;
+                const bool updated = z / 4 == 1 && y / 4 == 1 && x / 4 == 1;
+                ASSERT_EQ(out[i], updated ? -1 : data[i]);
+            }
+        }
+    }
+
+
+    TEST_F(StoreTest, DecodedChunkCache) {
+        filesystem::handle::File f(tmp / "data.zr");
+        createFile(f, true, 3);
+        const types::ShapeType shape = {30, 30};
+        std::vector<int32_t> data(30 * 30);
+        std::iota(data.begin(), data.end(), 0);
+        const types::ShapeType offset = {0, 0};
+
+        util::setChunkCacheBytes(std::size_t(1) << 20);
+        for(const bool sharded : {false, true}) {
+            const std::string name = sharded ? "sharded" : "plain";
+            auto ds = sharded ? createDataset(f, name, "int32", shape, {8, 8}, "raw",
+                                              types::CompressionOptions(), 0, "/", 3, "default", {16, 16})
+                              : createDataset(f, name, "int32", shape, {8, 8}, "raw");
+            multiarray::writeSubarray<int32_t>(*ds, multiarray::makeView(data.data(), shape), offset.begin(), 2);
+            auto & cache = ds->chunkCache();
+            ASSERT_TRUE(cache.enabled());
+
+            // the first read decodes all 16 chunks, the overlapping second one (4 x 3
+            // chunks, including edge chunks) is served from the cache
+            std::vector<int32_t> out(data.size());
+            multiarray::readSubarray<int32_t>(*ds, multiarray::makeView(out.data(), shape), offset.begin(), 2);
+            ASSERT_EQ(out, data) << name;
+            EXPECT_EQ(cache.misses(), 16) << name;
+            EXPECT_EQ(cache.hits(), 0) << name;
+
+            const types::ShapeType tileShape = {20, 20}, tileOffset = {7, 10};
+            std::vector<int32_t> tile(20 * 20);
+            multiarray::readSubarray<int32_t>(*ds, multiarray::makeView(tile.data(), tileShape),
+                                              tileOffset.begin(), 2);
+            EXPECT_EQ(cache.hits(), 12) << name;
+            EXPECT_EQ(cache.misses(), 16) << name;
+            for(std::size_t y = 0; y < 20; ++y) {
+                for(std::size_t x = 0; x < 20; ++x) {
+                    ASSERT_EQ(tile[y * 20 + x], data[(y + 7) * 30 + x + 10]) << name;
+                }
+            }
+
+            // writes invalidate the chunks they change: through writeChunk ...
+            ds->writeChunk({1, 1}, std::vector<int32_t>(8 * 8, -1).data());
+            auto expected = data;
+            for(std::size_t y = 8; y < 16; ++y) {
+                for(std::size_t x = 8; x < 16; ++x) {
+                    expected[y * 30 + x] = -1;
+                }
+            }
+            // ... and through writeSubarray
+            std::vector<int32_t> patch(4 * 4, -2);
+            const types::ShapeType patchShape = {4, 4}, patchOffset = {26, 0};
+            multiarray::writeSubarray<int32_t>(*ds, multiarray::makeView(patch.data(), patchShape),
+                                               patchOffset.begin(), 2);
+            for(std::size_t y = 26; y < 30; ++y) {
+                for(std::size_t x = 0; x < 4; ++x) {
+                    expected[y * 30 + x] = -2;
+                }
+            }
+            cache.resetCounters();
+            multiarray::readSubarray<int32_t>(*ds, multiarray::makeView(out.data(), shape), offset.begin(), 2);
+            ASSERT_EQ(out, expected) << name;
+            // the sub-array write of a sharded dataset drops all cached chunks of its shard
+            EXPECT_EQ(cache.misses(), sharded ? 5 : 2) << name;
+            EXPECT_EQ(cache.hits(), sharded ? 11 : 14) << name;
+        }
+    }
+
+
+    TEST_F(StoreTest, StoredChunkCache) {
+        filesystem::handle::File f(tmp / "data.zr");
+        createFile(f, true, 3);
+        const types::ShapeType shape = {30, 30};
+        std::vector<int32_t> data(30 * 30);
+        std::iota(data.begin(), data.end(), 0);
+        const types::ShapeType offset = {0, 0};
+        types::CompressionOptions cOpts;
+        cOpts["level"] = 5;
+        cOpts["useZlib"] = true;
+
+        util::setStoredChunkCacheBytes(std::size_t(1) << 20);
+        for(const bool sharded : {false, true}) {
+            const std::string name = sharded ? "sharded" : "plain";
+            auto ds = sharded ? createDataset(f, name, "int32", shape, {8, 8}, "zlib",
+                                              cOpts, 0, "/", 3, "default", {16, 16})
+                              : createDataset(f, name, "int32", shape, {8, 8}, "zlib", cOpts);
+            multiarray::writeSubarray<int32_t>(*ds, multiarray::makeView(data.data(), shape), offset.begin(), 2);
+            auto & cache = ds->storedChunkCache();
+            ASSERT_TRUE(cache.enabled());
+            // forget the reads of partially written chunks
+            cache.clear();
+            cache.resetCounters();
+
+            // chunks are admitted on their second access ...
+            std::vector<int32_t> out(data.size());
+            for(int pass = 0; pass < 2; ++pass) {
+                multiarray::readSubarray<int32_t>(*ds, multiarray::makeView(out.data(), shape), offset.begin(), 2);
+                ASSERT_EQ(out, data) << name;
+            }
+            EXPECT_EQ(cache.misses(), 32) << name;
+            EXPECT_EQ(cache.hits(), 0) << name;
+            EXPECT_EQ(cache.size(), 16) << name;
+
+            // ... and then read from the cache by sub-array and chunk reads
+            const types::ShapeType tileShape = {20, 20}, tileOffset = {7, 10};
+            std::vector<int32_t> tile(20 * 20);
+            multiarray::readSubarray<int32_t>(*ds, multiarray::makeView(tile.data(), tileShape),
+                                              tileOffset.begin(), 2);
+            EXPECT_EQ(cache.hits(), 12) << name;
+            for(std::size_t y = 0; y < 20; ++y) {
+                for(std::size_t x = 0; x < 20; ++x) {
+                    ASSERT_EQ(tile[y * 20 + x], data[(y + 7) * 30 + x + 10]) << name;
+                }
+            }
+            std::vector<int32_t> chunk(8 * 8);
+            ds->readChunk({0, 1}, chunk.data());
+            EXPECT_EQ(chunk[0], 8) << name;
+            EXPECT_EQ(cache.hits(), 13) << name;
+
+            // writes invalidate the chunks they change
+            ds->writeChunk({1, 1}, std::vector<int32_t>(8 * 8, -1).data());
+            EXPECT_EQ(cache.size(), 15) << name;
+            ds->readChunk({1, 1}, chunk.data());
+            EXPECT_EQ(chunk, std::vector<int32_t>(8 * 8, -1)) << name;
+            EXPECT_EQ(cache.misses(), 33) << name;
+        }
+
+        // a chunk read once is cached right away with CacheAdmission::always, and never
+        // without a budget
+        util::setStoredChunkCacheAdmission(util::CacheAdmission::always);
+        auto ds = openDataset(f, "plain");
+        EXPECT_EQ(ds->storedChunkCache().admission(), util::CacheAdmission::always);
+        std::vector<int32_t> chunk(8 * 8);
+        ds->readChunk({0, 0}, chunk.data());
+        EXPECT_EQ(ds->storedChunkCache().size(), 1);
+        util::setStoredChunkCacheBytes(0);
+        ds = openDataset(f, "plain");
+        EXPECT_FALSE(ds->storedChunkCache().enabled());
+    }
+
+}
@@ -0,0 +1,233 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "z5/util/pipeline.hxx"
+
+
+namespace z5 {
+namespace util {
+
+    // track the maximal value of a concurrently updated counter
+    inline void updateMax(std::atomic<int> & maxValue, const int value) {
+        int prev = maxValue.load();
+        while(value > prev && !maxValue.compare_exchange_weak(prev, value)) {}
+    }
+
+    TEST(ReadPipelineTest, ProcessesAllItems) {
+        const std::size_t nItems = 500;
+        std::vector<std::atomic<int>> decoded(nItems);
+        runReadPipeline<std::vector<char>>(nItems, 4,
+            [](const std::size_t i, std::vector<char> & item){
+                item.assign(i % 7 + 1, static_cast<char>(i % 128));
+            },
+            [&](std::vector<char> & item, const std::size_t i){
+                // the decoder sees the data read for the same item
+                ASSERT_EQ(item.size(), i % 7 + 1);
+                ASSERT_EQ(item[0], static_cast<char>(i % 128));
+                ++decoded[i];
+            });
+        for(std::size_t i = 0; i < nItems; ++i) {
+            EXPECT_EQ(decoded[i].load(), 1);
+        }
+    }
+
+    TEST(ReadPipelineTest, ConcurrencyLimits) {
+        // slow "storage": with 6 reads in flight and 2 decoders the reads overlap,
+        // but neither stage exceeds its limit
+        setReadIoConcurrency(6);
+        std::atomic<int> ioActive(0), ioMax(0), decodeActive(0), decodeMax(0);
+        const int nThreads = 2;
+        runReadPipeline<int>(48, nThreads,
+            [&](const std::size_t, int &){
+                updateMax(ioMax, ++ioActive);
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                --ioActive;
+            },
+            [&](int &, const std::size_t){
+                updateMax(decodeMax, ++decodeActive);
+                --decodeActive;
+            });
+        setReadIoConcurrency(0);
+        EXPECT_LE(ioMax.load(), 6);
+        EXPECT_GT(ioMax.load(), 1);
+        EXPECT_LE(decodeMax.load(), static_cast<int>(codecConcurrency(nThreads)));
+    }
+
+    TEST(ReadPipelineTest, SingleThreaded) {
+        const auto caller = std::this_thread::get_id();
+        std::size_t count = 0;
+        runReadPipeline<int>(20, 1,
+            [&](const std::size_t i, int & item){
+                EXPECT_EQ(std::this_thread::get_id(), caller);
+                item = static_cast<int>(i);
+            },
+            [&](int & item, const std::size_t i){
+                EXPECT_EQ(std::this_thread::get_id(), caller);
+                EXPECT_EQ(item, static_cast<int>(i));
+                ++count;
+            });
+        EXPECT_EQ(count, 20);
+    }
+
+    TEST(ReadPipelineTest, ReleasesLargeItems) {
+        // the items are retained by the calling thread across calls unless they are large
+        auto runWithCapacity = [](const std::size_t capacity, std::vector<std::size_t> & previous) {
+            previous.clear();
+            runReadPipeline<std::vector<char>>(8, 1,
+                [&](const std::size_t, std::vector<char> & item){
+                    previous.push_back(item.capacity());
+                    item.reserve(capacity);
+                },
+                [](std::vector<char> &, const std::size_t){});
+        };
+        std::vector<std::size_t> previous;
+        runWithCapacity(1024, previous);
+        runWithCapacity(std::size_t(8) << 20, previous);
+        for(const auto capacity : previous) {
+            EXPECT_GE(capacity, 1024);
+        }
+        runWithCapacity(1024, previous);
+        for(const auto capacity : previous) {
+            EXPECT_LE(capacity, pipeline_detail::maxRetainedItemBytes);
+        }
+    }
+
+    TEST(ReadPipelineTest, PropagatesException) {
+        EXPECT_THROW(
+            runReadPipeline<int>(100, 4,
+                [](const std::size_t i, int &){
+                    if(i == 17) {
+                        throw std::runtime_error("read failed");
+                    }
+                },
+                [](int &, const std::size_t){}),
+            std::runtime_error);
+        EXPECT_THROW(
+            runReadPipeline<int>(100, 4,
+                [](const std::size_t, int &){},
+                [](int &, const std::size_t i){
+                    if(i == 42) {
+                        throw std::runtime_error("decode failed");
+                    }
+                }),
+            std::runtime_error);
+    }
+
+    TEST(WritePipelineTest, ByteBudget) {
+        // the compressed items waiting for the (slow) writers stay within the budget
+        // (plus the items being encoded when it ran out)
+        setWriteQueueBytes(1000);
+        std::mutex mutex;
+        std::size_t queued = 0, maxQueued = 0;
+        std::vector<int> stored(64, 0);
+        runWritePipeline<std::vector<char>>(64, 4,
+            [&](const std::size_t, std::vector<char> & blob){
+                blob.assign(400, 1);
+                std::lock_guard<std::mutex> lock(mutex);
+                queued += blob.size();
+                maxQueued = std::max(maxQueued, queued);
+            },
+            [&](const std::vector<char> & blob, const std::size_t i){
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                std::lock_guard<std::mutex> lock(mutex);
+                queued -= blob.size();
+                ++stored[i];
+            },
+            [](const std::vector<char> & blob){ return blob.size(); });
+        setWriteQueueBytes(std::size_t(256) << 20);
+        for(const int s : stored) {
+            EXPECT_EQ(s, 1);
+        }
+        EXPECT_LE(maxQueued, 1000 + 400 * codecConcurrency(4));
+    }
+
+    TEST(AsyncRequestTest, CompletionAndErrors) {
+        std::atomic<int> value(0);
+        std::atomic<bool> called(false);
+        auto request = submitAsync([&]{ value = 42; });
+        request.onDone([&]{ called = true; });
+        request.get();
+        EXPECT_TRUE(request.ready());
+        EXPECT_FALSE(request.cancelled());
+        EXPECT_EQ(value.load(), 42);
+        // the callback runs on the completing thread, possibly just after the waiters wake up
+        while(!called) {
+            std::this_thread::yield();
+        }
+        // registering on a finished request calls back right away
+        bool calledNow = false;
+        request.onDone([&]{ calledNow = true; });
+        EXPECT_TRUE(calledNow);
+        EXPECT_FALSE(request.cancel());
+
+        auto failing = submitAsync([]{ throw std::runtime_error("failed"); });
+        EXPECT_THROW(failing.get(), std::runtime_error);
+        EXPECT_FALSE(failing.cancelled());
+    }
+
+    TEST(AsyncRequestTest, CancelRunningPipeline) {
+        std::atomic<int> nRead(0);
+        std::atomic<bool> started(false);
+        auto request = submitAsync([&]{
+            runReadPipeline<int>(1000, 2,
+                [&](const std::size_t, int &){
+                    started = true;
+                    ++nRead;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                },
+                [](int &, const std::size_t){});
+        });
+        while(!started) {
+            std::this_thread::yield();
+        }
+        request.cancel();
+        EXPECT_THROW(request.get(), RequestCancelled);
+        EXPECT_TRUE(request.cancelled());
+        EXPECT_LT(nRead.load(), 1000);
+    }
+
+    TEST(AsyncRequestTest, ShrinkingThePoolRunsQueuedRequests) {
+        // one worker, held by the first request, so that the others stay queued
+        setSharedThreadPoolSize(1);
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool started = false, release = false;
+        auto blocking = submitAsync([&]{
+            std::unique_lock<std::mutex> lock(mutex);
+            started = true;
+            cv.notify_all();
+            cv.wait(lock, [&]{ return release; });
+        });
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]{ return started; });
+        }
+        std::atomic<int> nDone(0);
+        std::vector<AsyncRequest> queued;
+        for(int i = 0; i < 3; ++i) {
+            queued.push_back(submitAsync([&]{ ++nDone; }));
+        }
+
+        // no worker is left for the queued requests: they run on this thread
+        setSharedThreadPoolSize(0);
+        for(auto & request : queued) {
+            request.wait();
+        }
+        EXPECT_EQ(nDone.load(), 3);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            release = true;
+        }
+        cv.notify_all();
+        blocking.wait();
+        setSharedThreadPoolSize(4);
+    }
+
+}
+}
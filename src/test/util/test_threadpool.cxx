@@ -0,0 +1,166 @@
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "z5/util/threadpool.hxx"
+
+
+namespace z5 {
+namespace util {
+
+    TEST(SharedThreadPoolTest, VisitsAllItems) {
+        const std::size_t nItems = 10000;
+        const int nThreads = 4;
+        std::vector<std::atomic<int>> visits(nItems);
+        std::atomic<int> maxRunner(0);
+        parallel_foreach_shared(nThreads, nItems, [&](const int runner, const std::size_t i){
+            ++visits[i];
+            int prev = maxRunner.load();
+            while(runner > prev && !maxRunner.compare_exchange_weak(prev, runner)) {}
+        });
+        for(std::size_t i = 0; i < nItems; ++i) {
+            EXPECT_EQ(visits[i].load(), 1);
+        }
+        // runner ids index per-thread state, so they must stay below nThreads
+        EXPECT_LT(maxRunner.load(), nThreads);
+        // the pool grows on demand and is reused by the next call
+        EXPECT_GE(sharedThreadPoolSize(), std::size_t(nThreads - 1));
+    }
+
+    TEST(SharedThreadPoolTest, ParallelForeachPerThreadState) {
+        const int nThreads = 3;
+        const std::ptrdiff_t nItems = 1000;
+        std::vector<int64_t> sums(nThreads, 0);
+        parallel_foreach(nThreads, nItems, [&](const int tid, const int64_t i){
+            sums[tid] += i;
+        });
+        int64_t sum = 0;
+        for(const auto s : sums) {
+            sum += s;
+        }
+        EXPECT_EQ(sum, nItems * (nItems - 1) / 2);
+    }
+
+    TEST(SharedThreadPoolTest, PropagatesException) {
+        std::atomic<int> visited(0);
+        EXPECT_THROW(
+            parallel_foreach_shared(4, 100, [&](const int, const std::size_t i){
+                ++visited;
+                if(i == 10) {
+                    throw std::runtime_error("fail");
+                }
+            }),
+            std::runtime_error);
+        EXPECT_LE(visited.load(), 100);
+        // the pool stays usable after a failed loop
+        std::atomic<int> count(0);
+        parallel_foreach_shared(4, 100, [&](const int, const std::size_t){ ++count; });
+        EXPECT_EQ(count.load(), 100);
+    }
+
+    TEST(SharedThreadPoolTest, NestedLoops) {
+        // the caller takes part in its own loop, so nesting on the shared pool cannot deadlock
+        std::atomic<int> count(0);
+        parallel_foreach_shared(4, 16, [&](const int, const std::size_t){
+            parallel_foreach_shared(4, 16, [&](const int, const std::size_t){ ++count; });
+        });
+        EXPECT_EQ(count.load(), 16 * 16);
+    }
+
+    TEST(SharedThreadPoolTest, ThreadLocalScratch) {
+        std::vector<int> * first = nullptr;
+        {
+            ThreadLocalScratch<std::vector<int>> scratch([]{ return std::vector<int>(10, 1); });
+            first = &scratch.get();
+            EXPECT_EQ(first->size(), 10);
+            // nested acquisition on the same thread gets its own object
+            ThreadLocalScratch<std::vector<int>> nested([]{ return std::vector<int>(5, 2); });
+            EXPECT_NE(&nested.get(), first);
+        }
+        {
+            // reused across acquisitions
+            ThreadLocalScratch<std::vector<int>> scratch([]{ return std::vector<int>(); });
+            EXPECT_EQ(&scratch.get(), first);
+            EXPECT_EQ(scratch.get().size(), 10);
+        }
+        releaseThreadScratch();
+        {
+            ThreadLocalScratch<std::vector<int>> scratch([]{ return std::vector<int>(3, 0); });
+            EXPECT_EQ(scratch.get().size(), 3);
+        }
+    }
+
+    TEST(WorkStealingTest, UnevenItemCosts) {
+        // all expensive items sit in the first runner's initial range,
+        // the other runners have to steal them
+        ThreadPool pool(3);
+        const std::size_t nItems = 64;
+        std::vector<std::atomic<int>> visits(nItems);
+        std::vector<std::atomic<int>> runnerOf(nItems);
+        parallel_foreach_stealing(pool, 4, nItems, [&](const int runner, const std::size_t i){
+            if(i < nItems / 4) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+            ++visits[i];
+            runnerOf[i] = runner;
+        });
+        for(std::size_t i = 0; i < nItems; ++i) {
+            EXPECT_EQ(visits[i].load(), 1);
+            EXPECT_LT(runnerOf[i].load(), 4);
+        }
+        bool stolen = false;
+        for(std::size_t i = 0; i < nItems / 4; ++i) {
+            stolen |= runnerOf[i].load() != 0;
+        }
+        EXPECT_TRUE(stolen);
+    }
+
+    TEST(WorkStealingTest, FixedGrainSize) {
+        ThreadPool pool(2);
+        for(const std::size_t grain : {std::size_t(1), std::size_t(7), std::size_t(1000)}) {
+            std::atomic<std::size_t> sum(0);
+            parallel_foreach_stealing(pool, 3, 500, [&](const int, const std::size_t i){
+                sum += i;
+            }, grain);
+            EXPECT_EQ(sum.load(), std::size_t(500 * 499 / 2));
+        }
+    }
+
+    TEST(WorkStealingTest, ExplicitPoolIndices) {
+        ThreadPool pool(3);
+        const std::ptrdiff_t nItems = 2000;
+        std::vector<int64_t> sums(pool.nThreads(), 0);
+        parallel_foreach(pool, nItems, [&](const int tid, const int64_t i){
+            sums[tid] += i;
+        });
+        int64_t sum = 0;
+        for(const auto s : sums) {
+            sum += s;
+        }
+        EXPECT_EQ(sum, nItems * (nItems - 1) / 2);
+    }
+
+    TEST(SharedThreadPoolTest, FixedSize) {
+        setSharedThreadPoolSize(2);
+        EXPECT_EQ(sharedThreadPoolSize(), 2);
+        std::atomic<int> maxRunner(0);
+        parallel_foreach_shared(8, 1000, [&](const int runner, const std::size_t){
+            int prev = maxRunner.load();
+            while(runner > prev && !maxRunner.compare_exchange_weak(prev, runner)) {}
+        });
+        // caller + 2 workers
+        EXPECT_LT(maxRunner.load(), 3);
+        setSharedThreadPoolSize(0);
+        std::atomic<int> count(0);
+        parallel_foreach_shared(8, 100, [&](const int runner, const std::size_t){
+            EXPECT_EQ(runner, 0);
+            ++count;
+        });
+        EXPECT_EQ(count.load(), 100);
+    }
+
+}
+}
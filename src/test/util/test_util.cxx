@@ -1,6 +1,12 @@
+#include <fstream>
+#include <iterator>
+#include <map>
 #include <random>
 #include "gtest/gtest.h"
 #include "z5/util/util.hxx"
+#include "z5/util/lru_cache.hxx"
+#include "z5/util/disk_cache.hxx"
+#include "z5/util/write_behind.hxx"
 
 
 namespace test_util_detail {
@@ -121,5 +127,281 @@ namespace util {
         }
     }
 
+
+    TEST(LruCacheTest, EvictsLeastRecentlyUsed) {
+        LruCache<int, std::string> cache(30);
+        for(int key = 0; key < 3; ++key) {
+            cache.put(key, std::make_shared<const std::string>(std::to_string(key)), 10);
+        }
+        EXPECT_EQ(cache.size(), 3);
+        EXPECT_EQ(cache.bytes(), 30);
+        // touching 0 makes 1 the least recently used entry
+        EXPECT_EQ(*cache.get(0), "0");
+        cache.put(3, std::make_shared<const std::string>("3"), 10);
+        EXPECT_FALSE(cache.get(1));
+        EXPECT_TRUE(cache.get(0));
+        EXPECT_TRUE(cache.get(2));
+
+        // replacing an entry updates its size; values above the budget are not cached
+        cache.put(2, std::make_shared<const std::string>("two"), 20);
+        EXPECT_EQ(*cache.get(2), "two");
+        EXPECT_EQ(cache.bytes(), 30);
+        auto kept = cache.get(0);
+        cache.put(4, std::make_shared<const std::string>("4"), 31);
+        EXPECT_FALSE(cache.get(4));
+        // evicted values stay valid for their users
+        cache.setMaxBytes(0);
+        EXPECT_EQ(cache.size(), 0);
+        EXPECT_EQ(*kept, "0");
+    }
+
+
+    TEST(DiskCacheTest, StoresValidatesAndEvicts) {
+        const fs::path dir = fs::temp_directory_path() / "z5_disk_cache_test";
+        fs::remove_all(dir);
+        DiskCache cache(dir, 4000);
+
+        DiskCache::Entry entry;
+        entry.etag = "\"abc\"";
+        entry.objectSize = 100;
+        entry.validated = 10;
+        entry.data.assign(100, 'a');
+        cache.put("bucket/x", "", entry);
+        entry.data.assign(10, 'r');
+        cache.put("bucket/x", "bytes=-10", entry);
+
+        // the whole object and a range of it are separate entries
+        DiskCache::Entry out;
+        EXPECT_FALSE(cache.get("bucket/y", "", out));
+        ASSERT_TRUE(cache.get("bucket/x", "", out));
+        EXPECT_EQ(out.etag, "\"abc\"");
+        EXPECT_EQ(out.objectSize, 100);
+        EXPECT_EQ(out.validated, 10);
+        EXPECT_EQ(out.data, std::vector<char>(100, 'a'));
+        ASSERT_TRUE(cache.get("bucket/x", "bytes=-10", out));
+        EXPECT_EQ(out.data, std::vector<char>(10, 'r'));
+
+        // revalidation only updates the time; a second cache on the directory sees it
+        cache.setValidated("bucket/x", "", 20);
+        DiskCache other(dir, 4000);
+        ASSERT_TRUE(other.get("bucket/x", "", out));
+        EXPECT_EQ(out.validated, 20);
+        EXPECT_EQ(out.data.size(), 100);
+
+        // erasing an object drops all of its entries
+        cache.erase("bucket/x");
+        EXPECT_FALSE(cache.get("bucket/x", "", out));
+        EXPECT_FALSE(cache.get("bucket/x", "bytes=-10", out));
+
+        // entries above the budget are not stored, others are evicted least recently used first
+        entry.data.assign(5000, 'b');
+        cache.put("bucket/big", "", entry);
+        EXPECT_FALSE(cache.get("bucket/big", "", out));
+        entry.data.assign(1000, 'c');
+        for(int i = 0; i < 3; ++i) {
+            cache.put("bucket/" + std::to_string(i), "", entry);
+        }
+        // age all entries, then use 1 and 2 again, which leaves 0 least recently used
+        const auto old = fs::file_time_type::clock::now() - std::chrono::hours(1);
+        for(const auto & file : fs::recursive_directory_iterator(dir)) {
+            if(file.is_regular_file()) {
+                fs::last_write_time(file.path(), old);
+            }
+        }
+        EXPECT_TRUE(cache.get("bucket/1", "", out));
+        EXPECT_TRUE(cache.get("bucket/2", "", out));
+        cache.put("bucket/3", "", entry);
+        EXPECT_FALSE(cache.get("bucket/0", "", out));
+        EXPECT_TRUE(cache.get("bucket/1", "", out));
+        EXPECT_TRUE(cache.get("bucket/2", "", out));
+        EXPECT_TRUE(cache.get("bucket/3", "", out));
+
+        // entries cut off by a power loss or with damaged bytes miss and are dropped
+        std::vector<fs::path> entries;
+        for(const auto & file : fs::recursive_directory_iterator(dir)) {
+            if(file.is_regular_file() && file.path().filename() != ".lock") {
+                entries.push_back(file.path());
+            }
+        }
+        ASSERT_EQ(entries.size(), 3);
+        std::map<std::string, fs::path> byName;
+        for(const auto & name : {"bucket/1", "bucket/2", "bucket/3"}) {
+            for(const auto & path : entries) {
+                std::ifstream file(path, std::ios::binary);
+                const std::string content((std::istreambuf_iterator<char>(file)),
+                                          std::istreambuf_iterator<char>());
+                if(content.find(name) != std::string::npos) {
+                    byName[name] = path;
+                }
+            }
+        }
+        fs::resize_file(byName["bucket/1"], fs::file_size(byName["bucket/1"]) - 10);
+        {
+            std::fstream file(byName["bucket/2"], std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(-1, std::ios::end);
+            file.put('x');
+        }
+        EXPECT_FALSE(cache.get("bucket/1", "", out));
+        EXPECT_FALSE(cache.get("bucket/2", "", out));
+        EXPECT_TRUE(cache.get("bucket/3", "", out));
+        EXPECT_FALSE(fs::exists(byName["bucket/1"]));
+        EXPECT_FALSE(fs::exists(byName["bucket/2"]));
+        fs::remove_all(dir);
+    }
+
+
+
+    TEST(WriteBehindTest, StagesUploadsAndResumes) {
+        const fs::path dir = fs::temp_directory_path() / "z5_write_behind_test";
+        fs::remove_all(dir);
+
+        // a fake remote store whose uploads can be held back or made to fail
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool hold = true, fail = false;
+        int nFailed = 0;
+        std::map<std::string, std::vector<char>> store;
+        auto upload = [&](const std::string & object, const std::string & context,
+                          const std::vector<char> & data) {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&](){return !hold;});
+            if(fail) {
+                ++nFailed;
+                cv.notify_all();
+                throw std::runtime_error("upload failed");
+            }
+            EXPECT_EQ(context, "ctx");
+            store[object] = data;
+        };
+        auto release = [&](const bool failUploads) {
+            std::lock_guard<std::mutex> lock(mutex);
+            hold = false;
+            fail = failUploads;
+            cv.notify_all();
+        };
+
+        const std::vector<char> a(100, 'a'), b(50, 'b'), c(10, 'c');
+        {
+            // one uploader: it holds the first write of x, the others wait in the queue
+            WriteBehind staging(dir, 1, 1 << 20, upload);
+            staging.stage("x", "ctx", a.data(), a.size());
+            staging.stage("x", "ctx", b.data(), b.size());
+            staging.stage("y", "ctx", c.data(), c.size());
+            staging.stage("z", "ctx", c.data(), c.size());
+            staging.erase("z");
+
+            // pending objects are read from their newest staged write
+            auto staged = staging.find("x");
+            ASSERT_TRUE(staged);
+            std::vector<char> out;
+            ASSERT_TRUE(staged->read(out));
+            EXPECT_EQ(out, b);
+            EXPECT_FALSE(staging.find("z"));
+
+            release(true);
+            EXPECT_THROW(staging.flush(), std::runtime_error);
+            // failed uploads stay staged and readable, and are retried by the next flush
+            EXPECT_EQ(staging.pending(), 2);
+            ASSERT_TRUE(staging.find("y"));
+            release(false);
+            staging.flush();
+            EXPECT_EQ(staging.pending(), 0);
+            EXPECT_EQ(staging.stagedBytes(), 0);
+            // the old write of x was replaced, not uploaded after the new one
+            EXPECT_EQ(store["x"], b);
+            EXPECT_EQ(store["y"], c);
+            EXPECT_EQ(store.count("z"), 0);
+            // an upload that failed in the background is not reported once a retry succeeds
+            release(true);
+            const int failed = nFailed;
+            staging.stage("w", "ctx", c.data(), c.size());
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&](){return nFailed > failed;});
+            }
+            release(false);
+            EXPECT_NO_THROW(staging.flush());
+            EXPECT_EQ(store["w"], c);
+            // a dataset removal drops all of its pending objects
+            release(true);
+            staging.stage("ds/0", "ctx", a.data(), a.size());
+            staging.stage("ds/1", "ctx", a.data(), a.size());
+            staging.stage("ds2/0", "ctx", c.data(), c.size());
+            staging.erasePrefix("ds/");
+            EXPECT_EQ(staging.pending(), 1);
+            // the directory is locked while it is used
+            EXPECT_THROW(WriteBehind(dir, 1, 1 << 20, upload), std::runtime_error);
+            // ds2/0 failed to upload and is still staged when the staging is closed
+        }
+
+        // the objects left staged are uploaded by the next process
+        store.clear();
+        release(false);
+        {
+            WriteBehind resumed(dir, 1, 1 << 20, upload);
+            resumed.flush();
+            EXPECT_EQ(store.size(), 1);
+            EXPECT_EQ(store["ds2/0"], c);
+        }
+
+        // staged files cut off by a power loss (in the body or in the header) and files
+        // with foreign names are set aside, not uploaded, and do not prevent resuming
+        store.clear();
+        release(true);
+        {
+            WriteBehind staging(dir, 1, 1 << 20, upload);
+            staging.stage("cut-body", "ctx", a.data(), a.size());
+            staging.stage("cut-header", "ctx", a.data(), a.size());
+            staging.stage("whole", "ctx", c.data(), c.size());
+        }
+        std::vector<fs::path> staged;
+        for(const auto & entry : fs::directory_iterator(dir)) {
+            if(entry.path().extension() == ".obj") {
+                staged.push_back(entry.path());
+            }
+        }
+        std::sort(staged.begin(), staged.end());
+        ASSERT_EQ(staged.size(), 3);
+        fs::resize_file(staged[0], fs::file_size(staged[0]) - 10);
+        fs::resize_file(staged[1], 12);
+        std::ofstream(dir / "not-hex.obj") << "x";
+        release(false);
+        {
+            WriteBehind resumed(dir, 1, 1 << 20, upload);
+            resumed.flush();
+        }
+        EXPECT_EQ(store.size(), 1);
+        EXPECT_EQ(store["whole"], c);
+        std::size_t nCorrupt = 0;
+        for(const auto & entry : fs::directory_iterator(dir)) {
+            nCorrupt += entry.path().extension() == ".corrupt";
+        }
+        EXPECT_EQ(nCorrupt, 3);
+
+        // while uploads fail, writes over the budget fail instead of filling the disk
+        store.clear();
+        release(true);
+        {
+            WriteBehind staging(dir, 1, 150, upload);
+            const int failed = nFailed;
+            staging.stage("u", "ctx", a.data(), a.size());
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&](){return nFailed > failed;});
+            }
+            staging.stage("v", "ctx", c.data(), c.size());
+            EXPECT_THROW(staging.stage("t", "ctx", a.data(), a.size()), std::runtime_error);
+            EXPECT_EQ(staging.stagedBytes(), a.size() + c.size());
+            EXPECT_FALSE(staging.find("t"));
+            release(false);
+            staging.flush();
+            staging.stage("t", "ctx", a.data(), a.size());
+            staging.flush();
+        }
+        EXPECT_EQ(store.size(), 3);
+        EXPECT_EQ(store["t"], a);
+        fs::remove_all(dir);
+    }
+
 }
 }